@@ -0,0 +1,635 @@
+#include "candidates.h"
+#include "globals.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+CandidateSet candidates_create(const size_t width, const size_t stride) {
+  CandidateSet set;
+  set.width = width;
+  set.stride = stride > 0 ? stride : 1;
+  set.count = 0;
+  set.uniform = false;
+  set.value = 0;
+  set.size = 0;
+  set.capacity = 64;
+  set.blocks = calloc(set.capacity, sizeof(CandidateBlock));
+
+  if (set.blocks == NULL) {
+    exit_error("Error allocating candidate blocks");
+  }
+
+  return set;
+}
+
+void candidate_block_destroy(CandidateBlock *block) {
+  if (block->mapped) {
+    block->data = NULL;
+    block->values = NULL;
+    return;
+  }
+
+  free(block->data);
+  free(block->values);
+  block->data = NULL;
+  block->values = NULL;
+
+  if (block->kind == BLOCK_ALL) {
+    snapshot_destroy(&block->snapshot);
+  }
+}
+
+void candidates_clear(CandidateSet *set) {
+  for (size_t i = 0; i < set->size; i++) {
+    candidate_block_destroy(&set->blocks[i]);
+  }
+
+  set->size = 0;
+  set->count = 0;
+}
+
+void candidates_destroy(CandidateSet *set) {
+  candidates_clear(set);
+  free(set->blocks);
+  set->blocks = NULL;
+  set->capacity = 0;
+}
+
+static size_t varint_size(unsigned long value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+
+  return size;
+}
+
+static size_t varint_put(unsigned char *out, unsigned long value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (unsigned char)value;
+
+  return n;
+}
+
+static unsigned long varint_get(const unsigned char *data, size_t *pos) {
+  unsigned long value = 0;
+  unsigned int shift = 0;
+
+  while (data[*pos] & 0x80) {
+    value |= (unsigned long)(data[*pos] & 0x7F) << shift;
+    shift += 7;
+    (*pos)++;
+  }
+  value |= (unsigned long)data[*pos] << shift;
+  (*pos)++;
+
+  return value;
+}
+
+CandidateBlock candidate_block_encode(const size_t stride, const size_t width,
+                                      const unsigned long base,
+                                      const unsigned long span,
+                                      const unsigned long *addresses,
+                                      const unsigned char *values,
+                                      const size_t count) {
+  CandidateBlock block;
+  memset(&block, 0, sizeof(block));
+  block.base = base - base % stride;
+  block.span = base + span - block.base;
+  block.count = count;
+
+  if (values != NULL && count > 0) {
+    block.values = malloc(count * width);
+
+    if (block.values == NULL) {
+      exit_error("Error allocating candidate values");
+    }
+
+    memcpy(block.values, values, count * width);
+  }
+
+  const unsigned long slots = (block.span + stride - 1) / stride;
+  const size_t bitmap_size = (slots + 7) / 8;
+
+  size_t sparse_size = 0;
+  unsigned long previous = 0;
+  for (size_t i = 0; i < count && sparse_size <= bitmap_size; i++) {
+    const unsigned long slot = (addresses[i] - block.base) / stride;
+    sparse_size += varint_size(slot - previous);
+    previous = slot;
+  }
+
+  if (sparse_size < bitmap_size) {
+    block.kind = BLOCK_SPARSE;
+    block.data_size = sparse_size;
+    block.data = malloc(sparse_size);
+
+    if (block.data == NULL) {
+      exit_error("Error allocating candidate block");
+    }
+
+    size_t pos = 0;
+    previous = 0;
+    for (size_t i = 0; i < count; i++) {
+      const unsigned long slot = (addresses[i] - block.base) / stride;
+      pos += varint_put(block.data + pos, slot - previous);
+      previous = slot;
+    }
+  } else {
+    block.kind = BLOCK_BITMAP;
+    block.data_size = bitmap_size;
+    block.data = calloc(bitmap_size, 1);
+
+    if (block.data == NULL) {
+      exit_error("Error allocating candidate block");
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      const unsigned long slot = (addresses[i] - block.base) / stride;
+      block.data[slot / 8] |= (unsigned char)(1 << (slot % 8));
+    }
+  }
+
+  return block;
+}
+
+CandidateBlock candidate_block_snapshot(const size_t width,
+                                        const unsigned long base,
+                                        const unsigned char *buf,
+                                        const size_t len) {
+  CandidateBlock block;
+  memset(&block, 0, sizeof(block));
+  block.kind = BLOCK_ALL;
+  block.base = base;
+  block.span = len - len % width;
+  block.count = len / width;
+  block.snapshot = snapshot_encode(buf, block.span);
+
+  return block;
+}
+
+void candidates_push(CandidateSet *set, CandidateBlock block) {
+  if (block.count == 0) {
+    candidate_block_destroy(&block);
+    return;
+  }
+
+  if (set->size >= set->capacity) {
+    set->capacity *= GROWTH_FACTOR;
+    CandidateBlock *blocks =
+        realloc(set->blocks, set->capacity * sizeof(CandidateBlock));
+
+    if (blocks == NULL) {
+      exit_error("Error allocating candidate blocks");
+    }
+
+    set->blocks = blocks;
+  }
+
+  set->blocks[set->size] = block;
+  set->size++;
+  set->count += block.count;
+}
+
+void candidates_append(CandidateSet *set, const unsigned long base,
+                       const unsigned long span,
+                       const unsigned long *addresses,
+                       const unsigned char *values, const size_t count) {
+  if (count == 0) {
+    return;
+  }
+
+  candidates_push(set, candidate_block_encode(set->stride, set->width, base,
+                                              span, addresses, values, count));
+}
+
+void candidates_decode_block(const CandidateSet *set, const size_t i,
+                             ULongArray *out) {
+  const CandidateBlock *block = &set->blocks[i];
+
+  if (block->kind == BLOCK_ALL) {
+    for (size_t n = 0; n < block->count; n++) {
+      ulong_array_insert(out, block->base + n * set->stride);
+    }
+    return;
+  }
+
+  if (block->kind == BLOCK_SPARSE) {
+    size_t pos = 0;
+    unsigned long slot = 0;
+
+    for (size_t n = 0; n < block->count; n++) {
+      slot += varint_get(block->data, &pos);
+      ulong_array_insert(out, block->base + slot * set->stride);
+    }
+    return;
+  }
+
+  for (size_t byte = 0; byte < block->data_size; byte++) {
+    unsigned int bits = block->data[byte];
+
+    while (bits != 0) {
+      const unsigned long slot = byte * 8 + __builtin_ctz(bits);
+      ulong_array_insert(out, block->base + slot * set->stride);
+      bits &= bits - 1;
+    }
+  }
+}
+
+// Reads a varint that must end before size, false if it doesn't
+static bool varint_get_checked(const unsigned char *data, const size_t size,
+                               size_t *pos, unsigned long *value) {
+  *value = 0;
+
+  for (unsigned int shift = 0; *pos < size && shift < 64; shift += 7) {
+    const unsigned char byte = data[(*pos)++];
+    *value |= (unsigned long)(byte & 0x7F) << shift;
+
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool candidate_block_valid(const CandidateBlock *block, const size_t width,
+                           const size_t stride) {
+  if (block->span == 0 || block->base + block->span < block->base) {
+    return false;
+  }
+
+  const unsigned long slots = (block->span + stride - 1) / stride;
+
+  if (block->kind == BLOCK_ALL) {
+    return block->span % width == 0 && block->count == block->span / width &&
+           block->snapshot.len == block->span &&
+           snapshot_valid(&block->snapshot);
+  }
+
+  // Values of a uniform set are only as wide as its value
+  if (block->values == NULL && width > sizeof(unsigned long)) {
+    return false;
+  }
+
+  if (block->kind == BLOCK_SPARSE) {
+    size_t pos = 0;
+    unsigned long slot = 0;
+
+    for (size_t n = 0; n < block->count; n++) {
+      unsigned long delta;
+      if (!varint_get_checked(block->data, block->data_size, &pos, &delta) ||
+          (n > 0 && delta == 0) || delta >= slots - slot) {
+        return false;
+      }
+      slot += delta;
+    }
+
+    return pos == block->data_size;
+  }
+
+  if (block->data_size != (slots + 7) / 8) {
+    return false;
+  }
+
+  // Every set bit is a candidate, and none lies past the last slot
+  size_t count = 0;
+  for (size_t byte = 0; byte < block->data_size; byte++) {
+    count += __builtin_popcount(block->data[byte]);
+  }
+  const unsigned int tail = slots % 8;
+  if (tail != 0 && (block->data[block->data_size - 1] >> tail) != 0) {
+    return false;
+  }
+
+  return count == block->count;
+}
+
+CandidateIter candidates_iter(const CandidateSet *set) {
+  CandidateIter iter;
+  iter.set = set;
+  iter.block = 0;
+  iter.index = 0;
+  iter.pos = 0;
+  iter.slot = 0;
+
+  return iter;
+}
+
+bool candidates_next(CandidateIter *iter, unsigned long *address) {
+  const CandidateSet *set = iter->set;
+
+  while (iter->block < set->size) {
+    const CandidateBlock *block = &set->blocks[iter->block];
+
+    if (iter->index < block->count) {
+      if (block->kind == BLOCK_ALL) {
+        iter->slot = iter->index;
+      } else if (block->kind == BLOCK_SPARSE) {
+        iter->slot += varint_get(block->data, &iter->pos);
+      } else {
+        // pos is the next bit to look at
+        while (!(block->data[iter->pos / 8] & (1 << (iter->pos % 8)))) {
+          iter->pos++;
+        }
+        iter->slot = iter->pos++;
+      }
+
+      iter->index++;
+      *address = block->base + iter->slot * set->stride;
+      return true;
+    }
+
+    iter->block++;
+    iter->index = 0;
+    iter->pos = 0;
+    iter->slot = 0;
+  }
+
+  return false;
+}
+
+// Copies the values of the candidates at indices of block to out, reading
+// them from the snapshot for BLOCK_ALL
+static void block_values(const size_t width, const CandidateBlock *block,
+                         const ULongArray *indices, unsigned char *out) {
+  unsigned char page[PAGE_SIZE];
+  size_t loaded_page = SIZE_MAX;
+
+  for (size_t n = 0; n < indices->size; n++) {
+    const size_t offset = indices->items[n] * width;
+
+    if (block->kind == BLOCK_ALL) {
+      if (offset / PAGE_SIZE != loaded_page) {
+        loaded_page = offset / PAGE_SIZE;
+        snapshot_page(&block->snapshot, loaded_page, page);
+      }
+      memcpy(out + n * width, page + offset % PAGE_SIZE, width);
+    } else {
+      memcpy(out + n * width, block->values + offset, width);
+    }
+  }
+}
+
+CandidateSet candidates_intersect(const CandidateSet *a,
+                                  const CandidateSet *b) {
+  CandidateSet out = candidates_create(a->width, a->stride);
+  out.uniform = a->uniform;
+  out.value = a->value;
+  ULongArray addresses = ulong_array_create(1024);
+  ULongArray common = ulong_array_create(1024);
+  ULongArray indices = ulong_array_create(1024);
+  unsigned char *values = NULL;
+  CandidateIter other = candidates_iter(b);
+  unsigned long other_address;
+  bool other_valid = candidates_next(&other, &other_address);
+
+  for (size_t i = 0; i < a->size && other_valid; i++) {
+    const CandidateBlock *block = &a->blocks[i];
+
+    ulong_array_clear(&addresses);
+    ulong_array_clear(&common);
+    ulong_array_clear(&indices);
+    candidates_decode_block(a, i, &addresses);
+
+    for (size_t n = 0; n < addresses.size && other_valid; n++) {
+      while (other_valid && other_address < addresses.items[n]) {
+        other_valid = candidates_next(&other, &other_address);
+      }
+
+      if (other_valid && other_address == addresses.items[n]) {
+        ulong_array_insert(&common, addresses.items[n]);
+        ulong_array_insert(&indices, n);
+      }
+    }
+
+    // Carry over the old values of the survivors
+    if (block->values != NULL || block->kind == BLOCK_ALL) {
+      unsigned char *grown = realloc(values, common.size * a->width + 1);
+
+      if (grown == NULL) {
+        exit_error("Error allocating candidate values");
+      }
+
+      values = grown;
+      block_values(a->width, block, &indices, values);
+    }
+
+    const bool has_values = block->values != NULL || block->kind == BLOCK_ALL;
+    candidates_append(&out, block->base, block->span, common.items,
+                      has_values ? values : NULL, common.size);
+  }
+
+  free(values);
+  ulong_array_destroy(&addresses);
+  ulong_array_destroy(&common);
+  ulong_array_destroy(&indices);
+
+  return out;
+}
+
+// Index of the range holding [address, address + width), or ranges->size
+static size_t find_range(const PMRegionArray *ranges, const unsigned long address,
+                         const size_t width) {
+  size_t low = 0;
+  size_t high = ranges->size;
+
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (ranges->regions[mid].end <= address) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  if (low < ranges->size && ranges->regions[low].start <= address &&
+      address + width <= ranges->regions[low].end) {
+    return low;
+  }
+
+  return ranges->size;
+}
+
+void candidates_clip(CandidateSet *set, const PMRegionArray *ranges) {
+  ULongArray addresses = ulong_array_create(1024);
+  ULongArray kept = ulong_array_create(1024);
+  ULongArray indices = ulong_array_create(1024);
+  CandidateBlock *blocks = set->blocks;
+  const size_t block_count = set->size;
+
+  set->blocks = calloc(set->capacity, sizeof(CandidateBlock));
+  set->size = 0;
+  set->count = 0;
+
+  if (set->blocks == NULL) {
+    exit_error("Error allocating candidate blocks");
+  }
+
+  for (size_t i = 0; i < block_count; i++) {
+    CandidateBlock *block = &blocks[i];
+    const unsigned long last = block->base + block->span - 1;
+
+    // Blocks lying inside one range are moved over untouched
+    const size_t range = find_range(ranges, block->base, 1);
+    if (range < ranges->size &&
+        last + set->width <= ranges->regions[range].end) {
+      candidates_push(set, *block);
+      continue;
+    }
+
+    ulong_array_clear(&addresses);
+    ulong_array_clear(&kept);
+    ulong_array_clear(&indices);
+
+    const CandidateSet single = {.width = set->width,
+                                 .stride = set->stride,
+                                 .size = 1,
+                                 .blocks = block};
+    candidates_decode_block(&single, 0, &addresses);
+
+    for (size_t n = 0; n < addresses.size; n++) {
+      if (find_range(ranges, addresses.items[n], set->width) < ranges->size) {
+        ulong_array_insert(&kept, addresses.items[n]);
+        ulong_array_insert(&indices, n);
+      }
+    }
+
+    unsigned char *values = NULL;
+    if (block->values != NULL || block->kind == BLOCK_ALL) {
+      values = malloc(kept.size * set->width + 1);
+
+      if (values == NULL) {
+        exit_error("Error allocating candidate values");
+      }
+
+      block_values(set->width, block, &indices, values);
+    }
+
+    candidates_append(set, block->base, block->span, kept.items, values,
+                      kept.size);
+    free(values);
+    candidate_block_destroy(block);
+  }
+
+  free(blocks);
+  ulong_array_destroy(&addresses);
+  ulong_array_destroy(&kept);
+  ulong_array_destroy(&indices);
+}
+
+// Gives every block its own copy of the set's uniform value
+static void candidates_materialize(CandidateSet *set) {
+  if (!set->uniform) {
+    return;
+  }
+
+  for (size_t i = 0; i < set->size; i++) {
+    CandidateBlock *block = &set->blocks[i];
+
+    if (block->kind == BLOCK_ALL || block->values != NULL) {
+      continue;
+    }
+
+    // The block takes its own copy of the file before owning any values
+    if (block->mapped) {
+      unsigned char *data = malloc(block->data_size + 1);
+      if (data == NULL) {
+        exit_error("Error allocating candidate block");
+      }
+
+      memcpy(data, block->data, block->data_size);
+      block->data = data;
+      block->mapped = false;
+    }
+
+    block->values = malloc(block->count * set->width);
+    if (block->values == NULL) {
+      exit_error("Error allocating candidate values");
+    }
+
+    for (size_t n = 0; n < block->count; n++) {
+      memcpy(block->values + n * set->width, &set->value, set->width);
+    }
+  }
+
+  set->uniform = false;
+}
+
+void candidates_merge(CandidateSet *set, CandidateSet *other) {
+  if (other->count == 0) {
+    candidates_destroy(other);
+    return;
+  }
+
+  if (set->count == 0) {
+    candidates_destroy(set);
+    *set = *other;
+    return;
+  }
+
+  if (set->uniform != other->uniform || set->value != other->value) {
+    candidates_materialize(set);
+    candidates_materialize(other);
+  }
+
+  CandidateBlock *blocks = set->blocks;
+  const size_t block_count = set->size;
+  size_t i = 0;
+  size_t j = 0;
+
+  set->capacity = block_count + other->size;
+  set->blocks = calloc(set->capacity, sizeof(CandidateBlock));
+  set->size = 0;
+  set->count = 0;
+
+  if (set->blocks == NULL) {
+    exit_error("Error allocating candidate blocks");
+  }
+
+  while (i < block_count || j < other->size) {
+    if (j == other->size ||
+        (i < block_count && blocks[i].base < other->blocks[j].base)) {
+      candidates_push(set, blocks[i++]);
+    } else {
+      candidates_push(set, other->blocks[j++]);
+    }
+  }
+
+  // The blocks now belong to set
+  free(blocks);
+  other->size = 0;
+  candidates_destroy(other);
+}
+
+size_t candidate_block_memory(const CandidateBlock *block,
+                              const size_t width) {
+  if (block->mapped) {
+    return 0;
+  }
+
+  size_t bytes = block->data_size;
+  if (block->values != NULL) {
+    bytes += block->count * width;
+  }
+  if (block->kind == BLOCK_ALL) {
+    bytes += snapshot_memory(&block->snapshot);
+  }
+
+  return bytes;
+}
+
+size_t candidates_memory(const CandidateSet *set) {
+  size_t bytes = set->capacity * sizeof(CandidateBlock);
+
+  for (size_t i = 0; i < set->size; i++) {
+    bytes += candidate_block_memory(&set->blocks[i], set->width);
+  }
+
+  return bytes;
+}
@@ -0,0 +1,119 @@
+#ifndef CANDIDATES_H
+#define CANDIDATES_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "regions.h"
+#include "snapshot.h"
+#include "ulong_array.h"
+
+typedef enum {
+  BLOCK_BITMAP, // One bit per slot of the block
+  BLOCK_SPARSE, // Varint slot deltas, the first one relative to base
+  BLOCK_ALL,    // Every slot, with a snapshot of the memory behind them
+} BlockKind;
+
+// Candidates inside [base, base + span). Slots are stride bytes apart and
+// base is a multiple of stride, so every candidate is a whole slot.
+// values holds the last seen value of each candidate, width bytes apiece in
+// candidate order, unless the set's value is uniform. A mapped block points
+// into a loaded session file and owns none of its memory.
+typedef struct {
+  unsigned long base;
+  unsigned long span;
+  size_t count;
+  BlockKind kind;
+  size_t data_size;
+  unsigned char *data;
+  unsigned char *values;
+  Snapshot snapshot;
+  bool mapped;
+} CandidateBlock;
+
+// Addresses that still match, in increasing order, grouped in blocks that
+// each pick the smaller of a bitmap and a delta list. When uniform is set,
+// every candidate was last seen holding value, and blocks keep no values.
+typedef struct {
+  size_t width;
+  size_t stride;
+  size_t count;
+  bool uniform;
+  unsigned long value;
+  size_t size;
+  size_t capacity;
+  CandidateBlock *blocks;
+} CandidateSet;
+
+typedef struct {
+  const CandidateSet *set;
+  size_t block;
+  size_t index;
+  size_t pos;
+  unsigned long slot;
+} CandidateIter;
+
+CandidateSet candidates_create(size_t width, size_t stride);
+
+void candidates_destroy(CandidateSet *set);
+
+void candidates_clear(CandidateSet *set);
+
+// Encodes count sorted addresses from [base, base + span) on its own, so
+// workers can build blocks in parallel and push them in order afterwards.
+// values, if not NULL, holds width bytes per address and is copied.
+CandidateBlock candidate_block_encode(size_t stride, size_t width,
+                                      unsigned long base, unsigned long span,
+                                      const unsigned long *addresses,
+                                      const unsigned char *values,
+                                      size_t count);
+
+// Makes every width-sized slot of buf a candidate, keeping buf as snapshot
+CandidateBlock candidate_block_snapshot(size_t width, unsigned long base,
+                                        const unsigned char *buf, size_t len);
+
+void candidate_block_destroy(CandidateBlock *block);
+
+// Whether a block's data, values and snapshot agree with its count and span
+// for a set of width and stride, so a block read from a file can be decoded
+// without reading past any of them. Their sizes must have been checked.
+bool candidate_block_valid(const CandidateBlock *block, size_t width,
+                           size_t stride);
+
+// Takes ownership of block, which must lie past the current last block.
+// Empty blocks are dropped.
+void candidates_push(CandidateSet *set, CandidateBlock block);
+
+// Encodes count sorted addresses from [base, base + span) as a new block.
+// Blocks must be appended in address order.
+void candidates_append(CandidateSet *set, unsigned long base,
+                       unsigned long span, const unsigned long *addresses,
+                       const unsigned char *values, size_t count);
+
+// Appends the addresses of block i to out
+void candidates_decode_block(const CandidateSet *set, size_t i,
+                             ULongArray *out);
+
+CandidateIter candidates_iter(const CandidateSet *set);
+
+bool candidates_next(CandidateIter *iter, unsigned long *address);
+
+// Addresses present in both sets, laid out in a's blocks
+CandidateSet candidates_intersect(const CandidateSet *a, const CandidateSet *b);
+
+// Drops the candidates whose value doesn't lie whole inside one of ranges,
+// which must be sorted and disjoint
+void candidates_clip(CandidateSet *set, const PMRegionArray *ranges);
+
+// Moves the blocks of other into set and destroys other. Their blocks must
+// not overlap. Per-candidate values are kept unless both sets share a
+// uniform value.
+void candidates_merge(CandidateSet *set, CandidateSet *other);
+
+// Heap bytes held by a block's data, values and snapshot
+size_t candidate_block_memory(const CandidateBlock *block, size_t width);
+
+// Heap bytes held by the encoded blocks, their values and snapshots. Mapped
+// blocks are left to the page cache and only count their entry.
+size_t candidates_memory(const CandidateSet *set);
+
+#endif
@@ -0,0 +1,285 @@
+#include "filter.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool float_match_parse(const char *option, FloatMatch *match, double *eps) {
+  if (strcmp(option, "--eps") == 0) {
+    const char *eps_str = strtok(NULL, " ");
+    if (eps_str == NULL) {
+      return false;
+    }
+
+    *match = FLOAT_EPSILON;
+    *eps = fabs(strtod(eps_str, NULL));
+  } else if (strcmp(option, "--round") == 0) {
+    *match = FLOAT_ROUNDED;
+  } else if (strcmp(option, "--truncate") == 0) {
+    *match = FLOAT_TRUNCATED;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+bool filter_parse(Filter *filter, const ValueType type, const size_t width,
+                  const char *first) {
+  filter->type = type;
+  filter->width = width;
+  filter->a.u = 0;
+  filter->b.u = 0;
+  filter->set_size = 0;
+
+  if (first == NULL) {
+    return false;
+  }
+
+  if (strcmp(first, "changed") == 0) {
+    filter->op = FILTER_CHANGED;
+  } else if (strcmp(first, "unchanged") == 0) {
+    filter->op = FILTER_UNCHANGED;
+  } else if (type == STRING) {
+    // Patterns have no order, only their bytes
+    return false;
+  } else if (strcmp(first, "increased") == 0) {
+    filter->op = FILTER_INCREASED;
+  } else if (strcmp(first, "decreased") == 0) {
+    filter->op = FILTER_DECREASED;
+  } else if (strcmp(first, "increased-by") == 0 ||
+             strcmp(first, "decreased-by") == 0) {
+    const char *delta_str = strtok(NULL, " ");
+    if (delta_str == NULL) {
+      return false;
+    }
+
+    filter->op = first[0] == 'i' ? FILTER_INCREASED_BY : FILTER_DECREASED_BY;
+    filter->a = value_parse(type, delta_str);
+  } else if (strcmp(first, "between") == 0) {
+    const char *low_str = strtok(NULL, " ");
+    const char *high_str = strtok(NULL, " ");
+    if (low_str == NULL || high_str == NULL) {
+      return false;
+    }
+
+    filter->op = FILTER_BETWEEN;
+    filter->a = value_parse(type, low_str);
+    filter->b = value_parse(type, high_str);
+  } else if (strcmp(first, "!=") == 0 || strcmp(first, "<") == 0 ||
+             strcmp(first, ">") == 0) {
+    const char *value_str = strtok(NULL, " ");
+    if (value_str == NULL) {
+      return false;
+    }
+
+    filter->op = first[0] == '!'   ? FILTER_NOT_EQUAL
+                 : first[0] == '<' ? FILTER_BELOW
+                                   : FILTER_ABOVE;
+    filter->a = value_parse(type, value_str);
+  } else if (strcmp(first, "mask") == 0) {
+    const char *mask_str = strtok(NULL, " ");
+    const char *bits_str = strtok(NULL, " ");
+    if (mask_str == NULL) {
+      return false;
+    }
+
+    // Masks are bit patterns, in hex as often as not
+    filter->op = FILTER_MASK;
+    filter->a.u = strtoul(mask_str, NULL, 0);
+    filter->b.u = bits_str != NULL ? strtoul(bits_str, NULL, 0) : filter->a.u;
+  } else if (strcmp(first, "in") == 0) {
+    const char *list = strtok(NULL, " ");
+    if (list == NULL) {
+      return false;
+    }
+
+    filter->op = FILTER_ONE_OF;
+    const char *member = list;
+    while (member != NULL) {
+      if (filter->set_size == KERNEL_SET_MAX) {
+        return false;
+      }
+
+      filter->set[filter->set_size++] = value_parse(type, member);
+      member = strchr(member, ',');
+      member = member != NULL ? member + 1 : NULL;
+    }
+  } else {
+    filter->op = FILTER_EQUAL;
+    filter->a = value_parse(type, first);
+
+    // A float with a tolerance matches a range of values instead
+    FloatMatch match = FLOAT_EXACT;
+    double eps = 0;
+    const char *option;
+    while (is_float_type(type) && (option = strtok(NULL, " ")) != NULL) {
+      if (!float_match_parse(option, &match, &eps)) {
+        return false;
+      }
+    }
+
+    if (match != FLOAT_EXACT) {
+      filter->op = FILTER_BETWEEN;
+      value_float_range(type, first, match, eps, &filter->a, &filter->b);
+    }
+  }
+
+  return true;
+}
+
+// Whether current == old + delta in the type's own arithmetic
+static bool moved_by(const ValueType type, const Value old,
+                     const Value current, const Value delta, const int sign) {
+  Value expected;
+
+  if (type == FLOAT32) {
+    expected.f = (float)(old.f + sign * delta.f);
+  } else if (type == DOUBLE64) {
+    expected.f = old.f + sign * delta.f;
+  } else {
+    // Unsigned arithmetic wraps the same way the target's does
+    expected.u = sign > 0 ? old.u + delta.u : old.u - delta.u;
+    return value_bits(type, expected) == value_bits(type, current);
+  }
+
+  return value_compare(type, current, expected) == 0;
+}
+
+bool filter_match(const Filter *filter, const unsigned char *old,
+                  const unsigned char *current) {
+  const ValueType type = filter->type;
+
+  switch (filter->op) {
+  case FILTER_CHANGED:
+    return memcmp(old, current, filter->width) != 0;
+  case FILTER_UNCHANGED:
+    return memcmp(old, current, filter->width) == 0;
+  default:
+    break;
+  }
+
+  const Value now = value_load(type, current);
+
+  switch (filter->op) {
+  case FILTER_EQUAL:
+    return value_compare(type, now, filter->a) == 0;
+  case FILTER_INCREASED:
+    return value_compare(type, now, value_load(type, old)) == 1;
+  case FILTER_DECREASED:
+    return value_compare(type, now, value_load(type, old)) == -1;
+  case FILTER_INCREASED_BY:
+    return moved_by(type, value_load(type, old), now, filter->a, 1);
+  case FILTER_DECREASED_BY:
+    return moved_by(type, value_load(type, old), now, filter->a, -1);
+  case FILTER_BETWEEN: {
+    const int low = value_compare(type, now, filter->a);
+    const int high = value_compare(type, now, filter->b);
+    return (low == 0 || low == 1) && (high == 0 || high == -1);
+  }
+  case FILTER_NOT_EQUAL:
+    return value_compare(type, now, filter->a) != 0;
+  case FILTER_BELOW:
+    return value_compare(type, now, filter->a) == -1;
+  case FILTER_ABOVE:
+    return value_compare(type, now, filter->a) == 1;
+  case FILTER_MASK: {
+    unsigned long bits = 0;
+    memcpy(&bits, current, filter->width);
+    return (bits & filter->a.u) == (filter->b.u & filter->a.u);
+  }
+  case FILTER_ONE_OF: {
+    bool found = false;
+    for (size_t i = 0; i < filter->set_size; i++) {
+      found |= value_compare(type, now, filter->set[i]) == 0;
+    }
+    return found;
+  }
+  default:
+    return false;
+  }
+}
+
+bool filter_is_absolute(const Filter *filter) {
+  switch (filter->op) {
+  case FILTER_CHANGED:
+  case FILTER_UNCHANGED:
+  case FILTER_INCREASED:
+  case FILTER_DECREASED:
+  case FILTER_INCREASED_BY:
+  case FILTER_DECREASED_BY:
+    return false;
+  default:
+    return true;
+  }
+}
+
+// < and > become ranges up to the type's limits. Bounds past the limits are
+// clamped to them before being narrowed to the type, and nothing lies beyond
+// the limits themselves, which leaves an empty set.
+static KernelOp compile_range(const Filter *filter, Value low, Value high,
+                              KernelArgs *args) {
+  const ValueType type = filter->type;
+  const Value min = value_min(type);
+  const Value max = value_max(type);
+
+  if (value_compare(type, low, min) == -1) {
+    low = min;
+  }
+  if (value_compare(type, high, max) == 1) {
+    high = max;
+  }
+
+  const int order = value_compare(type, low, high);
+
+  if (order == 1 || order == 2) {
+    args->set_size = 0;
+    return KERNEL_SET;
+  }
+
+  args->a = value_bits(type, low);
+  args->b = value_bits(type, high);
+  return KERNEL_RANGE;
+}
+
+KernelOp filter_compile(const Filter *filter, KernelArgs *args) {
+  const ValueType type = filter->type;
+  const Value min = value_min(type);
+  const Value max = value_max(type);
+
+  args->a = value_bits(type, filter->a);
+  args->b = 0;
+  args->set_size = 0;
+
+  switch (filter->op) {
+  case FILTER_NOT_EQUAL:
+    return KERNEL_NOT_EQUAL;
+  case FILTER_BETWEEN:
+    return compile_range(filter, filter->a, filter->b, args);
+  case FILTER_BELOW:
+    if (value_compare(type, filter->a, min) != 1) {
+      return compile_range(filter, max, min, args);
+    }
+    return compile_range(filter, min, value_step(type, filter->a, -1), args);
+  case FILTER_ABOVE:
+    if (value_compare(type, filter->a, max) != -1) {
+      return compile_range(filter, max, min, args);
+    }
+    return compile_range(filter, value_step(type, filter->a, 1), max, args);
+  case FILTER_MASK:
+    args->a = filter->a.u;
+    args->b = filter->b.u & filter->a.u;
+    return KERNEL_MASK;
+  case FILTER_ONE_OF:
+    for (size_t i = 0; i < filter->set_size; i++) {
+      args->set[i] = value_bits(type, filter->set[i]);
+    }
+    args->set_size = filter->set_size;
+    return KERNEL_SET;
+  default:
+    return KERNEL_EQUAL;
+  }
+}
+
+bool filter_is_exact(const Filter *filter) {
+  return filter->op == FILTER_EQUAL;
+}
@@ -0,0 +1,58 @@
+#ifndef FILTER_H
+#define FILTER_H
+#include <stdbool.h>
+
+#include "kernels.h"
+#include "value_type.h"
+
+typedef enum {
+  FILTER_EQUAL,        // <value> [--eps <e> | --round | --truncate]
+  FILTER_CHANGED,      // changed
+  FILTER_UNCHANGED,    // unchanged
+  FILTER_INCREASED,    // increased
+  FILTER_DECREASED,    // decreased
+  FILTER_INCREASED_BY, // increased-by <value>
+  FILTER_DECREASED_BY, // decreased-by <value>
+  FILTER_BETWEEN,      // between <low> <high>
+  FILTER_NOT_EQUAL,    // != <value>
+  FILTER_BELOW,        // < <value>
+  FILTER_ABOVE,        // > <value>
+  FILTER_MASK,         // mask <mask> [<bits>], bits set to mask by default
+  FILTER_ONE_OF,       // in <value>,<value>,...
+} FilterOp;
+
+// A next condition, comparing a candidate's current value with a literal or
+// with the value it held at the previous scan
+typedef struct {
+  FilterOp op;
+  ValueType type;
+  size_t width;
+  Value a;
+  Value b;
+  Value set[KERNEL_SET_MAX];
+  size_t set_size;
+} Filter;
+
+// Parses one of --eps <e>, --round or --truncate, reading the argument of
+// --eps from strtok. Returns false on any other option.
+bool float_match_parse(const char *option, FloatMatch *match, double *eps);
+
+// Parses the arguments of next from strtok for candidates of width bytes.
+// Returns false on a bad filter.
+bool filter_parse(Filter *filter, ValueType type, size_t width,
+                  const char *first);
+
+bool filter_match(const Filter *filter, const unsigned char *old,
+                  const unsigned char *current);
+
+// Whether a filter only looks at current values, so a first scan can run it
+bool filter_is_absolute(const Filter *filter);
+
+// The kernel that runs an absolute filter over memory, with its operands
+KernelOp filter_compile(const Filter *filter, KernelArgs *args);
+
+// Whether every survivor ends up holding the same value, so there is no
+// need to keep values per candidate
+bool filter_is_exact(const Filter *filter);
+
+#endif
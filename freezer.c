@@ -0,0 +1,264 @@
+#include "freezer.h"
+#include "globals.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Values are batched by width, as each batch writes a single width
+static const size_t WIDTHS[] = {1, 2, 4, 8};
+#define WIDTH_COUNT (sizeof(WIDTHS) / sizeof(WIDTHS[0]))
+
+Freezer freezer_create(const pid_t pid) {
+  Freezer freezer;
+  freezer.pid = pid;
+  freezer.started = false;
+  freezer.stopping = false;
+  freezer.rate = FREEZE_DEFAULT_RATE;
+  freezer.size = 0;
+  freezer.capacity = 16;
+  freezer.values = malloc(freezer.capacity * sizeof(FrozenValue));
+  memset(&freezer.stats, 0, sizeof(freezer.stats));
+
+  if (freezer.values == NULL) {
+    exit_error("Error allocating frozen values");
+  }
+
+  pthread_mutex_init(&freezer.lock, NULL);
+
+  // Ticks are timed on the monotonic clock
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&freezer.wake, &attr);
+  pthread_condattr_destroy(&attr);
+
+  return freezer;
+}
+
+static unsigned long elapsed_ns(const struct timespec *from,
+                                const struct timespec *to) {
+  return (to->tv_sec - from->tv_sec) * 1000000000UL + to->tv_nsec -
+         from->tv_nsec;
+}
+
+static void add_ns(struct timespec *time, const unsigned long ns) {
+  time->tv_nsec += ns % 1000000000UL;
+  time->tv_sec += ns / 1000000000UL + time->tv_nsec / 1000000000L;
+  time->tv_nsec %= 1000000000L;
+}
+
+// Addresses and values of one width, rebuilt every tick
+typedef struct {
+  size_t size;
+  size_t capacity;
+  unsigned long *addresses;
+  unsigned char *values;
+} FreezeBatch;
+
+static void batch_reserve(FreezeBatch *batch, const size_t capacity) {
+  if (capacity <= batch->capacity) {
+    return;
+  }
+
+  batch->capacity = capacity;
+  batch->addresses =
+      realloc(batch->addresses, capacity * sizeof(unsigned long));
+  batch->values = realloc(batch->values, capacity * sizeof(unsigned long));
+
+  if (batch->addresses == NULL || batch->values == NULL) {
+    exit_error("Error allocating freeze batch");
+  }
+}
+
+static void *freezer_run(void *arg) {
+  Freezer *freezer = arg;
+  MemoryWriter writer = writer_create(freezer->pid);
+  FreezeBatch batches[WIDTH_COUNT];
+  struct timespec deadline;
+
+  memset(batches, 0, sizeof(batches));
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+  pthread_mutex_lock(&freezer->lock);
+  while (!freezer->stopping) {
+    for (size_t w = 0; w < WIDTH_COUNT; w++) {
+      batch_reserve(&batches[w], freezer->size);
+      batches[w].size = 0;
+    }
+
+    for (size_t i = 0; i < freezer->size; i++) {
+      const FrozenValue *value = &freezer->values[i];
+      const size_t width = get_byte_count(value->type);
+      size_t w = 0;
+      while (WIDTHS[w] != width) {
+        w++;
+      }
+
+      FreezeBatch *batch = &batches[w];
+      batch->addresses[batch->size] = value->address;
+      memcpy(batch->values + batch->size * width, &value->bits, width);
+      batch->size++;
+    }
+
+    const unsigned long period = 1000000000UL / freezer->rate;
+    pthread_mutex_unlock(&freezer->lock);
+
+    struct timespec start;
+    struct timespec end;
+    size_t count = 0;
+    size_t written = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t w = 0; w < WIDTH_COUNT; w++) {
+      if (batches[w].size > 0) {
+        written += writer_write(&writer, batches[w].addresses,
+                                batches[w].size, batches[w].values,
+                                WIDTHS[w]);
+        count += batches[w].size;
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    pthread_mutex_lock(&freezer->lock);
+    if (count > 0) {
+      FreezeStats *stats = &freezer->stats;
+      stats->ticks++;
+      stats->writes += written;
+      stats->failures += count - written;
+      stats->last_ns = elapsed_ns(&start, &end);
+      stats->total_ns += stats->last_ns;
+      stats->max_ns =
+          stats->last_ns > stats->max_ns ? stats->last_ns : stats->max_ns;
+    }
+
+    // Fixed deadlines keep the rate steady however long a tick took, but a
+    // thread that fell behind starts over rather than catching up
+    add_ns(&deadline, period);
+    if (elapsed_ns(&end, &deadline) > period) {
+      deadline = end;
+      add_ns(&deadline, period);
+    }
+
+    while (!freezer->stopping &&
+           pthread_cond_timedwait(&freezer->wake, &freezer->lock,
+                                  &deadline) == 0) {
+      // Woken by a change, keep waiting for the deadline
+    }
+  }
+  pthread_mutex_unlock(&freezer->lock);
+
+  for (size_t w = 0; w < WIDTH_COUNT; w++) {
+    free(batches[w].addresses);
+    free(batches[w].values);
+  }
+  writer_destroy(&writer);
+
+  return NULL;
+}
+
+void freezer_destroy(Freezer *freezer) {
+  if (freezer->started) {
+    pthread_mutex_lock(&freezer->lock);
+    freezer->stopping = true;
+    pthread_cond_signal(&freezer->wake);
+    pthread_mutex_unlock(&freezer->lock);
+
+    pthread_join(freezer->thread, NULL);
+  }
+
+  pthread_mutex_destroy(&freezer->lock);
+  pthread_cond_destroy(&freezer->wake);
+  free(freezer->values);
+  freezer->values = NULL;
+}
+
+void freezer_add(Freezer *freezer, const FrozenValue value) {
+  pthread_mutex_lock(&freezer->lock);
+
+  size_t i = 0;
+  while (i < freezer->size && freezer->values[i].address != value.address) {
+    i++;
+  }
+
+  if (i == freezer->size) {
+    if (freezer->size >= freezer->capacity) {
+      freezer->capacity *= GROWTH_FACTOR;
+      FrozenValue *values =
+          realloc(freezer->values, freezer->capacity * sizeof(FrozenValue));
+
+      if (values == NULL) {
+        exit_error("Error allocating frozen values");
+      }
+
+      freezer->values = values;
+    }
+    freezer->size++;
+  }
+
+  freezer->values[i] = value;
+  pthread_mutex_unlock(&freezer->lock);
+
+  if (!freezer->started) {
+    if (pthread_create(&freezer->thread, NULL, freezer_run, freezer) != 0) {
+      exit_error("Error starting freeze thread");
+    }
+    freezer->started = true;
+  }
+}
+
+bool freezer_remove(Freezer *freezer, const unsigned long address) {
+  bool found = false;
+
+  pthread_mutex_lock(&freezer->lock);
+  for (size_t i = 0; i < freezer->size; i++) {
+    if (freezer->values[i].address == address) {
+      freezer->values[i] = freezer->values[freezer->size - 1];
+      freezer->size--;
+      found = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&freezer->lock);
+
+  return found;
+}
+
+void freezer_clear(Freezer *freezer) {
+  pthread_mutex_lock(&freezer->lock);
+  freezer->size = 0;
+  pthread_mutex_unlock(&freezer->lock);
+}
+
+void freezer_set_rate(Freezer *freezer, const unsigned long rate) {
+  pthread_mutex_lock(&freezer->lock);
+  freezer->rate = rate > 0 ? rate : 1;
+  pthread_cond_signal(&freezer->wake);
+  pthread_mutex_unlock(&freezer->lock);
+}
+
+void print_freezer(Freezer *freezer) {
+  pthread_mutex_lock(&freezer->lock);
+
+  for (size_t i = 0; i < freezer->size; i++) {
+    const FrozenValue *frozen = &freezer->values[i];
+    const Value value =
+        value_load(frozen->type, (const unsigned char *)&frozen->bits);
+
+    char value_str[64];
+    value_format(frozen->type, value, value_str, sizeof(value_str));
+    printf("Frozen %s at 0x%lx\n", value_str, frozen->address);
+  }
+
+  const FreezeStats *stats = &freezer->stats;
+  printf("%zu frozen at %lu Hz: %lu ticks, %lu writes, %lu failed\n",
+         freezer->size, freezer->rate, stats->ticks, stats->writes,
+         stats->failures);
+  if (stats->ticks > 0) {
+    printf("Tick latency: last %.3f ms, average %.3f ms, max %.3f ms\n",
+           stats->last_ns / 1e6, stats->total_ns / 1e6 / stats->ticks,
+           stats->max_ns / 1e6);
+  }
+
+  pthread_mutex_unlock(&freezer->lock);
+}
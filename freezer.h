@@ -0,0 +1,63 @@
+#ifndef FREEZER_H
+#define FREEZER_H
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "value_type.h"
+#include "writer.h"
+
+#define FREEZE_DEFAULT_RATE 100 // Ticks per second
+
+typedef struct {
+  unsigned long address;
+  ValueType type;
+  unsigned long bits;
+} FrozenValue;
+
+// Timing of the writer thread's ticks, in nanoseconds
+typedef struct {
+  unsigned long ticks;
+  unsigned long writes;
+  unsigned long failures;
+  unsigned long last_ns;
+  unsigned long max_ns;
+  unsigned long total_ns;
+} FreezeStats;
+
+// Rewrites every frozen value on a background thread, rate times a second,
+// without stopping the target. The thread has its own writer and starts
+// with the first frozen value.
+typedef struct {
+  pid_t pid;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  bool started;
+  bool stopping;
+  unsigned long rate;
+  size_t size;
+  size_t capacity;
+  FrozenValue *values;
+  FreezeStats stats;
+} Freezer;
+
+Freezer freezer_create(pid_t pid);
+
+// Stops the thread, the values are left as last written
+void freezer_destroy(Freezer *freezer);
+
+// Freezes address at value, replacing what was frozen there before
+void freezer_add(Freezer *freezer, FrozenValue value);
+
+// Returns false if address was not frozen
+bool freezer_remove(Freezer *freezer, unsigned long address);
+
+void freezer_clear(Freezer *freezer);
+
+void freezer_set_rate(Freezer *freezer, unsigned long rate);
+
+void print_freezer(Freezer *freezer);
+
+#endif
@@ -0,0 +1,184 @@
+#include "group.h"
+#include "globals.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool group_parse_field(GroupField *field, char *token) {
+  char *colon = strchr(token, ':');
+  char *at = strrchr(token, '@');
+
+  if (colon == NULL || at == NULL || at < colon) {
+    return false;
+  }
+
+  *colon = '\0';
+  *at = '\0';
+
+  field->type = value_type_parse(token);
+  if (field->type == UNKNOWN || field->type == STRING) {
+    return false;
+  }
+
+  char *end;
+  field->width = get_byte_count(field->type);
+  field->offset = strtoul(at + 1, &end, 0);
+
+  return at[1] != '\0' && *end == '\0' &&
+         value_try_parse(field->type, colon + 1, &field->value);
+}
+
+bool group_parse(Group *group, const char *text) {
+  char copy[256];
+  char *save;
+
+  snprintf(copy, sizeof(copy), "%s", text);
+  group->count = 0;
+  group->stride = 1;
+
+  for (char *token = strtok_r(copy, " ", &save); token != NULL;
+       token = strtok_r(NULL, " ", &save)) {
+    if (group->count == GROUP_MAX_FIELDS ||
+        !group_parse_field(&group->fields[group->count], token)) {
+      return false;
+    }
+    group->count++;
+  }
+
+  if (group->count == 0) {
+    return false;
+  }
+
+  // Offsets are made relative to the lowest, where a group starts
+  size_t lowest = 0;
+  for (size_t i = 0; i < group->count; i++) {
+    if (group->fields[i].offset < group->fields[lowest].offset) {
+      lowest = i;
+    }
+  }
+
+  const size_t base = group->fields[lowest].offset;
+  group->first = lowest;
+  group->span = 0;
+
+  for (size_t i = 0; i < group->count; i++) {
+    GroupField *field = &group->fields[i];
+    field->offset -= base;
+
+    if (field->offset + field->width > group->span) {
+      group->span = field->offset + field->width;
+    }
+    if (field->width > group->stride) {
+      group->stride = field->width;
+    }
+  }
+
+  return group->span <= GROUP_MAX_SPAN;
+}
+
+static Filter group_filter(const GroupField *field) {
+  Filter filter;
+  memset(&filter, 0, sizeof(filter));
+  filter.op = FILTER_EQUAL;
+  filter.type = field->type;
+  filter.width = field->width;
+  filter.a = field->value;
+
+  return filter;
+}
+
+void group_count_matches(const Group *group, const unsigned char *buf,
+                         const size_t len, size_t *counts) {
+  ULongArray hits = ulong_array_create(1024);
+
+  for (size_t i = 0; i < group->count; i++) {
+    const GroupField *field = &group->fields[i];
+    const Filter filter = group_filter(field);
+    KernelArgs args;
+    const MatchKernel kernel =
+        kernel_select(field->type, filter_compile(&filter, &args));
+
+    ulong_array_clear(&hits);
+    kernel(buf, len - len % field->width, 0, &args, &hits);
+    counts[i] += hits.size;
+  }
+
+  ulong_array_destroy(&hits);
+}
+
+size_t group_rarest_field(const Group *group, const size_t *counts) {
+  size_t rarest = 0;
+
+  for (size_t i = 1; i < group->count; i++) {
+    if (counts[i] < counts[rarest] ||
+        (counts[i] == counts[rarest] &&
+         group->fields[i].width > group->fields[rarest].width)) {
+      rarest = i;
+    }
+  }
+
+  return rarest;
+}
+
+void group_scan_create(GroupScan *scan, const Group *group,
+                       const size_t anchor) {
+  scan->group = group;
+  scan->anchor = anchor;
+
+  for (size_t i = 0; i < group->count; i++) {
+    scan->filters[i] = group_filter(&group->fields[i]);
+  }
+
+  scan->kernel = kernel_select(group->fields[anchor].type,
+                               filter_compile(&scan->filters[anchor],
+                                              &scan->args));
+}
+
+void group_find(const GroupScan *scan, const unsigned char *buf,
+                const size_t len, const size_t avail,
+                const unsigned long address, ULongArray *hits) {
+  const Group *group = scan->group;
+  const GroupField *anchor = &group->fields[scan->anchor];
+  const size_t begin = hits->size;
+
+  if (avail < group->span) {
+    return;
+  }
+
+  // Searching from the anchor's offset with the piece's address reports
+  // the start of each group directly, aligned to the group's stride
+  kernel_match_strided(scan->kernel, anchor->width, group->stride,
+                       buf + anchor->offset, len, avail - anchor->offset,
+                       address, &scan->args, hits);
+
+  size_t kept = begin;
+  for (size_t i = begin; i < hits->size; i++) {
+    const size_t start = hits->items[i] - address;
+    bool match = start + group->span <= avail;
+
+    for (size_t f = 0; match && f < group->count; f++) {
+      const unsigned char *value = buf + start + group->fields[f].offset;
+      match = f == scan->anchor || filter_match(&scan->filters[f], value,
+                                                value);
+    }
+
+    if (match) {
+      hits->items[kept++] = hits->items[i];
+    }
+  }
+
+  hits->size = kept;
+}
+
+void print_group(const Group *group) {
+  for (size_t i = 0; i < group->count; i++) {
+    const GroupField *field = &group->fields[i];
+    char value_str[64];
+
+    value_format(field->type, field->value, value_str, sizeof(value_str));
+    printf("%s%s %s at +%zu", i > 0 ? ", " : "", value_type_name(field->type),
+           value_str, field->offset);
+  }
+
+  printf("\n");
+}
@@ -0,0 +1,63 @@
+#ifndef GROUP_H
+#define GROUP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "filter.h"
+#include "kernels.h"
+#include "ulong_array.h"
+#include "value_type.h"
+
+#define GROUP_MAX_FIELDS 8
+#define GROUP_MAX_SPAN 4096 // Bytes from the first field to the end of the last
+
+// <type>:<value>@<offset>
+typedef struct {
+  ValueType type;
+  size_t width;
+  size_t offset; // From the field with the lowest offset
+  Value value;
+} GroupField;
+
+// Values at fixed offsets from each other, such as the fields of a struct.
+// Groups start at multiples of stride, which defaults to the widest field
+// as a compiler would align them.
+typedef struct {
+  GroupField fields[GROUP_MAX_FIELDS];
+  size_t count;
+  size_t first; // The field at offset 0, where groups are said to be
+  size_t span;
+  size_t stride;
+} Group;
+
+// A group compiled for a scan. Memory is only searched for the anchor field,
+// with its vectorized kernel, the others are checked at each of its hits.
+typedef struct {
+  const Group *group;
+  size_t anchor;
+  MatchKernel kernel;
+  KernelArgs args;
+  Filter filters[GROUP_MAX_FIELDS];
+} GroupScan;
+
+// Parses whitespace separated fields such as int32:100@0 float32:1.5@0x10.
+// Returns false on a malformed field or a group wider than GROUP_MAX_SPAN.
+bool group_parse(Group *group, const char *text);
+
+// Adds to counts[i] how many values in buf field i matches on its own
+void group_count_matches(const Group *group, const unsigned char *buf,
+                         size_t len, size_t *counts);
+
+// The field with the fewest matches, the widest among equals
+size_t group_rarest_field(const Group *group, const size_t *counts);
+
+void group_scan_create(GroupScan *scan, const Group *group, size_t anchor);
+
+// Appends the address of every group starting in the first len bytes of
+// buf, in address order. Groups may extend into the first avail bytes.
+void group_find(const GroupScan *scan, const unsigned char *buf, size_t len,
+                size_t avail, unsigned long address, ULongArray *hits);
+
+void print_group(const Group *group);
+
+#endif
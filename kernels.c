@@ -0,0 +1,492 @@
+#include "kernels.h"
+#include "globals.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+KernelISA kernel_isa(void) {
+#ifdef KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return ISA_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return ISA_SSE2;
+  }
+#endif
+  return ISA_SCALAR;
+}
+
+const char *kernel_isa_name(void) {
+  switch (kernel_isa()) {
+  case ISA_AVX2:
+    return "avx2";
+  case ISA_SSE2:
+    return "sse2";
+  default:
+    return "scalar";
+  }
+}
+
+// Scalar kernels, also used for the tails the vector kernels leave over
+
+#define SCALAR_KERNEL(name, type, setup, test)                                 \
+  static void name(const unsigned char *buf, const size_t len,                \
+                   const unsigned long address, const KernelArgs *args,       \
+                   ULongArray *hits) {                                         \
+    setup;                                                                     \
+    for (size_t i = 0; i + sizeof(type) <= len; i += sizeof(type)) {           \
+      type value;                                                              \
+      memcpy(&value, buf + i, sizeof(type));                                   \
+      if (test) {                                                              \
+        ulong_array_insert(hits, address + i);                                 \
+      }                                                                        \
+    }                                                                          \
+  }
+
+// An operand of the kernel, from the low bytes of its bits
+#define LOAD_ARG(type, var, bits)                                              \
+  type var;                                                                    \
+  memcpy(&var, &(bits), sizeof(type))
+
+#define LOAD_SET(type, var)                                                    \
+  type var[KERNEL_SET_MAX];                                                    \
+  for (size_t j = 0; j < args->set_size; j++) {                                \
+    memcpy(&var[j], &args->set[j], sizeof(type));                              \
+  }
+
+#define SET_CONTAINS(name, type)                                               \
+  static inline bool name(const type *members, const size_t size,             \
+                          const type value) {                                  \
+    bool found = false;                                                        \
+    for (size_t j = 0; j < size; j++) {                                        \
+      found |= value == members[j];                                            \
+    }                                                                          \
+    return found;                                                              \
+  }
+
+SET_CONTAINS(set_contains8, uint8_t)
+SET_CONTAINS(set_contains16, uint16_t)
+SET_CONTAINS(set_contains32, uint32_t)
+SET_CONTAINS(set_contains64, uint64_t)
+SET_CONTAINS(set_containsf32, float)
+SET_CONTAINS(set_containsf64, double)
+
+// Integers are compared as unsigned bits. A range holds value when
+// value - low, wrapping around, is at most high - low, which works for both
+// signed and unsigned types as long as low <= high in the type's own order.
+#define SCALAR_INT_KERNELS(bits, type)                                         \
+  SCALAR_KERNEL(match_eq##bits##_scalar, type,                                 \
+                LOAD_ARG(type, needle, args->a), value == needle)              \
+  SCALAR_KERNEL(match_ne##bits##_scalar, type,                                 \
+                LOAD_ARG(type, needle, args->a), value != needle)              \
+  SCALAR_KERNEL(match_range##bits##_scalar, type,                              \
+                LOAD_ARG(type, low, args->a);                                  \
+                LOAD_ARG(type, high, args->b);                                 \
+                const type span = (type)(high - low),                          \
+                (type)(value - low) <= span)                                   \
+  SCALAR_KERNEL(match_mask##bits##_scalar, type,                               \
+                LOAD_ARG(type, mask, args->a);                                 \
+                LOAD_ARG(type, want, args->b), (value & mask) == want)         \
+  SCALAR_KERNEL(match_set##bits##_scalar, type, LOAD_SET(type, members),      \
+                set_contains##bits(members, args->set_size, value))
+
+#define SCALAR_FLOAT_KERNELS(bits, type)                                       \
+  SCALAR_KERNEL(match_eq##bits##_scalar, type,                                 \
+                LOAD_ARG(type, needle, args->a), value == needle)              \
+  SCALAR_KERNEL(match_ne##bits##_scalar, type,                                 \
+                LOAD_ARG(type, needle, args->a), value != needle)              \
+  SCALAR_KERNEL(match_range##bits##_scalar, type,                              \
+                LOAD_ARG(type, low, args->a);                                  \
+                LOAD_ARG(type, high, args->b),                                 \
+                value >= low && value <= high)                                 \
+  SCALAR_KERNEL(match_set##bits##_scalar, type, LOAD_SET(type, members),      \
+                set_contains##bits(members, args->set_size, value))
+
+SCALAR_INT_KERNELS(8, uint8_t)
+SCALAR_INT_KERNELS(16, uint16_t)
+SCALAR_INT_KERNELS(32, uint32_t)
+SCALAR_INT_KERNELS(64, uint64_t)
+SCALAR_FLOAT_KERNELS(f32, float)
+SCALAR_FLOAT_KERNELS(f64, double)
+
+#ifdef KERNELS_X86
+
+// mask has one bit per byte of the compared vector; keep has the lowest bit
+// of every element set, so each surviving bit is the byte offset of a hit
+static inline void emit_hits(unsigned int mask, const unsigned int keep,
+                             const unsigned long address, ULongArray *hits) {
+  mask &= keep;
+  while (mask != 0) {
+    ulong_array_insert(hits, address + __builtin_ctz(mask));
+    mask &= mask - 1;
+  }
+}
+
+#define KEEP_8 0xFFFFFFFFu
+#define KEEP_16 0x55555555u
+#define KEEP_32 0x11111111u
+#define KEEP_64 0x01010101u
+
+// SSE2 has no 64-bit compare: a lane matches when both of its halves do
+static inline __m128i sse2_cmpeq_epi64(const __m128i a, const __m128i b) {
+  const __m128i halves = _mm_cmpeq_epi32(a, b);
+  return _mm_and_si128(halves,
+                       _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+static inline __m128i sse2_cmpeq_f32(const __m128i a, const __m128i b) {
+  return _mm_castps_si128(
+      _mm_cmpeq_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+}
+
+static inline __m128i sse2_cmpeq_f64(const __m128i a, const __m128i b) {
+  return _mm_castpd_si128(
+      _mm_cmpeq_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b)));
+}
+
+#define SSE2_ANY_EQ(name, cmpeq)                                               \
+  static inline __m128i name(const __m128i value, const __m128i *members,     \
+                             const size_t size) {                              \
+    __m128i found = _mm_setzero_si128();                                       \
+    for (size_t j = 0; j < size; j++) {                                        \
+      found = _mm_or_si128(found, cmpeq(value, members[j]));                   \
+    }                                                                          \
+    return found;                                                              \
+  }
+
+SSE2_ANY_EQ(sse2_any_eq8, _mm_cmpeq_epi8)
+SSE2_ANY_EQ(sse2_any_eq16, _mm_cmpeq_epi16)
+SSE2_ANY_EQ(sse2_any_eq32, _mm_cmpeq_epi32)
+SSE2_ANY_EQ(sse2_any_eq64, sse2_cmpeq_epi64)
+SSE2_ANY_EQ(sse2_any_eqf32, sse2_cmpeq_f32)
+SSE2_ANY_EQ(sse2_any_eqf64, sse2_cmpeq_f64)
+
+#define SSE2_LOAD_SET(var, set1, type)                                         \
+  __m128i var[KERNEL_SET_MAX];                                                 \
+  for (size_t j = 0; j < args->set_size; j++) {                                \
+    var[j] = set1((type)args->set[j]);                                         \
+  }
+
+#define SSE2_KERNEL(name, scalar, keep, setup, compare)                        \
+  static void name(const unsigned char *buf, const size_t len,                \
+                   const unsigned long address, const KernelArgs *args,       \
+                   ULongArray *hits) {                                         \
+    setup;                                                                     \
+    size_t i = 0;                                                              \
+    for (; i + 16 <= len; i += 16) {                                           \
+      const __m128i value = _mm_loadu_si128((const __m128i *)(buf + i));      \
+      const unsigned int mask = _mm_movemask_epi8(compare);                    \
+      if (mask != 0) {                                                         \
+        emit_hits(mask, keep, address + i, hits);                              \
+      }                                                                        \
+    }                                                                          \
+    scalar(buf + i, len - i, address + i, args, hits);                         \
+  }
+
+#define SSE2_INT_KERNELS(bits, keep, set1, type, cmpeq)                        \
+  SSE2_KERNEL(match_eq##bits##_sse2, match_eq##bits##_scalar, keep,            \
+              const __m128i needle = set1((type)args->a),                      \
+              cmpeq(value, needle))                                            \
+  SSE2_KERNEL(match_ne##bits##_sse2, match_ne##bits##_scalar, keep,            \
+              const __m128i needle = set1((type)args->a),                      \
+              _mm_xor_si128(cmpeq(value, needle), _mm_set1_epi32(-1)))         \
+  SSE2_KERNEL(match_mask##bits##_sse2, match_mask##bits##_scalar, keep,        \
+              const __m128i test = set1((type)args->a);                        \
+              const __m128i want = set1((type)args->b),                        \
+              cmpeq(_mm_and_si128(value, test), want))                         \
+  SSE2_KERNEL(match_set##bits##_sse2, match_set##bits##_scalar, keep,          \
+              SSE2_LOAD_SET(members, set1, type),                              \
+              sse2_any_eq##bits(value, members, args->set_size))
+
+// Flipping the sign bit turns the signed compare into an unsigned one
+#define SSE2_RANGE_KERNEL(bits, keep, set1, type, sub, cmpgt)                  \
+  SSE2_KERNEL(match_range##bits##_sse2, match_range##bits##_scalar, keep,      \
+              const __m128i low = set1((type)args->a);                         \
+              const __m128i bias = set1((type)(1UL << (bits - 1)));            \
+              const __m128i span =                                             \
+                  _mm_xor_si128(set1((type)(args->b - args->a)), bias),        \
+              _mm_xor_si128(cmpgt(_mm_xor_si128(sub(value, low), bias), span), \
+                            _mm_set1_epi32(-1)))
+
+SSE2_INT_KERNELS(8, KEEP_8, _mm_set1_epi8, char, _mm_cmpeq_epi8)
+SSE2_INT_KERNELS(16, KEEP_16, _mm_set1_epi16, short, _mm_cmpeq_epi16)
+SSE2_INT_KERNELS(32, KEEP_32, _mm_set1_epi32, int, _mm_cmpeq_epi32)
+SSE2_INT_KERNELS(64, KEEP_64, _mm_set1_epi64x, long long, sse2_cmpeq_epi64)
+SSE2_RANGE_KERNEL(8, KEEP_8, _mm_set1_epi8, char, _mm_sub_epi8, _mm_cmpgt_epi8)
+SSE2_RANGE_KERNEL(16, KEEP_16, _mm_set1_epi16, short, _mm_sub_epi16,
+                  _mm_cmpgt_epi16)
+SSE2_RANGE_KERNEL(32, KEEP_32, _mm_set1_epi32, int, _mm_sub_epi32,
+                  _mm_cmpgt_epi32)
+
+// SSE2 has no 64-bit greater than either
+#define match_range64_sse2 match_range64_scalar
+
+// Ordered compares, so NaN is equal to nothing and lies in no range, while
+// the unordered != matches it
+SSE2_KERNEL(match_eqf32_sse2, match_eqf32_scalar, KEEP_32,
+            const __m128i needle = _mm_set1_epi32((int)args->a),
+            sse2_cmpeq_f32(value, needle))
+SSE2_KERNEL(match_eqf64_sse2, match_eqf64_scalar, KEEP_64,
+            const __m128i needle = _mm_set1_epi64x((long long)args->a),
+            sse2_cmpeq_f64(value, needle))
+SSE2_KERNEL(match_nef32_sse2, match_nef32_scalar, KEEP_32,
+            const __m128 needle =
+                _mm_castsi128_ps(_mm_set1_epi32((int)args->a)),
+            _mm_castps_si128(_mm_cmpneq_ps(_mm_castsi128_ps(value), needle)))
+SSE2_KERNEL(match_nef64_sse2, match_nef64_scalar, KEEP_64,
+            const __m128d needle =
+                _mm_castsi128_pd(_mm_set1_epi64x((long long)args->a)),
+            _mm_castpd_si128(_mm_cmpneq_pd(_mm_castsi128_pd(value), needle)))
+SSE2_KERNEL(match_rangef32_sse2, match_rangef32_scalar, KEEP_32,
+            const __m128 low = _mm_castsi128_ps(_mm_set1_epi32((int)args->a));
+            const __m128 high = _mm_castsi128_ps(_mm_set1_epi32((int)args->b)),
+            _mm_castps_si128(
+                _mm_and_ps(_mm_cmpge_ps(_mm_castsi128_ps(value), low),
+                           _mm_cmple_ps(_mm_castsi128_ps(value), high))))
+SSE2_KERNEL(match_rangef64_sse2, match_rangef64_scalar, KEEP_64,
+            const __m128d low =
+                _mm_castsi128_pd(_mm_set1_epi64x((long long)args->a));
+            const __m128d high =
+                _mm_castsi128_pd(_mm_set1_epi64x((long long)args->b)),
+            _mm_castpd_si128(
+                _mm_and_pd(_mm_cmpge_pd(_mm_castsi128_pd(value), low),
+                           _mm_cmple_pd(_mm_castsi128_pd(value), high))))
+SSE2_KERNEL(match_setf32_sse2, match_setf32_scalar, KEEP_32,
+            SSE2_LOAD_SET(members, _mm_set1_epi32, int),
+            sse2_any_eqf32(value, members, args->set_size))
+SSE2_KERNEL(match_setf64_sse2, match_setf64_scalar, KEEP_64,
+            SSE2_LOAD_SET(members, _mm_set1_epi64x, long long),
+            sse2_any_eqf64(value, members, args->set_size))
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_cmpeq_f32(const __m256i a, const __m256i b) {
+  return _mm256_castps_si256(
+      _mm256_cmp_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b),
+                    _CMP_EQ_OQ));
+}
+
+AVX2 static inline __m256i avx2_cmpeq_f64(const __m256i a, const __m256i b) {
+  return _mm256_castpd_si256(
+      _mm256_cmp_pd(_mm256_castsi256_pd(a), _mm256_castsi256_pd(b),
+                    _CMP_EQ_OQ));
+}
+
+#define AVX2_ANY_EQ(name, cmpeq)                                               \
+  AVX2 static inline __m256i name(const __m256i value, const __m256i *members,\
+                                  const size_t size) {                         \
+    __m256i found = _mm256_setzero_si256();                                    \
+    for (size_t j = 0; j < size; j++) {                                        \
+      found = _mm256_or_si256(found, cmpeq(value, members[j]));                \
+    }                                                                          \
+    return found;                                                              \
+  }
+
+AVX2_ANY_EQ(avx2_any_eq8, _mm256_cmpeq_epi8)
+AVX2_ANY_EQ(avx2_any_eq16, _mm256_cmpeq_epi16)
+AVX2_ANY_EQ(avx2_any_eq32, _mm256_cmpeq_epi32)
+AVX2_ANY_EQ(avx2_any_eq64, _mm256_cmpeq_epi64)
+AVX2_ANY_EQ(avx2_any_eqf32, avx2_cmpeq_f32)
+AVX2_ANY_EQ(avx2_any_eqf64, avx2_cmpeq_f64)
+
+#define AVX2_LOAD_SET(var, set1, type)                                         \
+  __m256i var[KERNEL_SET_MAX];                                                 \
+  for (size_t j = 0; j < args->set_size; j++) {                                \
+    var[j] = set1((type)args->set[j]);                                         \
+  }
+
+#define AVX2_KERNEL(name, scalar, keep, setup, compare)                        \
+  AVX2 static void name(const unsigned char *buf, const size_t len,           \
+                        const unsigned long address, const KernelArgs *args,  \
+                        ULongArray *hits) {                                    \
+    setup;                                                                     \
+    size_t i = 0;                                                              \
+    for (; i + 32 <= len; i += 32) {                                           \
+      const __m256i value = _mm256_loadu_si256((const __m256i *)(buf + i));   \
+      const unsigned int mask = (unsigned int)_mm256_movemask_epi8(compare);   \
+      if (mask != 0) {                                                         \
+        emit_hits(mask, keep, address + i, hits);                              \
+      }                                                                        \
+    }                                                                          \
+    scalar(buf + i, len - i, address + i, args, hits);                         \
+  }
+
+#define AVX2_INT_KERNELS(bits, keep, set1, type, cmpeq, sub, cmpgt)            \
+  AVX2_KERNEL(match_eq##bits##_avx2, match_eq##bits##_scalar, keep,            \
+              const __m256i needle = set1((type)args->a),                      \
+              cmpeq(value, needle))                                            \
+  AVX2_KERNEL(match_ne##bits##_avx2, match_ne##bits##_scalar, keep,            \
+              const __m256i needle = set1((type)args->a),                      \
+              _mm256_xor_si256(cmpeq(value, needle), _mm256_set1_epi32(-1)))   \
+  AVX2_KERNEL(match_mask##bits##_avx2, match_mask##bits##_scalar, keep,        \
+              const __m256i test = set1((type)args->a);                        \
+              const __m256i want = set1((type)args->b),                        \
+              cmpeq(_mm256_and_si256(value, test), want))                      \
+  AVX2_KERNEL(match_set##bits##_avx2, match_set##bits##_scalar, keep,          \
+              AVX2_LOAD_SET(members, set1, type),                              \
+              avx2_any_eq##bits(value, members, args->set_size))              \
+  AVX2_KERNEL(match_range##bits##_avx2, match_range##bits##_scalar, keep,      \
+              const __m256i low = set1((type)args->a);                         \
+              const __m256i bias = set1((type)(1UL << (bits - 1)));            \
+              const __m256i span =                                             \
+                  _mm256_xor_si256(set1((type)(args->b - args->a)), bias),     \
+              _mm256_xor_si256(                                                \
+                  cmpgt(_mm256_xor_si256(sub(value, low), bias), span),        \
+                  _mm256_set1_epi32(-1)))
+
+AVX2_INT_KERNELS(8, KEEP_8, _mm256_set1_epi8, char, _mm256_cmpeq_epi8,
+                 _mm256_sub_epi8, _mm256_cmpgt_epi8)
+AVX2_INT_KERNELS(16, KEEP_16, _mm256_set1_epi16, short, _mm256_cmpeq_epi16,
+                 _mm256_sub_epi16, _mm256_cmpgt_epi16)
+AVX2_INT_KERNELS(32, KEEP_32, _mm256_set1_epi32, int, _mm256_cmpeq_epi32,
+                 _mm256_sub_epi32, _mm256_cmpgt_epi32)
+AVX2_INT_KERNELS(64, KEEP_64, _mm256_set1_epi64x, long long,
+                 _mm256_cmpeq_epi64, _mm256_sub_epi64, _mm256_cmpgt_epi64)
+
+AVX2_KERNEL(match_eqf32_avx2, match_eqf32_scalar, KEEP_32,
+            const __m256i needle = _mm256_set1_epi32((int)args->a),
+            avx2_cmpeq_f32(value, needle))
+AVX2_KERNEL(match_eqf64_avx2, match_eqf64_scalar, KEEP_64,
+            const __m256i needle = _mm256_set1_epi64x((long long)args->a),
+            avx2_cmpeq_f64(value, needle))
+AVX2_KERNEL(match_nef32_avx2, match_nef32_scalar, KEEP_32,
+            const __m256 needle =
+                _mm256_castsi256_ps(_mm256_set1_epi32((int)args->a)),
+            _mm256_castps_si256(_mm256_cmp_ps(_mm256_castsi256_ps(value),
+                                              needle, _CMP_NEQ_UQ)))
+AVX2_KERNEL(match_nef64_avx2, match_nef64_scalar, KEEP_64,
+            const __m256d needle =
+                _mm256_castsi256_pd(_mm256_set1_epi64x((long long)args->a)),
+            _mm256_castpd_si256(_mm256_cmp_pd(_mm256_castsi256_pd(value),
+                                              needle, _CMP_NEQ_UQ)))
+AVX2_KERNEL(match_rangef32_avx2, match_rangef32_scalar, KEEP_32,
+            const __m256 low =
+                _mm256_castsi256_ps(_mm256_set1_epi32((int)args->a));
+            const __m256 high =
+                _mm256_castsi256_ps(_mm256_set1_epi32((int)args->b)),
+            _mm256_castps_si256(_mm256_and_ps(
+                _mm256_cmp_ps(_mm256_castsi256_ps(value), low, _CMP_GE_OQ),
+                _mm256_cmp_ps(_mm256_castsi256_ps(value), high, _CMP_LE_OQ))))
+AVX2_KERNEL(match_rangef64_avx2, match_rangef64_scalar, KEEP_64,
+            const __m256d low =
+                _mm256_castsi256_pd(_mm256_set1_epi64x((long long)args->a));
+            const __m256d high =
+                _mm256_castsi256_pd(_mm256_set1_epi64x((long long)args->b)),
+            _mm256_castpd_si256(_mm256_and_pd(
+                _mm256_cmp_pd(_mm256_castsi256_pd(value), low, _CMP_GE_OQ),
+                _mm256_cmp_pd(_mm256_castsi256_pd(value), high, _CMP_LE_OQ))))
+AVX2_KERNEL(match_setf32_avx2, match_setf32_scalar, KEEP_32,
+            AVX2_LOAD_SET(members, _mm256_set1_epi32, int),
+            avx2_any_eqf32(value, members, args->set_size))
+AVX2_KERNEL(match_setf64_avx2, match_setf64_scalar, KEEP_64,
+            AVX2_LOAD_SET(members, _mm256_set1_epi64x, long long),
+            avx2_any_eqf64(value, members, args->set_size))
+
+#endif
+
+// Kernels for every type. Masks only look at bits, so floats share the
+// integer kernels of their width.
+#define KERNEL_ROW(op, isa)                                                    \
+  {                                                                            \
+      [INT8] = match_##op##8_##isa,   [UINT8] = match_##op##8_##isa,           \
+      [INT16] = match_##op##16_##isa, [UINT16] = match_##op##16_##isa,         \
+      [INT32] = match_##op##32_##isa, [UINT32] = match_##op##32_##isa,         \
+      [INT64] = match_##op##64_##isa, [UINT64] = match_##op##64_##isa,         \
+      [FLOAT32] = match_##op##f32_##isa, [DOUBLE64] = match_##op##f64_##isa,   \
+  }
+
+#define KERNEL_TABLE(isa)                                                      \
+  {                                                                            \
+      [KERNEL_EQUAL] = KERNEL_ROW(eq, isa),                                    \
+      [KERNEL_NOT_EQUAL] = KERNEL_ROW(ne, isa),                                \
+      [KERNEL_RANGE] = KERNEL_ROW(range, isa),                                 \
+      [KERNEL_MASK] = KERNEL_ROW(mask, isa),                                   \
+      [KERNEL_SET] = KERNEL_ROW(set, isa),                                     \
+  }
+
+#define match_maskf32_scalar match_mask32_scalar
+#define match_maskf64_scalar match_mask64_scalar
+#define match_maskf32_sse2 match_mask32_sse2
+#define match_maskf64_sse2 match_mask64_sse2
+#define match_maskf32_avx2 match_mask32_avx2
+#define match_maskf64_avx2 match_mask64_avx2
+
+MatchKernel kernel_select(const ValueType type, const KernelOp op) {
+  static const MatchKernel scalar[][DOUBLE64 + 1] = KERNEL_TABLE(scalar);
+#ifdef KERNELS_X86
+  static const MatchKernel sse2[][DOUBLE64 + 1] = KERNEL_TABLE(sse2);
+  static const MatchKernel avx2[][DOUBLE64 + 1] = KERNEL_TABLE(avx2);
+#endif
+
+  if (type > DOUBLE64) {
+    exit_error("No match kernel for type");
+  }
+
+  switch (kernel_isa()) {
+#ifdef KERNELS_X86
+  case ISA_AVX2:
+    return avx2[op][type];
+  case ISA_SSE2:
+    return sse2[op][type];
+#endif
+  default:
+    return scalar[op][type];
+  }
+}
+
+static int compare_address(const void *a, const void *b) {
+  const unsigned long left = *(const unsigned long *)a;
+  const unsigned long right = *(const unsigned long *)b;
+
+  return (left > right) - (left < right);
+}
+
+void kernel_match_strided(const MatchKernel kernel, const size_t width,
+                          const size_t stride, const unsigned char *buf,
+                          const size_t len, const size_t avail,
+                          const unsigned long address, const KernelArgs *args,
+                          ULongArray *hits) {
+  // Bytes that a value starting inside the piece can reach
+  const size_t end = avail < len + width - 1 ? avail : len + width - 1;
+  const size_t begin = hits->size;
+
+  if (stride == width) {
+    kernel(buf, end, address, args, hits);
+    return;
+  }
+
+  if (width % stride == 0) {
+    // Every shifted view of the same buffer is itself aligned to width
+    for (size_t phase = 0; phase < width && phase < end; phase += stride) {
+      kernel(buf + phase, end - phase, address + phase, args, hits);
+    }
+
+    qsort(hits->items + begin, hits->size - begin, sizeof(unsigned long),
+          compare_address);
+    return;
+  }
+
+  if (stride % width == 0) {
+    kernel(buf, end, address, args, hits);
+
+    size_t kept = begin;
+    for (size_t i = begin; i < hits->size; i++) {
+      if (hits->items[i] % stride == 0) {
+        hits->items[kept++] = hits->items[i];
+      }
+    }
+    hits->size = kept;
+    return;
+  }
+
+  const size_t first = (stride - address % stride) % stride;
+  for (size_t offset = first; offset + width <= end; offset += stride) {
+    kernel(buf + offset, width, address + offset, args, hits);
+  }
+}
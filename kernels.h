@@ -0,0 +1,57 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+#include <stddef.h>
+
+#include "ulong_array.h"
+#include "value_type.h"
+
+typedef enum {
+  ISA_SCALAR,
+  ISA_SSE2,
+  ISA_AVX2,
+} KernelISA;
+
+// The widest instruction set the CPU supports
+KernelISA kernel_isa(void);
+
+#define KERNEL_SET_MAX 8
+
+typedef enum {
+  KERNEL_EQUAL,     // value == a
+  KERNEL_NOT_EQUAL, // value != a
+  KERNEL_RANGE,     // a <= value <= b, with a <= b in the type's order
+  KERNEL_MASK,      // (value & a) == b, on the bits of any type
+  KERNEL_SET,       // value == one of set, matching nothing when empty
+} KernelOp;
+
+// The operands of a kernel, as the little-endian bytes of values in the
+// type's width
+typedef struct {
+  unsigned long a;
+  unsigned long b;
+  unsigned long set[KERNEL_SET_MAX];
+  size_t set_size;
+} KernelArgs;
+
+// Appends address + offset for every element of buf that satisfies the
+// kernel's op. Floats are compared as floats, so -0.0 matches 0.0 and NaN
+// only matches !=.
+typedef void (*MatchKernel)(const unsigned char *buf, size_t len,
+                            unsigned long address, const KernelArgs *args,
+                            ULongArray *hits);
+
+// Picks the widest kernel the CPU supports for type and op, once per scan
+MatchKernel kernel_select(ValueType type, KernelOp op);
+
+// Runs kernel over every stride-aligned address of a piece, so values of the
+// given width can be found at offsets their own alignment would skip. Values
+// may extend into the first avail bytes of buf, but only those starting in
+// the first len bytes are reported, in address order.
+void kernel_match_strided(MatchKernel kernel, size_t width, size_t stride,
+                          const unsigned char *buf, size_t len, size_t avail,
+                          unsigned long address, const KernelArgs *args,
+                          ULongArray *hits);
+
+const char *kernel_isa_name(void);
+
+#endif
@@ -1,380 +1,888 @@
 #include <fcntl.h>
-#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ptrace.h>
-#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "candidates.h"
+#include "filter.h"
+#include "freezer.h"
 #include "globals.h"
-#include "strings.h"
+#include "group.h"
+#include "kernels.h"
+#include "pagemap.h"
+#include "pattern.h"
+#include "ptrscan.h"
+#include "region_tracker.h"
+#include "reader.h"
+#include "regions.h"
+#include "results.h"
+#include "scan.h"
+#include "session.h"
+#include "spill.h"
+#include "stats.h"
+#include "target.h"
+#include "ulong_array.h"
 #include "value_type.h"
+#include "watch.h"
+#include "writer.h"
 
-#define INITIAL_CAPACITY 4096 * 4096 // 16MB
+// Hits shown after next, regions ranked by stats and sites shown by watch
+#define FOUND_LIMIT 10
+#define REGION_HITS_LIMIT 10
+#define WATCH_SITES_LIMIT 10
+#define WATCH_DEFAULT_SECONDS 5
 
-size_t get_byte_count(const ValueType type) {
-  switch (type) {
-  case INT8:
-  case UINT8:
-    return sizeof(int8_t);
-  case INT16:
-  case UINT16:
-    return sizeof(int16_t);
-  case INT32:
-  case UINT32:
-  case FLOAT32:
-    return sizeof(int32_t);
-  case INT64:
-  case UINT64:
-  case DOUBLE64:
-    return sizeof(int64_t);
+// The anchor of a group is picked from a read of this many bytes at the
+// start of up to GROUP_SAMPLES regions
+#define GROUP_SAMPLE_SIZE (256UL << 10)
+#define GROUP_SAMPLES 4
 
-  case STRING:
-    return 0; // TODO: Handle this later
+long load_data(const unsigned char *buf, const size_t byte_count) {
+  long data = 0;
+  memcpy(&data, buf, byte_count);
 
-  default:
-    exit_error("Invalid type");
-    return 0;
-  }
+  return data;
 }
 
 typedef struct {
-  bool read;
-  bool write;
-  bool execute;
-  bool private;
-  bool shared;
-} MemoryPermission;
+  MatchKernel kernel;
+  KernelArgs args;
+  size_t width;
+  size_t stride;
+  bool keep_values;
+} ScanContext;
+
+// Moves the hits a visitor added to out since begin into a block of their
+// own, along with the width bytes each was found with
+void push_hits_with_values(const ScanPiece *piece, const size_t begin,
+                           const size_t width, const size_t stride,
+                           ScanOutput *out) {
+  const unsigned long *hits = out->hits.items + begin;
+  const size_t count = out->hits.size - begin;
+  unsigned char *values = malloc(count * width + 1);
+
+  if (values == NULL) {
+    exit_error("Error allocating match values");
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    memcpy(values + i * width, piece->buf + (hits[i] - piece->address),
+           width);
+  }
+
+  candidates_push(&out->blocks,
+                  candidate_block_encode(stride, width, piece->address,
+                                         piece->len, hits, values, count));
+
+  free(values);
+  out->hits.size = begin;
+}
+
+void scan_chunk(const ScanPiece *piece, void *ctx, ScanOutput *out) {
+  const ScanContext *scan = ctx;
+  const size_t begin = out->hits.size;
+
+  kernel_match_strided(scan->kernel, scan->width, scan->stride, piece->buf,
+                       piece->len, piece->avail, piece->address, &scan->args,
+                       &out->hits);
+
+  if (scan->keep_values) {
+    push_hits_with_values(piece, begin, scan->width, scan->stride, out);
+  }
+}
 
 typedef struct {
-  unsigned long start;
-  unsigned long end;
-  MemoryPermission permission;
-} ProcessMemoryRegion;
+  ScanContext *scans;
+  size_t count;
+} MultiScanContext;
+
+// Runs the scan of every type over a piece while it is still in cache
+void scan_chunk_multi(const ScanPiece *piece, void *ctx, ScanOutput *outs) {
+  const MultiScanContext *multi = ctx;
+
+  for (size_t i = 0; i < multi->count; i++) {
+    scan_chunk(piece, &multi->scans[i], &outs[i]);
+  }
+}
 
+// Where a scan over several processes reads, and the results its sets go to.
+// A window works as in ScanSource.
 typedef struct {
-  size_t size;
-  size_t capacity;
-  ProcessMemoryRegion *regions;
-} PMRegionArray;
+  MemoryReader *reader;
+  const PMRegionArray *regions;
+  ScanResults *results;
+  unsigned long window_start;
+  unsigned long window_end;
+} ScanTarget;
+
+// Visits the regions of every target in a single job, so that all of them
+// share the engine's threads. Each target gets a set like each of protos,
+// added to its results as the matching type.
+void scan_targets(ScanEngine *engine, const ScanTarget *targets,
+                  const size_t target_count, const size_t overlap,
+                  const ScanVisitor visit, void *ctx,
+                  const CandidateSet *protos, const ValueType *types,
+                  const size_t count) {
+  CandidateSet *sets = malloc(target_count * count * sizeof(CandidateSet) + 1);
+  ScanSource *sources = malloc(target_count * sizeof(ScanSource) + 1);
+
+  if (sets == NULL || sources == NULL) {
+    exit_error("Error allocating scan sets");
+  }
 
-PMRegionArray pmregion_array_create(const size_t capacity) {
-  PMRegionArray pmregion_array;
+  for (size_t t = 0; t < target_count; t++) {
+    CandidateSet *outs = &sets[t * count];
 
-  pmregion_array.capacity = capacity;
-  pmregion_array.size = 0;
+    for (size_t i = 0; i < count; i++) {
+      outs[i] = candidates_create(protos[i].width, protos[i].stride);
+      outs[i].uniform = protos[i].uniform;
+      outs[i].value = protos[i].value;
+    }
+
+    sources[t].reader = targets[t].reader;
+    sources[t].regions = targets[t].regions;
+    sources[t].outs = outs;
+    sources[t].window_start = targets[t].window_start;
+    sources[t].window_end = targets[t].window_end;
+  }
 
-  pmregion_array.regions = calloc(capacity, sizeof(PMRegionArray));
+  scan_sources(engine, sources, target_count, overlap, visit, ctx, count);
 
-  return pmregion_array;
-};
+  for (size_t t = 0; t < target_count; t++) {
+    for (size_t i = 0; i < count; i++) {
+      scan_results_add(targets[t].results, types[i], sets[t * count + i]);
+    }
+  }
 
-void pmregion_array_insert(PMRegionArray *array,
-                           const ProcessMemoryRegion region) {
-  if (array->size >= array->capacity) {
-    array->capacity *= GROWTH_FACTOR;
-    ProcessMemoryRegion *regions =
-        realloc(array->regions, array->capacity * sizeof(ProcessMemoryRegion));
+  free(sets);
+  free(sources);
+}
 
-    if (array->regions == NULL) {
-      exit_error("Error allocating memory regions");
+// Runs absolute filters over every value in the regions in a single pass,
+// into a set per filter. Only exact matches all hold the same value, the
+// others keep the value each was found with.
+void predicate_scan(ScanEngine *engine, const ScanTarget *targets,
+                    const size_t target_count, const Filter *filters,
+                    const size_t count, const size_t stride) {
+  ScanContext scans[RESULTS_MAX];
+  CandidateSet protos[RESULTS_MAX];
+  ValueType types[RESULTS_MAX];
+  size_t overlap = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    const Filter *filter = &filters[i];
+    ScanContext *scan = &scans[i];
+
+    scan->width = get_byte_count(filter->type);
+    scan->stride = stride != 0 ? stride : scan->width;
+    scan->keep_values = !filter_is_exact(filter);
+
+    scan->kernel = kernel_select(filter->type,
+                                 filter_compile(filter, &scan->args));
+
+    // Values at offsets that aren't a multiple of their width may straddle
+    // two chunks
+    if (scan->stride % scan->width != 0 && scan->width - 1 > overlap) {
+      overlap = scan->width - 1;
     }
 
-    array->regions = regions;
+    // Every hit holds the target, no need to keep values per candidate
+    protos[i] = (CandidateSet){
+        .width = scan->width,
+        .stride = scan->stride,
+        .uniform = !scan->keep_values,
+        .value = scan->keep_values ? 0 : scan->args.a,
+    };
+    types[i] = filter->type;
   }
 
-  array->regions[array->size] = region;
-  array->size++;
+  MultiScanContext multi = {.scans = scans, .count = count};
+  scan_targets(engine, targets, target_count, overlap, scan_chunk_multi,
+               &multi, protos, types, count);
+}
+
+void scan_chunk_snapshot(const ScanPiece *piece, void *ctx,
+                         ScanOutput *out) {
+  const size_t width = *(const size_t *)ctx;
+  candidates_push(&out->blocks,
+                  candidate_block_snapshot(width, piece->address, piece->buf,
+                                           piece->len));
 }
 
-void pmregion_array_destroy(const PMRegionArray *pmregion_array) {
-  free(pmregion_array->regions);
+// Keeps every slot of every region as a candidate along with a compressed
+// copy of its memory, for when the initial value is unknown
+void snapshot_scan(ScanEngine *engine, const ScanTarget *targets,
+                   const size_t target_count, const ValueType type) {
+  size_t width = get_byte_count(type);
+  const CandidateSet proto = {.width = width, .stride = width};
+
+  scan_targets(engine, targets, target_count, 0, scan_chunk_snapshot, &width,
+               &proto, &type, 1);
 }
 
-void print_memory_region(const ProcessMemoryRegion region) {
-  // Print the memory region start and end addresses
-  printf("Range: [0x%lx - 0x%lx]\tPermissions: [", region.start, region.end);
+void scan_chunk_pattern(const ScanPiece *piece, void *ctx, ScanOutput *out) {
+  const Pattern *pattern = ctx;
+  const size_t begin = out->hits.size;
 
-  // Print the permissions
-  printf("%c", region.permission.read ? 'r' : '-');    // Read permission
-  printf("%c", region.permission.write ? 'w' : '-');   // Write permission
-  printf("%c", region.permission.execute ? 'x' : '-'); // Execute permission
-  printf("%c", region.permission.shared
-                   ? 's'
-                   : 'p'); // Shared/Private (s = shared, p = private)
+  pattern_find(pattern, piece->buf, piece->len, piece->avail, piece->address,
+               &out->hits);
 
-  printf("]\n");
+  // Wildcards let matches differ, so each keeps the bytes it matched
+  push_hits_with_values(piece, begin, pattern->len, 1, out);
 }
 
-void print_memory_regions(const PMRegionArray *pmregion_array) {
-  printf("Found regions: %ld", pmregion_array->size);
-  for (size_t i = 0; i < pmregion_array->size; i++) {
-    print_memory_region(pmregion_array->regions[i]);
-  }
+// Matches may start anywhere, and run up to len - 1 bytes into the next
+// chunk
+void pattern_scan(ScanEngine *engine, const ScanTarget *targets,
+                  const size_t target_count, Pattern *pattern) {
+  const CandidateSet proto = {.width = pattern->len, .stride = 1};
+  const ValueType type = STRING;
+
+  scan_targets(engine, targets, target_count, pattern->len - 1,
+               scan_chunk_pattern, pattern, &proto, &type, 1);
 }
 
-typedef struct {
-  size_t size;
-  size_t capacity;
-  unsigned long *items;
-} ULongArray;
+void scan_chunk_group(const ScanPiece *piece, void *ctx, ScanOutput *out) {
+  const GroupScan *scan = ctx;
 
-ULongArray ulong_array_create(const size_t capacity) {
-  ULongArray array;
-  array.capacity = capacity;
-  array.size = 0;
-  array.items = calloc(array.capacity, sizeof(unsigned long));
+  group_find(scan, piece->buf, piece->len, piece->avail, piece->address,
+             &out->hits);
+}
 
-  return array;
+// The field matching the fewest values in a sample of the regions, so that
+// the other fields are checked as rarely as possible
+size_t group_pick_anchor(MemoryReader *reader, const PMRegionArray *regions,
+                         const Group *group) {
+  size_t counts[GROUP_MAX_FIELDS] = {0};
+  unsigned char *buf = malloc(GROUP_SAMPLE_SIZE);
+  size_t previous = SIZE_MAX;
+  size_t sampled = 0;
+
+  if (buf == NULL) {
+    exit_error("Error allocating group sample");
+  }
+
+  for (size_t i = 0; i < GROUP_SAMPLES; i++) {
+    const size_t index = i * regions->size / GROUP_SAMPLES;
+    if (index >= regions->size || index == previous) {
+      continue;
+    }
+    previous = index;
+
+    const ProcessMemoryRegion *region = &regions->regions[index];
+    const size_t size = region->end - region->start < GROUP_SAMPLE_SIZE
+                            ? region->end - region->start
+                            : GROUP_SAMPLE_SIZE;
+    const size_t got = reader_read(reader, region->start, buf, size);
+
+    group_count_matches(group, buf, got, counts);
+    sampled += got;
+  }
+
+  free(buf);
+
+  const size_t anchor = group_rarest_field(group, counts);
+  printf("Anchoring on the %s at +%zu, %zu matches in %zu sampled bytes\n",
+         value_type_name(group->fields[anchor].type),
+         group->fields[anchor].offset, counts[anchor], sampled);
+
+  return anchor;
 }
 
-void ulong_array_destroy(const ULongArray *array) { free(array->items); }
+// Finds every group in the regions in a single pass. Groups are kept where
+// they start, as values of the field at offset 0, so next and lookall work
+// on that field. The anchor is picked from the first target's memory.
+void group_scan(ScanEngine *engine, const ScanTarget *targets,
+                const size_t target_count, const Group *group) {
+  const GroupField *first = &group->fields[group->first];
+  GroupScan scan;
+
+  group_scan_create(&scan, group,
+                    group_pick_anchor(targets[0].reader, targets[0].regions,
+                                      group));
+
+  // Every group holds the same value at offset 0
+  const CandidateSet proto = {
+      .width = first->width,
+      .stride = group->stride,
+      .uniform = true,
+      .value = value_bits(first->type, first->value),
+  };
 
-void ulong_array_insert(ULongArray *array, const unsigned long item) {
-  if (array->size >= array->capacity) {
-    array->capacity *= GROWTH_FACTOR;
-    unsigned long *items =
-        realloc(array->items, array->capacity * sizeof(unsigned long));
+  scan_targets(engine, targets, target_count, group->span - 1,
+               scan_chunk_group, &scan, &proto, &first->type, 1);
+}
 
-    if (items == NULL) {
-      perror("reallocate");
-      exit(EXIT_FAILURE);
+// The arguments of the last new command, kept so that catchup can run the
+// same scan over regions mapped since
+typedef struct {
+  ValueType type;
+  bool unknown; // new <type> ?
+  Filter filters[RESULTS_MAX];
+  size_t filter_count;
+  PatternKind pattern;
+  char target[256]; // The text of a pattern
+  size_t stride;
+  Group group; // With fields for a group scan
+} NewScan;
+
+// Runs a new scan over the regions of every target at once, adding its
+// sets to their results
+void new_scan(ScanEngine *engine, const ScanTarget *targets,
+              const size_t target_count, const NewScan *scan) {
+  if (scan->type == STRING) {
+    Pattern pattern;
+    if (!pattern_parse(&pattern, scan->pattern, scan->target)) {
+      printf("Invalid pattern: %s\n", scan->target);
+      return;
     }
 
-    array->items = items;
+    pattern_scan(engine, targets, target_count, &pattern);
+    pattern_destroy(&pattern);
+  }
+
+  else if (scan->group.count > 0) {
+    group_scan(engine, targets, target_count, &scan->group);
   }
 
-  array->items[array->size] = item;
-  array->size++;
+  else if (scan->unknown) {
+    snapshot_scan(engine, targets, target_count, scan->type);
+  }
+
+  else {
+    predicate_scan(engine, targets, target_count, scan->filters,
+                   scan->filter_count, scan->stride);
+  }
 }
 
-void ulong_array_clear(ULongArray *array) { array->size = 0; }
+void print_spill(const Spill *spill) {
+  if (spill->spilled > 0) {
+    printf("%zu bytes of candidates spilled to disk since the last new\n",
+           spill->spilled);
+  }
+}
 
-void read_process_memory(String *string, const pid_t pid) {
-  char proc_file_path[256];
+// Moves every set to the spill file once they hold more than its limit
+void spill_results(Spill *spill, ScanResults *results) {
+  if (!spill_needed(spill, scan_results_memory(results))) {
+    return;
+  }
 
-  snprintf(proc_file_path, sizeof(proc_file_path), "/proc/%d/maps", pid);
+  for (size_t i = 0; i < results->size; i++) {
+    spill_set(spill, &results->sets[i]);
+  }
+}
+
+// Makes the regions each target was just scanned over the baseline its
+// mapping changes are tracked against
+void track_scanned_regions(Target **targets, const size_t target_count) {
+  for (size_t t = 0; t < target_count; t++) {
+    region_tracker_reset(&targets[t]->region_tracker, &targets[t]->regions);
+  }
+}
 
-  string_readfile(string, proc_file_path);
+// Sets a new scan makes per target
+size_t new_scan_set_count(const NewScan *scan) {
+  const bool predicate =
+      scan->type != STRING && scan->group.count == 0 && !scan->unknown;
+  return predicate && scan->filter_count > 1 ? scan->filter_count : 1;
 }
 
-ssize_t read_line(const char *str, char *buffer) {
-  ssize_t bytes_read = 0;
-  if (*str == '\0')
-    return bytes_read;
-  do {
-    *buffer++ = *str++;
-    bytes_read++;
-  } while (*str != '\n');
-  *buffer = '\0';
+// Runs a new scan over one batch of a target's regions, or over a window of
+// them, and adds what it finds to the target's results
+void new_scan_batch(ScanEngine *engine, Target *target,
+                    const PMRegionArray *regions,
+                    const unsigned long window_start,
+                    const unsigned long window_end, const NewScan *scan) {
+  ScanResults found = scan_results_create();
+  const ScanTarget batch_target = {
+      .reader = &target->reader,
+      .regions = regions,
+      .results = &found,
+      .window_start = window_start,
+      .window_end = window_end,
+  };
 
-  return bytes_read;
+  new_scan(engine, &batch_target, 1, scan);
+  scan_results_merge(&target->results, &found);
+  spill_results(&target->spill, &target->results);
 }
 
-MemoryPermission parse_permissions(const char *perm_str) {
-  if (strlen(perm_str) != 4) {
-    perror("permissions");
-    exit(EXIT_FAILURE);
+// Scans the regions of every target at once, or a batch of them at a time
+// when there is a memory limit. Candidates rarely take more heap than the
+// memory they were found in, so a batch covers the limit's worth of memory
+// shared by the scan's sets. Regions larger than that are scanned one
+// window at a time. Sets go to the target's spill file whenever all of its
+// candidates outgrow the limit, so that only about one batch of candidates
+// is on the heap at once.
+void new_scan_bounded(ScanEngine *engine, Target **targets,
+                      const size_t target_count, const NewScan *scan) {
+  if (targets[0]->spill.limit == 0) {
+    ScanTarget *all = calloc(target_count, sizeof(ScanTarget));
+    if (all == NULL) {
+      exit_error("Error allocating scan targets");
+    }
+
+    for (size_t t = 0; t < target_count; t++) {
+      all[t].reader = &targets[t]->reader;
+      all[t].regions = &targets[t]->regions;
+      all[t].results = &targets[t]->results;
+    }
+
+    new_scan(engine, all, target_count, scan);
+    free(all);
+    track_scanned_regions(targets, target_count);
+    return;
   }
 
-  const MemoryPermission permissions = {
-      .read = perm_str[0] == 'r',
-      .write = perm_str[1] == 'w',
-      .execute = perm_str[2] == 'x',
-      .private = perm_str[3] == 'p',
-      .shared = perm_str[3] == 's',
-  };
+  PMRegionArray batch = pmregion_array_create(16);
+
+  for (size_t t = 0; t < target_count; t++) {
+    Target *target = targets[t];
+    const PMRegionArray *regions = &target->regions;
+    size_t batch_bytes = target->spill.limit / new_scan_set_count(scan);
+    size_t i = 0;
+
+    // Windows start on a chunk of their region
+    batch_bytes = batch_bytes / SCAN_CHUNK_SIZE * SCAN_CHUNK_SIZE;
+    batch_bytes = batch_bytes > 0 ? batch_bytes : SCAN_CHUNK_SIZE;
+
+    while (i < regions->size) {
+      const ProcessMemoryRegion *region = &regions->regions[i];
+      size_t bytes = 0;
+      pmregion_array_clear(&batch);
+
+      if (region->end - region->start > batch_bytes) {
+        pmregion_array_insert(&batch, *region);
+
+        for (unsigned long start = region->start; start < region->end;
+             start += batch_bytes) {
+          new_scan_batch(engine, target, &batch, start, start + batch_bytes,
+                         scan);
+        }
+
+        i++;
+        continue;
+      }
+
+      while (i < regions->size &&
+             bytes + regions->regions[i].end - regions->regions[i].start <=
+                 batch_bytes) {
+        pmregion_array_insert(&batch, regions->regions[i]);
+        bytes += regions->regions[i].end - regions->regions[i].start;
+        i++;
+      }
+
+      new_scan_batch(engine, target, &batch, 0, 0, scan);
+    }
+  }
+
+  pmregion_array_destroy(&batch);
+  track_scanned_regions(targets, target_count);
+}
 
-  return permissions;
+// Names the process what follows is about, when there are several
+void print_target_label(const Target *target, const size_t target_count) {
+  if (target_count > 1) {
+    printf("Process %d:\n", target->pid);
+  }
 }
 
-void regions_fill(PMRegionArray *regions, String *process_map) {
-  char line_buffer[1024];
-  ssize_t bytes_read = 0;
-  while ((bytes_read = read_line(process_map->str, line_buffer)) != 0) {
-    char *range = strtok(line_buffer, " ");
-    const char *perm_str = strtok(NULL, " ");
-    const char *start_str = strtok(range, "-");
-    const char *end_str = strtok(NULL, "-");
+// Empties the results of every target before a new scan
+void clear_targets(Target **targets, const size_t target_count,
+                   const bool incremental) {
+  for (size_t t = 0; t < target_count; t++) {
+    Target *target = targets[t];
 
-    const unsigned long start = strtoul(start_str, NULL, 16);
-    const unsigned long end = strtoul(end_str, NULL, 16);
-    const MemoryPermission permissions = parse_permissions(perm_str);
+    if (incremental) {
+      pagemap_clear_refs(&target->tracker);
+    }
 
-    ProcessMemoryRegion region;
+    scan_results_clear(&target->results);
+    session_unmap(&target->session);
+    spill_reset(&target->spill);
+  }
+}
 
-    region.start = start;
-    region.end = end;
-    region.permission = permissions;
+// Shows the range each filter of a scan compiles to, when it is one
+void print_scan_ranges(const NewScan *scan) {
+  for (size_t i = 0; i < scan->filter_count; i++) {
+    const Filter *filter = &scan->filters[i];
+    KernelArgs args;
 
-    if (permissions.write) {
-      pmregion_array_insert(regions, region);
+    if (filter_compile(filter, &args) != KERNEL_RANGE) {
+      continue;
     }
 
-    process_map->str = process_map->str + (bytes_read + 1);
+    char low_str[64];
+    char high_str[64];
+    value_format(filter->type,
+                 value_load(filter->type, (unsigned char *)&args.a), low_str,
+                 sizeof(low_str));
+    value_format(filter->type,
+                 value_load(filter->type, (unsigned char *)&args.b),
+                 high_str, sizeof(high_str));
+    printf("Matching %s values from %s to %s\n",
+           value_type_name(filter->type), low_str, high_str);
   }
 }
 
-long mask_data(long data, const size_t byte_count) {
-  if (byte_count == 1) {
-    data &= 0xFFL;
-  } else if (byte_count == 2) {
-    data &= 0xFFFFL;
-  } else if (byte_count == 4) {
-    data &= 0xFFFFFFFFL;
-  } else if (byte_count == 8) {
-    data &= 0xFFFFFFFFFFFFFFFFL;
+// Parses any, which stands for the common types, or a comma separated list
+// of types. Returns 0 when one of them is not a type.
+size_t parse_type_list(char *list, ValueType *types) {
+  static const ValueType any[] = {INT8,  INT16,   INT32,
+                                  INT64, FLOAT32, DOUBLE64};
+
+  if (strcmp(list, "any") == 0) {
+    memcpy(types, any, sizeof(any));
+    return sizeof(any) / sizeof(any[0]);
   }
 
-  return data;
+  size_t count = 0;
+  char *type_str = list;
+  while (type_str != NULL && count < RESULTS_MAX) {
+    char *comma = strchr(type_str, ',');
+    if (comma != NULL) {
+      *comma = '\0';
+    }
+
+    types[count] = value_type_parse(type_str);
+    if (types[count] == UNKNOWN) {
+      return 0;
+    }
+
+    count++;
+    type_str = comma != NULL ? comma + 1 : NULL;
+  }
+
+  return count;
 }
 
-long patch_byte(const long original, const long value) {
-  return (original & ~0xFFL) | (value & 0xFFL);
+// Parses a filter of the given type from a copy of args, so that the same
+// arguments can be read once per type. fits tells whether the value of an
+// equality is one of the type at all.
+bool parse_typed_filter(const ValueType type, const size_t width,
+                        const char *args, Filter *filter, bool *fits) {
+  char copy[256];
+  snprintf(copy, sizeof(copy), "%s", args);
+  const char *first = strtok(copy, " ");
+  Value value;
+
+  if (!filter_parse(filter, type, width, first)) {
+    return false;
+  }
+
+  *fits = filter->op != FILTER_EQUAL || value_try_parse(type, first, &value);
+  return true;
 }
 
-long patch_word(const long original, const long value) {
-  return (original & ~0xFFFFL) | (value & 0xFFFFL);
+// Reads the arguments of next as a filter for each set of results
+bool parse_next_filters(const ScanResults *results, const char *args,
+                        Filter *filters, bool *fits) {
+  // Every set reads the same arguments as its own type
+  for (size_t i = 0; i < results->size; i++) {
+    if (!parse_typed_filter(results->types[i], results->sets[i].width, args,
+                            &filters[i], &fits[i])) {
+      return false;
+    }
+  }
+
+  return true;
 }
 
-long patch_dword(const long original, const long value) {
-  return (original & ~0xFFFFFFFFL) | (value & 0xFFFFFFFFL);
+// Takes --align <stride> out of the arguments of new, wherever it is
+size_t take_align_option(char *args) {
+  char *option = strstr(args, "--align");
+  if (option == NULL) {
+    return 0;
+  }
+
+  char *end;
+  const size_t stride = strtoul(option + strlen("--align"), &end, 10);
+  memset(option, ' ', end - option);
+
+  return stride;
 }
 
-long patch_qword(const long original, const long value) {
-  return (original & ~0xFFFFFFFFFFFFFFFFL) | (value & 0xFFFFFFFFFFFFFFFFL);
+typedef struct {
+  const Filter *filter;
+  size_t width;
+  const unsigned char *old_values;
+  const unsigned char *uniform;
+  size_t index;
+  ULongArray *survivors;
+  unsigned char *values;
+} NextScanContext;
+
+void next_scan_keep(NextScanContext *scan, const unsigned long address,
+                    const unsigned char *value) {
+  memcpy(scan->values + scan->survivors->size * scan->width, value,
+         scan->width);
+  ulong_array_insert(scan->survivors, address);
 }
 
-long patch_data(const long original, const long value,
-                const size_t byte_count) {
-  if (byte_count == 1) {
-    return patch_byte(original, value);
-  }
-  if (byte_count == 2) {
-    return patch_word(original, value);
+void next_scan_value(const unsigned long address, const unsigned char *value,
+                     void *ctx) {
+  NextScanContext *scan = ctx;
+  const unsigned char *old = scan->old_values != NULL
+                                 ? scan->old_values + scan->index * scan->width
+                                 : scan->uniform;
+  scan->index++;
+
+  if (value == NULL) {
+    return;
   }
-  if (byte_count == 4) {
-    return patch_dword(original, value);
+
+  if (filter_match(scan->filter, old, value)) {
+    next_scan_keep(scan, address, value);
   }
-  if (byte_count == 8) {
-    return patch_qword(original, value);
+}
+
+// Passes the value last seen at each address as the current one, for
+// addresses on pages the target hasn't touched since
+void next_scan_unchanged(const unsigned long *addresses, const size_t count,
+                         NextScanContext *scan) {
+  for (size_t i = 0; i < count; i++) {
+    const unsigned char *old =
+        scan->old_values != NULL ? scan->old_values + scan->index * scan->width
+                                 : scan->uniform;
+    next_scan_value(addresses[i], old, scan);
   }
-  exit_error("Invalid patch data size");
-  return 0;
 }
 
-void initial_scan(const pid_t pid, const PMRegionArray regions,
-                  const long target, ULongArray *offset_array,
-                  const ValueType type) {
-  const size_t byte_count = get_byte_count(type);
+// Number of pages a block's values can touch, from the page holding its base
+size_t block_page_count(const CandidateBlock *block, const size_t width) {
+  const unsigned long last = block->base + block->span + width - 2;
+  return last / PAGE_SIZE - block->base / PAGE_SIZE + 1;
+}
 
-  for (ssize_t i = 0; i < regions.size; i++) {
-    unsigned long start = regions.regions[i].start;
-    const unsigned long end = regions.regions[i].end;
+// Compares a snapshot block against memory page by page. changed, if not
+// NULL, has a byte per page telling whether it needs to be read again.
+void next_scan_snapshot(MemoryReader *reader, const CandidateBlock *block,
+                        const unsigned char *changed, unsigned char *buf,
+                        NextScanContext *scan) {
+  unsigned char old_page[PAGE_SIZE];
+  size_t read_end = 0; // buf holds memory from the start of the run up to here
+  size_t run_end = 0;
+
+  if (changed == NULL) {
+    read_end = reader_read(reader, block->base, buf, block->span);
+    run_end = block->span;
+  }
 
-    // printf("Scanning from 0x%lx -> 0x%lx\n", start, end);
+  for (size_t page = 0; page * PAGE_SIZE < block->span; page++) {
+    const size_t page_start = page * PAGE_SIZE;
+    size_t page_end = block->span - page_start < PAGE_SIZE
+                          ? block->span
+                          : page_start + PAGE_SIZE;
+    const bool fresh = changed == NULL || changed[page];
+    const unsigned char *current = old_page;
+
+    // Reads the whole run of changed pages at once
+    if (fresh && page_start >= run_end) {
+      size_t end = page;
+      while (end * PAGE_SIZE < block->span && changed[end]) {
+        end++;
+      }
 
-    // TODO: Optimize this later by comparing slices of data instead of stepping
-    // by byte_count
-    while (start < end) {
-      long data = ptrace(PTRACE_PEEKDATA, pid, start, NULL);
+      run_end = end * PAGE_SIZE < block->span ? end * PAGE_SIZE : block->span;
+      read_end = page_start + reader_read(reader, block->base + page_start,
+                                          buf + page_start,
+                                          run_end - page_start);
+    }
 
-      data = mask_data(data, byte_count);
-      const long masked_target = mask_data(target, byte_count);
-      if (data == masked_target) {
-        // printf("Found %ld at 0x%lx\n", target, start);
-        ulong_array_insert(offset_array, start);
+    if (fresh) {
+      if (page_start >= read_end) {
+        continue;
       }
+      page_end = page_end < read_end ? page_end : read_end;
+      current = buf + page_start;
+    }
+
+    snapshot_page(&block->snapshot, page, old_page);
 
-      start += byte_count;
+    for (size_t offset = page_start; offset + scan->width <= page_end;
+         offset += scan->width) {
+      const unsigned char *value = current + offset - page_start;
+      if (filter_match(scan->filter, old_page + offset - page_start, value)) {
+        next_scan_keep(scan, block->base + offset, value);
+      }
     }
   }
 }
 
-void initial_scan_ld(const pid_t pid, const PMRegionArray regions,
-                     const double target, ULongArray *offset_array,
-                     const ValueType type) {
-  const size_t byte_count = get_byte_count(type);
-
-  for (ssize_t i = 0; i < regions.size; i++) {
-    unsigned long start = regions.regions[i].start;
-    const unsigned long end = regions.regions[i].end;
+// Gathers the addresses of a sparse or bitmap block, reading only those on
+// changed pages
+void next_scan_gather(MemoryReader *reader, const CandidateBlock *block,
+                      const unsigned char *changed, const ULongArray *addresses,
+                      unsigned char *buf, NextScanContext *scan) {
+  if (changed == NULL) {
+    reader_gather(reader, addresses->items, addresses->size, scan->width, buf,
+                  READ_CHUNK_SIZE, next_scan_value, scan);
+    return;
+  }
 
-    // TODO: Optimize this later by comparing slices of data instead of stepping
-    // by byte_count
-    while (start < end) {
-      long data = ptrace(PTRACE_PEEKDATA, pid, start, NULL);
+  const unsigned long first_page = block->base / PAGE_SIZE;
+  size_t i = 0;
+
+  while (i < addresses->size) {
+    const unsigned long *run = &addresses->items[i];
+    const bool fresh =
+        changed[run[0] / PAGE_SIZE - first_page] ||
+        changed[(run[0] + scan->width - 1) / PAGE_SIZE - first_page];
+    size_t count = 1;
+
+    while (i + count < addresses->size) {
+      const unsigned long address = run[count];
+      const bool next_fresh =
+          changed[address / PAGE_SIZE - first_page] ||
+          changed[(address + scan->width - 1) / PAGE_SIZE - first_page];
+      if (next_fresh != fresh) {
+        break;
+      }
+      count++;
+    }
 
-      data = mask_data(data, byte_count);
+    if (fresh) {
+      reader_gather(reader, run, count, scan->width, buf, READ_CHUNK_SIZE,
+                    next_scan_value, scan);
+    } else {
+      next_scan_unchanged(run, count, scan);
+    }
 
-      double ldvalue;
-      memcpy(&ldvalue, &data, sizeof(double));
+    i += count;
+  }
+}
 
-      const double masked_target = mask_data(target, byte_count);
+// Which pages of every set of a target may have changed, read once for all
+// of them
+PageChanges next_scan_pages(const PageTracker *tracker,
+                            const ScanResults *results) {
+  PageChanges changes = page_changes_create();
 
-      printf("%f\n", masked_target);
+  for (size_t i = 0; i < results->size; i++) {
+    const CandidateSet *candidates = &results->sets[i];
 
-      if (ldvalue == masked_target) {
-        printf("Found %f at 0x%lx\n", masked_target, start);
-        ulong_array_insert(offset_array, start);
-      }
-
-      start += byte_count;
+    for (size_t j = 0; j < candidates->size; j++) {
+      const CandidateBlock *block = &candidates->blocks[j];
+      page_changes_add(&changes, block->base / PAGE_SIZE,
+                       block_page_count(block, candidates->width));
     }
   }
+
+  page_changes_read(&changes, tracker);
+  printf("Reading %zu of %zu pages (%s)\n", changes.changed_count,
+         changes.total, pagemap_mode_name(tracker));
+
+  return changes;
 }
 
-void initial_scan_str(const pid_t pid, const PMRegionArray regions,
-                      const String string, ULongArray *offset_array) {
+// Filters candidates in place. Each block is dropped as soon as its
+// survivors are encoded, and survivors go to the spill file whenever they,
+// what is left of the old set and the other sets' heap bytes in others
+// outgrow its limit, so the old and new sets never both sit in memory.
+// With page changes, memory is only read back on pages that may have
+// changed, the rest are compared against the values they held last time.
+void next_scan(MemoryReader *reader, const PageChanges *changes,
+               const Filter *filter, CandidateSet *candidates, Spill *spill,
+               const size_t others) {
+  CandidateSet filtered =
+      candidates_create(candidates->width, candidates->stride);
+  ULongArray addresses = ulong_array_create(1024);
+  ULongArray survivors = ulong_array_create(1024);
+  const size_t width = candidates->width;
+  size_t old_bytes = candidates_memory(candidates);
+  size_t new_bytes = 0;
+  unsigned char uniform[sizeof(unsigned long)];
+  unsigned char *values = NULL;
+  size_t values_capacity = 0;
+  unsigned char *buf = malloc(READ_CHUNK_SIZE);
+  const unsigned long start = stats_now_ns();
+  const unsigned long read_ns = reader->stats.read_ns;
+
+  if (buf == NULL) {
+    exit_error("Error allocating scan buffer");
+  }
 
-  for (ssize_t i = 0; i < regions.size; i++) {
-    unsigned long start = regions.regions[i].start;
-    const unsigned long end = regions.regions[i].end;
-    const size_t string_len = string.size;
+  memcpy(uniform, &candidates->value, sizeof(uniform));
 
-    // TODO: Optimize this later by comparing slices of data instead of stepping
-    // by byte_count
-    while (start < end) {
-      long data = ptrace(PTRACE_PEEKDATA, pid, start, NULL);
+  // Survivors of an exact filter all hold its value, the others keep the
+  // value they were just seen with for the next comparison
+  const bool exact = filter_is_exact(filter);
+  filtered.uniform = exact;
+  filtered.value = exact ? value_bits(filter->type, filter->a) : 0;
 
-      // if (data == target) {
-      //     // printf("Found %ld at 0x%lx\n", target, start);
-      //     ulong_array_insert(offset_array, start);
-      // }
+  // One block at a time, so only a block's worth of addresses is expanded
+  for (size_t i = 0; i < candidates->size; i++) {
+    CandidateBlock *block = &candidates->blocks[i];
 
-      start += 8;
-    }
-  }
-}
+    if (block->count * width > values_capacity) {
+      values_capacity = block->count * width;
+      free(values);
+      values = malloc(values_capacity);
 
-ULongArray next_scan(const pid_t pid, const long target,
-                     const ULongArray *offset_array, const ValueType type) {
-  ULongArray filtered_offsets = ulong_array_create(1000);
-  const size_t byte_count = get_byte_count(type);
+      if (values == NULL) {
+        exit_error("Error allocating candidate values");
+      }
+    }
 
-  for (ssize_t i = 0; i < offset_array->size; i++) {
-    long data = ptrace(PTRACE_PEEKDATA, pid, offset_array->items[i], NULL);
+    ulong_array_clear(&survivors);
+    NextScanContext scan = {
+        .filter = filter,
+        .width = width,
+        .old_values = block->values,
+        .uniform = uniform,
+        .index = 0,
+        .survivors = &survivors,
+        .values = values,
+    };
+
+    const unsigned char *block_changed =
+        changes != NULL ? page_changes_find(changes, block->base / PAGE_SIZE)
+                        : NULL;
+
+    if (block->kind == BLOCK_ALL) {
+      next_scan_snapshot(reader, block, block_changed, buf, &scan);
+    } else {
+      ulong_array_clear(&addresses);
+      candidates_decode_block(candidates, i, &addresses);
+      next_scan_gather(reader, block, block_changed, &addresses, buf, &scan);
+    }
 
-    data = mask_data(data, byte_count);
-    const long masked_target = mask_data(target, byte_count);
+    const size_t size = filtered.size;
+    candidates_append(&filtered, block->base, block->span, survivors.items,
+                      exact ? NULL : values, survivors.size);
+    old_bytes -= candidate_block_memory(block, width);
+    candidate_block_destroy(block);
 
-    if (data == masked_target) {
-      printf("Found %ld at 0x%lx\n", target, offset_array->items[i]);
-      ulong_array_insert(&filtered_offsets, offset_array->items[i]);
+    if (filtered.size > size) {
+      new_bytes += candidate_block_memory(&filtered.blocks[size], width);
+    }
+    if (new_bytes > 0 && spill_needed(spill, others + old_bytes + new_bytes)) {
+      spill_set(spill, &filtered);
+      new_bytes = 0;
     }
   }
 
-  return filtered_offsets;
-}
+  free(buf);
+  free(values);
+  ulong_array_destroy(&addresses);
+  ulong_array_destroy(&survivors);
 
-void look(const pid_t pid, const unsigned long offset, const ValueType type) {
-  long data = ptrace(PTRACE_PEEKDATA, pid, offset, NULL);
-  const size_t byte_count = get_byte_count(type);
-  data = mask_data(data, byte_count);
+  candidates_destroy(candidates);
+  *candidates = filtered;
 
+  reader->stats.compare_ns +=
+      stats_now_ns() - start - (reader->stats.read_ns - read_ns);
+}
+
+void print_value(const unsigned long offset, const long data,
+                 const ValueType type) {
   switch (type) {
   case INT8:
     printf("Value at 0x%lx: %d\n", offset, (char)data);
@@ -419,96 +927,528 @@ void look(const pid_t pid, const unsigned long offset, const ValueType type) {
   }
 }
 
-void update(const pid_t pid, const unsigned long offset, const long value,
-            const ValueType type) {
-  const long original = ptrace(PTRACE_PEEKDATA, pid, offset, NULL);
+void look(MemoryReader *reader, const unsigned long offset,
+          const ValueType type) {
+  const size_t byte_count = get_byte_count(type);
+  long data = 0;
 
-  if (original == -1) {
-    exit_error("Error reading from process file");
+  if (reader_read(reader, offset, &data, byte_count) != byte_count) {
+    printf("Could not read 0x%lx\n", offset);
+    return;
   }
 
-  const size_t byte_count = get_byte_count(type);
-  const long patched = patch_data(original, value, byte_count);
+  print_value(offset, data, type);
+}
+
+typedef struct {
+  ValueType type;
+  size_t width;
+} LookContext;
+
+void look_value(const unsigned long address, const unsigned char *value,
+                void *ctx) {
+  const LookContext *look = ctx;
 
-  const long result = ptrace(PTRACE_POKEDATA, pid, offset, patched);
+  if (value == NULL) {
+    printf("Could not read 0x%lx\n", address);
+    return;
+  }
 
-  if (result == -1) {
-    exit_error("Error patching value");
+  if (look->type == STRING) {
+    printf("Value at 0x%lx: ", address);
+    pattern_print_bytes(value, look->width);
+    printf("\n");
+    return;
   }
 
-  printf("Set new value %ld at 0x%lx\n", value, offset);
+  print_value(address, load_data(value, look->width), look->type);
 }
 
-void show(const ULongArray offsets, const long target) {
-  for (int i = 0; i < offsets.size; i++) {
-    printf("Found %ld at 0x%lx\n", target, offsets.items[i]);
+// Pattern matches are shown whole, at the width of the set
+void look_all(MemoryReader *reader, const CandidateSet *candidates,
+              const ValueType type) {
+  LookContext look = {
+      .type = type,
+      .width = type == STRING ? candidates->width : get_byte_count(type),
+  };
+  ULongArray addresses = ulong_array_create(1024);
+  unsigned char *buf = malloc(READ_CHUNK_SIZE);
+
+  if (buf == NULL) {
+    exit_error("Error allocating scan buffer");
+  }
+
+  for (size_t i = 0; i < candidates->size; i++) {
+    ulong_array_clear(&addresses);
+    candidates_decode_block(candidates, i, &addresses);
+
+    reader_gather(reader, addresses.items, addresses.size, look.width, buf,
+                  READ_CHUNK_SIZE, look_value, &look);
   }
+
+  free(buf);
+  ulong_array_destroy(&addresses);
 }
 
-pid_t get_pid(const char *process_name) {
-  char pgrep_command[256];
+void update(MemoryWriter *writer, const unsigned long offset,
+            const char *value_str, const ValueType type) {
+  const unsigned long bits = value_bits(type, value_parse(type, value_str));
+
+  if (writer_write_all(writer, &offset, 1, (const unsigned char *)&bits,
+                       get_byte_count(type)) != 1) {
+    printf("Could not write at 0x%lx\n", offset);
+    return;
+  }
+
+  printf("Set new value %s at 0x%lx\n", value_str, offset);
+}
 
-  snprintf(pgrep_command, sizeof(pgrep_command), "pgrep %s", process_name);
+// Writes value at every candidate, one batch per block
+void set_all(MemoryWriter *writer, const CandidateSet *candidates,
+             const char *value_str, const ValueType type) {
+  ULongArray addresses = ulong_array_create(1024);
+  const unsigned long bits = value_bits(type, value_parse(type, value_str));
+  size_t written = 0;
 
-  FILE *file = popen(pgrep_command, "r");
+  for (size_t i = 0; i < candidates->size; i++) {
+    ulong_array_clear(&addresses);
+    candidates_decode_block(candidates, i, &addresses);
 
-  if (file == NULL) {
-    exit_error("popen() failed");
+    written += writer_write_all(writer, addresses.items, addresses.size,
+                                (const unsigned char *)&bits,
+                                get_byte_count(type));
   }
 
-  char pid_str[10];
+  printf("Set %s at %zu of %zu candidates\n", value_str, written,
+         candidates->count);
+  ulong_array_destroy(&addresses);
+}
+
+// Shows where the first limit candidates of each set holding a single value
+// are, the rest are left to lookall
+void print_found(const ScanResults *results, const size_t limit) {
+  for (size_t i = 0; i < results->size; i++) {
+    const CandidateSet *set = &results->sets[i];
+    CandidateIter iter = candidates_iter(set);
+    unsigned long address;
+    char value_str[64];
+
+    if (!set->uniform || results->types[i] == STRING) {
+      continue;
+    }
 
-  fgets(pid_str, sizeof(pid_str), file);
+    value_format(results->types[i],
+                 value_load(results->types[i],
+                            (const unsigned char *)&set->value),
+                 value_str, sizeof(value_str));
 
-  const pid_t pid = atoi(pid_str);
+    for (size_t n = 0; n < limit && candidates_next(&iter, &address); n++) {
+      printf("Found %s at 0x%lx\n", value_str, address);
+    }
 
-  return pid;
+    if (set->count > limit) {
+      printf("... and %zu more, use lookall to see them\n",
+             set->count - limit);
+    }
+  }
 }
 
 typedef struct {
-  int *numbers;
-  int start;
-  int end;
-  int id;
-} Arguments;
+  size_t region;
+  size_t hits;
+} RegionHits;
 
-static pthread_t thread_a;
+int compare_region_hits(const void *a, const void *b) {
+  const RegionHits *left = a;
+  const RegionHits *right = b;
+
+  return (left->hits < right->hits) - (left->hits > right->hits);
+}
+
+// Candidates per region, for the limit regions holding the most. Blocks
+// never span regions, so each is counted whole where its base is.
+void print_region_hits(const PMRegionArray *regions,
+                       const ScanResults *results, const size_t limit) {
+  RegionHits *hits = calloc(regions->size + 1, sizeof(RegionHits));
+  if (hits == NULL) {
+    exit_error("Error allocating region hits");
+  }
+
+  for (size_t i = 0; i < regions->size; i++) {
+    hits[i].region = i;
+  }
+
+  for (size_t i = 0; i < results->size; i++) {
+    const CandidateSet *set = &results->sets[i];
+
+    for (size_t b = 0; b < set->size; b++) {
+      const unsigned long base = set->blocks[b].base;
+      size_t low = 0;
+      size_t high = regions->size;
+
+      // Last region starting at or before base
+      while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if (regions->regions[mid].start <= base) {
+          low = mid + 1;
+        } else {
+          high = mid;
+        }
+      }
+
+      if (low > 0 && base < regions->regions[low - 1].end) {
+        hits[low - 1].hits += set->blocks[b].count;
+      }
+    }
+  }
+
+  qsort(hits, regions->size, sizeof(RegionHits), compare_region_hits);
+
+  for (size_t i = 0; i < regions->size && i < limit && hits[i].hits > 0;
+       i++) {
+    const ProcessMemoryRegion *region = &regions->regions[hits[i].region];
+
+    printf("%zu candidates in [0x%lx - 0x%lx] %s\n", hits[i].hits,
+           region->start, region->end,
+           region->path[0] != '\0' ? region->path
+                                   : region_kind_name(region->kind));
+  }
+
+  free(hits);
+}
+
+// The sets of every target, with the first hits of each when found is set
+void print_target_results(Target **targets, const size_t target_count,
+                          const bool found) {
+  size_t total = 0;
+
+  for (size_t t = 0; t < target_count; t++) {
+    Target *target = targets[t];
+
+    print_target_label(target, target_count);
+    if (found) {
+      print_found(&target->results, FOUND_LIMIT);
+    }
+    print_scan_results(&target->results);
+    print_spill(&target->spill);
+
+    total += scan_results_count(&target->results);
+  }
+
+  if (target_count > 1) {
+    printf("%zu candidates in %zu processes\n", total, target_count);
+  }
+}
+
+// Lists the targets, marking the one single process commands act on
+void print_targets(Target **targets, const size_t target_count,
+                   const Target *current) {
+  for (size_t t = 0; t < target_count; t++) {
+    const Target *target = targets[t];
+
+    printf("%c %d: %zu candidates\n", target == current ? '*' : ' ',
+           target->pid, scan_results_count(&target->results));
+  }
+}
+
+// Detaches from targets whose process exited, keeping the others in order.
+// The current target becomes the first left if it was one of them.
+size_t drop_exited_targets(Target **targets, const size_t target_count,
+                           Target **current) {
+  size_t kept = 0;
+
+  for (size_t t = 0; t < target_count; t++) {
+    if (target_alive(targets[t])) {
+      targets[kept++] = targets[t];
+      continue;
+    }
+
+    printf("Process %d exited, detaching\n", targets[t]->pid);
+    if (*current == targets[t]) {
+      *current = NULL;
+    }
+    target_detach(targets[t]);
+  }
+
+  if (*current == NULL && kept > 0) {
+    *current = targets[0];
+  }
+
+  return kept;
+}
+
+// Splits the memory limit evenly between the targets still attached
+void share_mem_limit(Target **targets, const size_t target_count,
+                     const size_t mem_limit) {
+  for (size_t t = 0; t < target_count; t++) {
+    targets[t]->spill.limit = mem_limit / target_count;
+  }
+}
+
+// Replaces the results with those saved in a session file, along with the
+// scan that found them. The previous mapping goes once no set uses it.
+bool load_session(const char *path, Session *session, const pid_t pid,
+                  RegionTracker *tracker, ScanResults *results, Spill *spill,
+                  NewScan *scan) {
+  Session loaded;
+  ScanResults found = scan_results_create();
+  NewScan saved_scan;
+
+  if (!session_load(path, &loaded, pid, tracker, &found, &saved_scan,
+                    sizeof(saved_scan))) {
+    return false;
+  }
+
+  scan_results_clear(results);
+  session_unmap(session);
+  spill_reset(spill);
+  *results = found;
+  *session = loaded;
+  *scan = saved_scan;
+
+  return true;
+}
+
+// Reads the maps again before a command. Candidates in ranges that were
+// unmapped are dropped, new ranges are left for catchup.
+void track_regions(Target *target, const RegionFilter *filter,
+                   const size_t target_count) {
+  RegionTracker *tracker = &target->region_tracker;
+  ScanResults *results = &target->results;
+
+  region_map_read(&target->region_map);
+  region_map_select(&target->region_map, filter, &target->regions);
+
+  if (!tracker->active) {
+    return;
+  }
+
+  const RegionChanges changes =
+      region_tracker_update(tracker, &target->regions);
+
+  if (changes.removed > 0 || changes.added > 0) {
+    print_target_label(target, target_count);
+  }
+
+  if (changes.removed > 0) {
+    const size_t count = scan_results_count(results);
+    for (size_t i = 0; i < results->size; i++) {
+      candidates_clip(&results->sets[i], &tracker->known);
+    }
+    printf("%zu bytes unmapped, dropped %zu candidates\n", changes.removed,
+           count - scan_results_count(results));
+  }
+
+  if (changes.added > 0) {
+    printf("%zu bytes newly mapped, %zu bytes not scanned yet, use catchup "
+           "to scan them\n",
+           changes.added, pmregion_array_bytes(&tracker->pending));
+  }
+}
+
+// Makes the regions a new filter selects the baseline of every target that
+// tracks them. Diffing against the old selection would take memory the
+// filter no longer covers for unmapped, and memory it newly covers for new.
+void retrack_regions(Target **targets, const size_t target_count,
+                     const RegionFilter *filter) {
+  bool tracked = false;
+
+  for (size_t t = 0; t < target_count; t++) {
+    Target *target = targets[t];
+    if (!target->region_tracker.active) {
+      continue;
+    }
+
+    region_map_read(&target->region_map);
+    region_map_select(&target->region_map, filter, &target->regions);
+    region_tracker_reset(&target->region_tracker, &target->regions);
+    tracked = true;
+  }
+
+  if (tracked) {
+    printf("Region filter changed, mapping changes are tracked from here "
+           "and the candidates are kept as they are\n");
+  }
+}
+
+// Indexes every pointer in the scanned regions, then looks for chains from
+// static addresses to address
+void pointer_scan_command(ScanEngine *engine, const RegionMap *region_map,
+                          const PMRegionArray *regions,
+                          const unsigned long address,
+                          const PointerScanOptions *options) {
+  struct timespec start;
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  PointerIndex index = pointer_index_build(engine, region_map, regions);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  printf("Indexed %zu pointers in %.1f ms, %zu bytes\n", index.count,
+         (end.tv_sec - start.tv_sec) * 1e3 +
+             (end.tv_nsec - start.tv_nsec) / 1e6,
+         index.count * 2 * sizeof(unsigned long));
+
+  const size_t found = pointer_scan(&index, region_map, address, options);
+  printf("Found %zu pointer chains to 0x%lx\n", found, address);
+
+  pointer_index_destroy(&index);
+}
+
+// Reads the maps again and shows what the next scan would cover
+void report_regions(RegionMap *region_map, const RegionFilter *filter,
+                    PMRegionArray *regions, const bool list) {
+  const RegionFilter writable_filter = region_filter_default();
+
+  region_map_read(region_map);
+  region_map_select(region_map, &writable_filter, regions);
+  const size_t writable_count = regions->size;
+  const size_t writable_bytes = pmregion_array_bytes(regions);
+
+  region_map_select(region_map, filter, regions);
+  const size_t selected_bytes = pmregion_array_bytes(regions);
+
+  print_region_filter(filter);
+  if (list) {
+    print_memory_regions(regions);
+  }
+
+  printf("Scanning %zu of %zu writable regions, %zu of %zu bytes (%zu "
+         "filtered out)\n",
+         regions->size, writable_count, selected_bytes, writable_bytes,
+         writable_bytes - selected_bytes);
+}
 
 int main(const int argc, const char *argv[]) {
-  if (argc != 2) {
-    fprintf(stderr, "Usage: %s <process_name>\n", argv[0]);
+  size_t threads = sysconf(_SC_NPROCESSORS_ONLN);
+  PauseMode pause_mode = PAUSE_FULL;
+  const char *process_name = NULL;
+  bool incremental = false;
+  const char *backend_name = NULL;
+  size_t mem_limit = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--pause") == 0 && i + 1 < argc) {
+      if (!pause_mode_parse(&pause_mode, argv[++i])) {
+        exit_error("Pause mode must be none, chunk or full");
+      }
+    } else if (strcmp(argv[i], "--incremental") == 0) {
+      incremental = true;
+    } else if (strcmp(argv[i], "--reader") == 0 && i + 1 < argc) {
+      backend_name = argv[++i];
+    } else if (strcmp(argv[i], "--mem-limit") == 0 && i + 1 < argc) {
+      // In megabytes
+      mem_limit = strtoul(argv[++i], NULL, 10) << 20;
+    } else {
+      process_name = argv[i];
+    }
+  }
+
+  if (process_name == NULL) {
+    fprintf(stderr, "Usage: %s [--threads <count>] [--incremental] "
+                    "[--pause none|chunk|full] [--mem-limit <MB>] "
+                    "[--reader vm|procmem|ptrace] "
+                    "<process_name | pid>\n",
+            argv[0]);
     exit_error("Wrong number of arguments");
   }
 
-  const char *process_name = argv[1];
-  const pid_t pid = get_pid(process_name);
-  // const pid_t pid = atoi(process_name);
+  ULongArray pids = ulong_array_create(16);
+  find_processes(process_name, &pids);
 
-  String process_memory_map = string_create(INITIAL_CAPACITY);
-  PMRegionArray regions = pmregion_array_create(INITIAL_CAPACITY);
-  ULongArray offset_array = ulong_array_create(INITIAL_CAPACITY);
+  // Every process named so is a target, sharing the memory limit
+  Target **targets = calloc(pids.size + 1, sizeof(Target *));
+  size_t target_count = 0;
+  if (targets == NULL) {
+    exit_error("Error allocating targets");
+  }
 
-  read_process_memory(&process_memory_map, pid);
-  regions_fill(&regions, &process_memory_map);
+  for (size_t i = 0; i < pids.size; i++) {
+    Target *target = target_attach(pids.items[i], pause_mode, mem_limit,
+                                   incremental);
+    if (target == NULL) {
+      continue;
+    }
 
-  if (ptrace(PTRACE_SEIZE, pid, NULL, NULL) == -1) {
-    perror("ptrace seize");
+    ReaderBackend backend;
+    if (backend_name != NULL &&
+        (!reader_backend_parse(&backend, backend_name) ||
+         !reader_set_backend(&target->reader, backend))) {
+      exit_error("Reader must be vm, procmem or ptrace, and available");
+    }
+
+    targets[target_count++] = target;
+  }
+  ulong_array_destroy(&pids);
+
+  if (target_count == 0) {
+    fprintf(stderr, "No process named %s could be attached to\n",
+            process_name);
     exit(EXIT_FAILURE);
   }
+  share_mem_limit(targets, target_count, mem_limit);
+
+  // Commands about a single process, such as look or watch, act on this one
+  Target *current = targets[0];
+  RegionFilter region_filter = region_filter_default();
+  NewScan last_scan = {.type = UNKNOWN};
+  ScanEngine engine = scan_engine_create(&current->reader, threads);
+
+  if (target_count > 1) {
+    printf("Attached to %zu processes named %s\n", target_count,
+           process_name);
+    print_targets(targets, target_count, current);
+  }
 
-  ValueType current_type = UNKNOWN;
+  if (incremental) {
+    printf("Incremental scans: %s\n", pagemap_mode_name(&current->tracker));
+  }
+
+  // Long listings go out in large writes, progress lines are flushed
+  setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+  Stats session_stats = stats_create();
+  bool stats_summary = true;
 
   char command_buffer[256];
   // char last_command[256];
 
   while (true) {
     printf("[memsniffer]>_ ");
+    // Output may go to a pipe, which isn't flushed at each line
+    fflush(stdout);
     // Commands:
-    // new <type> <value>
-    // next <value>
+    // new <type> <value> [--align <stride>]
+    // new any | <type>,<type>,... <value>
+    // new <type> between <low> <high> | < <value> | > <value> | != <value>
+    // new <type> mask <mask> [<bits>] | in <value>,<value>,...
+    // new float32 | double64 <value> [--eps <e> | --round | --truncate]
+    // new <type> ?
+    // new string | string16 <text>
+    // aob <hex bytes, ?? for any byte>
+    // group <type>:<value>@<offset> ... [--align <stride>]
+    // next <value> [--eps <e> | --round | --truncate]
+    // next changed | unchanged | increased | decreased
+    // next increased-by <value> | decreased-by <value>
+    // next between <low> <high> | < <value> | > <value> | != <value>
+    // next mask <mask> [<bits>] | in <value>,<value>,...
     // look <type> <region>
     // update <type> <region> <value>
-    // lookall <type>
+    // lookall [<type>]
+    // setall <type> <value>
+    // freeze [<type> <address> <value> | rate <hz>]
+    // unfreeze [<address>]
+    // catchup
+    // save <file> [--map]
+    // load <file>
+    // ptrscan <address> [--depth <n>] [--max-offset <n>] [--max-results <n>]
+    // pause [none | chunk | full]
+    // regions [list | <kind,...>] [--exclude-lib] [--only-module <name>]
+    //         [--min-size <n>] [--max-size <n>] [--range <start>-<end>]
+    // watch <address> <len> [w | rw] [<seconds>]
+    // stats [reset | summary on | off]
+    // target [<pid>]
     // exit
 
     fgets(command_buffer, sizeof(command_buffer), stdin);
@@ -519,95 +1459,568 @@ int main(const int argc, const char *argv[]) {
 
     // strcpy(last_command, command);
 
-    int status = 0;
+    if (command == NULL) {
+      continue;
+    }
 
-    ptrace(PTRACE_INTERRUPT, pid, NULL, NULL);
+    const unsigned long command_start = stats_now_ns();
 
-    if (waitpid(pid, &status, 0) == -1) {
-      perror("waitpid");
-      exit(EXIT_FAILURE);
+    const size_t alive = drop_exited_targets(targets, target_count, &current);
+    if (alive == 0) {
+      printf("Every process exited\n");
+      break;
     }
+    if (alive < target_count) {
+      share_mem_limit(targets, alive, mem_limit);
+    }
+    target_count = alive;
+    engine.reader = &current->reader;
 
-    if (WIFSTOPPED(status)) {
-      if (strcmp("new", command) == 0) {
-        ulong_array_clear(&offset_array);
+    for (size_t t = 0; t < target_count; t++) {
+      Tracee *tracee = &targets[t]->tracee;
 
-        char *type_str = strtok(NULL, " ");
-        const char *target_str = strtok(NULL, " ");
-        printf("Looking for new %s value: %s\n", type_str, target_str);
+      // Other modes leave stopping to the reader and writer
+      if (tracee->mode == PAUSE_FULL && !tracee_stop(tracee)) {
+        exit_error("Error stopping process");
+      }
 
-        current_type = parse_argtype(type_str);
+      track_regions(targets[t], &region_filter, target_count);
+    }
 
-        if (current_type == STRING) {
-          String string = string_create(1024);
-          string_from_chars(&string, target_str);
-          initial_scan_str(pid, regions, string, &offset_array);
-        }
+    if (strcmp("new", command) == 0 || strcmp("aob", command) == 0) {
+      const bool aob = strcmp("aob", command) == 0;
+      char *type_str = aob ? NULL : strtok(NULL, " ");
+      PatternKind pattern = aob ? PATTERN_HEX : PATTERN_TEXT;
+
+      // Patterns take the rest of the line, spaces included
+      char *args = strtok(NULL, "");
+      printf("Looking for new %s value: %s\n", aob ? command : type_str,
+             args);
+      fflush(stdout);
+
+      ValueType types[RESULTS_MAX] = {STRING};
+      size_t type_count = 1;
+
+      if (type_str != NULL && strcmp(type_str, "string16") == 0) {
+        pattern = PATTERN_UTF16;
+      } else if (!aob) {
+        type_count = type_str != NULL ? parse_type_list(type_str, types) : 0;
+      }
 
-        else if (current_type == FLOAT32 || current_type == DOUBLE64) {
-          const double target_double = strtod(target_str, NULL);
-          initial_scan_ld(pid, regions, target_double, &offset_array,
-                          current_type);
+      NewScan scan = {.type = types[0], .pattern = pattern};
+      bool valid = type_count > 0 && args != NULL;
+
+      // Patterns are a scan of their own
+      for (size_t i = 0; i < type_count; i++) {
+        valid = valid && types[i] != UNKNOWN &&
+                (types[i] != STRING || type_count == 1);
+      }
+
+      if (valid && scan.type == STRING) {
+        snprintf(scan.target, sizeof(scan.target), "%s", args);
+      } else if (valid) {
+        scan.stride = take_align_option(args);
+
+        char first[8] = "";
+        sscanf(args, "%7s", first);
+        scan.unknown = strcmp(first, "?") == 0;
+        valid = !scan.unknown || type_count == 1;
+
+        for (size_t i = 0; valid && !scan.unknown && i < type_count; i++) {
+          Filter *filter = &scan.filters[scan.filter_count];
+          bool fits;
+
+          valid = parse_typed_filter(types[i], get_byte_count(types[i]), args,
+                                     filter, &fits) &&
+                  filter_is_absolute(filter);
+
+          // Among several types, those the value isn't one of are skipped
+          if (valid && (fits || type_count == 1)) {
+            scan.filter_count++;
+          }
         }
+      }
+
+      if (!valid) {
+        printf("Usage: new <type> <value | ? | between <low> <high> | "
+               "< <value> | > <value> | != <value> | mask <mask> [<bits>] | "
+               "in <value>,...> [--align <stride>] "
+               "[--eps <e> | --round | --truncate] | "
+               "new any | <type>,<type>,... <value> | "
+               "new string | string16 <text> | aob <hex bytes>\n");
+      } else {
+        last_scan = scan;
+
+        clear_targets(targets, target_count, incremental);
+        print_scan_ranges(&last_scan);
+        new_scan_bounded(&engine, targets, target_count, &last_scan);
+      }
+
+      print_target_results(targets, target_count, false);
+    } else if (strcmp("group", command) == 0) {
+      char *args = strtok(NULL, "");
+      NewScan scan = {.type = UNKNOWN};
+      size_t stride = 0;
 
-        else {
-          const long target = strtol(target_str, NULL, 10);
+      if (args != NULL) {
+        stride = take_align_option(args);
+      }
 
-          initial_scan(pid, regions, target, &offset_array, current_type);
+      if (args == NULL || !group_parse(&scan.group, args)) {
+        printf("Usage: group <type>:<value>@<offset> ... [--align <stride>], "
+               "up to %d fields within %d bytes\n",
+               GROUP_MAX_FIELDS, GROUP_MAX_SPAN);
+      } else {
+        if (stride != 0) {
+          scan.group.stride = stride;
         }
-      } else if (strcmp("next", command) == 0) {
-        const char *target_str = strtok(NULL, " ");
-        const long target = strtol(target_str, NULL, 10);
+        scan.type = scan.group.fields[scan.group.first].type;
+        last_scan = scan;
+
+        printf("Looking for groups of ");
+        print_group(&scan.group);
+        fflush(stdout);
 
-        printf("Looking for next value: %s\n", target_str);
-        const ULongArray filtered =
-            next_scan(pid, target, &offset_array, current_type);
+        clear_targets(targets, target_count, incremental);
+        new_scan_bounded(&engine, targets, target_count, &last_scan);
+        print_target_results(targets, target_count, true);
+      }
+    } else if (strcmp("next", command) == 0) {
+      const char *args = strtok(NULL, "");
+      Filter filters[RESULTS_MAX];
+      bool fits[RESULTS_MAX];
+      size_t set_count = 0;
+      bool valid = args != NULL;
+
+      // Targets may hold different sets once one loads a session
+      for (size_t t = 0; valid && t < target_count; t++) {
+        valid = parse_next_filters(&targets[t]->results, args, filters, fits);
+        set_count += targets[t]->results.size;
+      }
+      valid = valid && set_count > 0;
+
+      if (!valid) {
+        printf("Usage: next <value> [--eps <e> | --round | --truncate] | "
+               "changed | unchanged | increased | "
+               "decreased | increased-by <n> | decreased-by <n> | "
+               "between <low> <high> | < <value> | > <value> | "
+               "!= <value> | mask <mask> [<bits>] | in <value>,...\n");
+      } else {
+        printf("Looking for next value: %s\n", args);
+        fflush(stdout);
+
+        for (size_t t = 0; t < target_count; t++) {
+          Target *target = targets[t];
+          ScanResults *results = &target->results;
+
+          parse_next_filters(results, args, filters, fits);
+
+          // Every set is filtered against the pages that changed since the
+          // last command. Bits are cleared once, before reading anything, so
+          // writes racing with this scan show up in the next one.
+          PageChanges changes = page_changes_create();
+          if (incremental) {
+            changes = next_scan_pages(&target->tracker, results);
+            pagemap_clear_refs(&target->tracker);
+          }
+
+          for (size_t i = 0; i < results->size; i++) {
+            CandidateSet *set = &results->sets[i];
+
+            // None of a set can hold a value that isn't one of its type
+            if (!fits[i] && results->size > 1) {
+              candidates_clear(set);
+              continue;
+            }
+
+            // The limit holds for all of the target's sets together
+            spill_results(&target->spill, results);
+            next_scan(&target->reader, incremental ? &changes : NULL,
+                      &filters[i], set, &target->spill,
+                      scan_results_memory(results) - candidates_memory(set));
+          }
+
+          page_changes_destroy(&changes);
+        }
 
-        memcpy(offset_array.items, filtered.items,
-               filtered.size * (sizeof(unsigned long)));
+        print_target_results(targets, target_count, true);
+      }
+    } else if (strcmp("look", command) == 0) {
+      char *type_str = strtok(NULL, " ");
+      const char *offset_str = strtok(NULL, " ");
+      const unsigned long offset = strtoul(offset_str, NULL, 16);
 
-        offset_array.size = filtered.size;
-      } else if (strcmp("look", command) == 0) {
-        char *type_str = strtok(NULL, " ");
-        const char *offset_str = strtok(NULL, " ");
-        const unsigned long offset = strtoul(offset_str, NULL, 16);
+      const ValueType type = parse_argtype(type_str);
 
-        const ValueType type = parse_argtype(type_str);
+      look(&current->reader, offset, type);
+    } else if (strcmp("lookall", command) == 0) {
+      char *type_str = strtok(NULL, " ");
+      const ValueType type =
+          type_str != NULL ? parse_argtype(type_str) : UNKNOWN;
 
-        look(pid, offset, type);
-      } else if (strcmp("lookall", command) == 0) {
-        char *type_str = strtok(NULL, " ");
-        const ValueType type = parse_argtype(type_str);
+      for (size_t t = 0; t < target_count; t++) {
+        const ScanResults *results = &targets[t]->results;
 
-        for (int i = 0; i < offset_array.size; i++) {
-          look(pid, offset_array.items[i], type);
+        if (scan_results_count(results) > 0) {
+          print_target_label(targets[t], target_count);
         }
-      } else if (strcmp("update", command) == 0) {
-        char *type_str = strtok(NULL, " ");
-        const ValueType type = parse_argtype(type_str);
 
-        const char *offset_str = strtok(NULL, " ");
-        const unsigned long offset = strtoul(offset_str, NULL, 16);
+        // Without a type, each set is shown as the type it was found as
+        for (size_t i = 0; i < results->size; i++) {
+          if (type_str == NULL && results->size > 1 &&
+              results->sets[i].count > 0) {
+            printf("%s:\n", value_type_name(results->types[i]));
+          }
+          look_all(&targets[t]->reader, &results->sets[i],
+                   type_str != NULL ? type : results->types[i]);
+        }
+      }
+    } else if (strcmp("update", command) == 0) {
+      char *type_str = strtok(NULL, " ");
+      const ValueType type =
+          type_str != NULL ? value_type_parse(type_str) : UNKNOWN;
+
+      const char *offset_str = strtok(NULL, " ");
+      const unsigned long offset =
+          offset_str != NULL ? strtoul(offset_str, NULL, 16) : 0;
+
+      const char *value_str = strtok(NULL, " ");
+
+      if (type == UNKNOWN || type == STRING || offset_str == NULL ||
+          value_str == NULL) {
+        printf("Usage: update <type> <address> <value>\n");
+      } else {
+        update(&current->writer, offset, value_str, type);
+      }
+    } else if (strcmp("setall", command) == 0) {
+      char *type_str = strtok(NULL, " ");
+      const ValueType type =
+          type_str != NULL ? value_type_parse(type_str) : UNKNOWN;
+      const char *value_str = strtok(NULL, " ");
+
+      if (type == UNKNOWN || type == STRING || value_str == NULL) {
+        printf("Usage: setall <type> <value>\n");
+      } else {
+        for (size_t t = 0; t < target_count; t++) {
+          const ScanResults *results = &targets[t]->results;
+          print_target_label(targets[t], target_count);
+
+          // Among several sets, only those found as type are written
+          for (size_t i = 0; i < results->size; i++) {
+            if (results->size == 1 || results->types[i] == type) {
+              set_all(&targets[t]->writer, &results->sets[i], value_str,
+                      type);
+            }
+          }
+        }
+      }
+    } else if (strcmp("freeze", command) == 0) {
+      char *first = strtok(NULL, " ");
+
+      if (first == NULL) {
+        print_freezer(&current->freezer);
+      } else if (strcmp(first, "rate") == 0) {
+        const char *rate_str = strtok(NULL, " ");
+        if (rate_str != NULL) {
+          freezer_set_rate(&current->freezer, strtoul(rate_str, NULL, 10));
+        }
+        printf("Freezing at %lu Hz\n", current->freezer.rate);
+      } else {
+        const ValueType type = value_type_parse(first);
+        const char *address_str = strtok(NULL, " ");
+        const char *value_str = strtok(NULL, " ");
 
+        if (type == UNKNOWN || type == STRING || address_str == NULL ||
+            value_str == NULL) {
+          printf("Usage: freeze [<type> <address> <value> | rate <hz>]\n");
+        } else {
+          const FrozenValue frozen = {
+              .address = strtoul(address_str, NULL, 16),
+              .type = type,
+              .bits = value_bits(type, value_parse(type, value_str)),
+          };
+          freezer_add(&current->freezer, frozen);
+          printf("Freezing %s at 0x%lx\n", value_str, frozen.address);
+        }
+      }
+    } else if (strcmp("unfreeze", command) == 0) {
+      const char *address_str = strtok(NULL, " ");
+
+      if (address_str == NULL) {
+        freezer_clear(&current->freezer);
+        printf("Unfroze everything\n");
+      } else if (!freezer_remove(&current->freezer,
+                                 strtoul(address_str, NULL, 16))) {
+        printf("Nothing frozen at %s\n", address_str);
+      }
+    } else if (strcmp("ptrscan", command) == 0) {
+      const char *address_str = strtok(NULL, " ");
+      PointerScanOptions options = {
+          .depth = 4,
+          .max_offset = 0x1000,
+          .max_results = 100,
+      };
+
+      const char *option_str;
+      while ((option_str = strtok(NULL, " ")) != NULL) {
         const char *value_str = strtok(NULL, " ");
-        const long value = strtol(value_str, NULL, 10);
+        const unsigned long value =
+            value_str != NULL ? strtoul(value_str, NULL, 0) : 0;
+
+        if (strcmp(option_str, "--depth") == 0) {
+          options.depth = value;
+        } else if (strcmp(option_str, "--max-offset") == 0) {
+          options.max_offset = value;
+        } else if (strcmp(option_str, "--max-results") == 0) {
+          options.max_results = value;
+        }
+      }
 
-        update(pid, offset, value, type);
-      } else if (strcmp("exit", command) == 0) {
-        printf("Exiting...\n");
-        break;
+      if (address_str == NULL) {
+        printf("Usage: ptrscan <address> [--depth <n>] [--max-offset <n>] "
+               "[--max-results <n>]\n");
+      } else {
+        pointer_scan_command(&engine, &current->region_map, &current->regions,
+                             strtoul(address_str, NULL, 16), &options);
+      }
+    } else if (strcmp("catchup", command) == 0) {
+      ScanTarget *pending = calloc(target_count, sizeof(ScanTarget));
+      ScanResults *found = calloc(target_count, sizeof(ScanResults));
+      size_t pending_count = 0;
+
+      if (pending == NULL || found == NULL) {
+        exit_error("Error allocating scan targets");
+      }
+
+      for (size_t t = 0; last_scan.type != UNKNOWN && t < target_count; t++) {
+        Target *target = targets[t];
+
+        if (target->region_tracker.pending.size > 0) {
+          found[pending_count] = scan_results_create();
+          pending[pending_count].reader = &target->reader;
+          pending[pending_count].regions = &target->region_tracker.pending;
+          pending[pending_count].results = &found[pending_count];
+          pending_count++;
+        }
+      }
+
+      if (pending_count == 0) {
+        printf("No new regions to scan\n");
+      } else {
+        new_scan(&engine, pending, pending_count, &last_scan);
+
+        for (size_t t = 0, n = 0; t < target_count; t++) {
+          Target *target = targets[t];
+
+          if (target->region_tracker.pending.size == 0) {
+            continue;
+          }
+
+          print_target_label(target, target_count);
+          printf("Found %zu candidates in %zu new bytes\n",
+                 scan_results_count(&found[n]),
+                 pmregion_array_bytes(&target->region_tracker.pending));
+
+          scan_results_merge(&target->results, &found[n++]);
+          spill_results(&target->spill, &target->results);
+          region_tracker_catch_up(&target->region_tracker);
+        }
+
+        print_target_results(targets, target_count, false);
+      }
+
+      free(pending);
+      free(found);
+    } else if (strcmp("save", command) == 0) {
+      const char *path = strtok(NULL, " ");
+      const char *option = strtok(NULL, " ");
+      const bool map = option != NULL && strcmp(option, "--map") == 0;
+
+      if (path == NULL || (option != NULL && !map)) {
+        printf("Usage: save <file> [--map]\n");
+      } else if (session_save(path, current->pid, &current->region_tracker,
+                              &current->results, &last_scan,
+                              sizeof(last_scan))) {
+        printf("Saved %zu candidates to %s\n",
+               scan_results_count(&current->results), path);
+
+        // The sets are swapped for the file, leaving them to the page cache
+        if (map && load_session(path, &current->session, current->pid,
+                                &current->region_tracker, &current->results,
+                                &current->spill, &last_scan)) {
+          print_scan_results(&current->results);
+        }
+      }
+    } else if (strcmp("load", command) == 0) {
+      const char *path = strtok(NULL, " ");
+
+      if (path == NULL) {
+        printf("Usage: load <file>\n");
+      } else if (load_session(path, &current->session, current->pid,
+                              &current->region_tracker, &current->results,
+                              &current->spill, &last_scan)) {
+        printf("Loaded %zu candidates from %s\n",
+               scan_results_count(&current->results), path);
+        print_scan_results(&current->results);
+      }
+    } else if (strcmp("regions", command) == 0) {
+      const char *first = strtok(NULL, " ");
+      const bool list = first != NULL && strcmp(first, "list") == 0;
+      RegionFilter filter = region_filter;
+
+      if (first != NULL && !list && !region_filter_parse(&filter, first)) {
+        printf("Usage: regions [list | <heap,anon,stack,file,vdso,all>] "
+               "[--exclude-lib] [--only-module <name>] [--min-size <n>] "
+               "[--max-size <n>] [--range <start>-<end>]\n");
+      } else {
+        const bool changed = !region_filter_equal(&filter, &region_filter);
+        region_filter = filter;
+        report_regions(&current->region_map, &region_filter,
+                       &current->regions, list);
+
+        if (changed) {
+          retrack_regions(targets, target_count, &region_filter);
+        }
+      }
+    } else if (strcmp("pause", command) == 0) {
+      const char *mode_str = strtok(NULL, " ");
+      PauseMode mode = current->tracee.mode;
+
+      // Without a mode, only shows the current one
+      if (mode_str != NULL && !pause_mode_parse(&mode, mode_str)) {
+        printf("Usage: pause [none | chunk | full]\n");
+      } else {
+        for (size_t t = 0; mode_str != NULL && t < target_count; t++) {
+          targets[t]->tracee.mode = mode;
+        }
+        printf("Pause mode: %s\n", pause_mode_name(mode));
+      }
+    } else if (strcmp("watch", command) == 0) {
+      const char *address_str = strtok(NULL, " ");
+      const char *len_str = strtok(NULL, " ");
+      const char *mode_str = strtok(NULL, " ");
+      const char *seconds_str = strtok(NULL, " ");
+
+      // The mode may be left out before the duration
+      if (mode_str != NULL && strcmp(mode_str, "w") != 0 &&
+          strcmp(mode_str, "rw") != 0 && seconds_str == NULL) {
+        seconds_str = mode_str;
+        mode_str = NULL;
+      }
+
+      const bool reads = mode_str != NULL && strcmp(mode_str, "rw") == 0;
+      const unsigned long seconds = seconds_str != NULL
+                                        ? strtoul(seconds_str, NULL, 10)
+                                        : WATCH_DEFAULT_SECONDS;
+      Watch watch;
+
+      if (address_str == NULL || len_str == NULL ||
+          (mode_str != NULL && strcmp(mode_str, "w") != 0 && !reads) ||
+          !watch_create(&watch, strtoul(address_str, NULL, 16),
+                        strtoul(len_str, NULL, 0), reads)) {
+        printf("Usage: watch <address> <len> [w | rw] [<seconds>], the "
+               "range fitting in four aligned pieces of up to 8 bytes\n");
+      } else {
+        printf("Watching %s of %zu bytes at 0x%lx for %lu s\n",
+               reads ? "reads and writes" : "writes", watch.len,
+               watch.address, seconds);
+        fflush(stdout);
+
+        if (watch_run(&watch, &current->tracee, seconds * 1000)) {
+          print_watch(&watch, &current->region_map, WATCH_SITES_LIMIT);
+        }
+        watch_destroy(&watch);
+      }
+    } else if (strcmp("stats", command) == 0) {
+      const char *first = strtok(NULL, " ");
+      const char *second = strtok(NULL, " ");
+
+      if (first == NULL) {
+        size_t memory = 0;
+        size_t spilled = 0;
+
+        for (size_t t = 0; t < target_count; t++) {
+          memory += scan_results_memory(&targets[t]->results);
+          spilled += targets[t]->spill.spilled;
+        }
+
+        print_stats(&session_stats);
+        printf("Candidate memory: %zu bytes, %zu bytes spilled to disk\n",
+               memory, spilled);
+
+        for (size_t t = 0; t < target_count; t++) {
+          if (scan_results_count(&targets[t]->results) > 0) {
+            print_target_label(targets[t], target_count);
+          }
+          print_region_hits(&targets[t]->regions, &targets[t]->results,
+                            REGION_HITS_LIMIT);
+        }
+      } else if (strcmp(first, "reset") == 0) {
+        session_stats = stats_create();
+      } else if (strcmp(first, "summary") == 0 && second != NULL &&
+                 (strcmp(second, "on") == 0 || strcmp(second, "off") == 0)) {
+        stats_summary = strcmp(second, "on") == 0;
+      } else {
+        printf("Usage: stats [reset | summary on | off]\n");
+      }
+    } else if (strcmp("target", command) == 0) {
+      const char *pid_str = strtok(NULL, " ");
+      Target *chosen = pid_str == NULL ? current : NULL;
+
+      for (size_t t = 0; chosen == NULL && t < target_count; t++) {
+        if (targets[t]->pid == atoi(pid_str)) {
+          chosen = targets[t];
+        }
       }
+
+      if (chosen == NULL) {
+        printf("Not attached to %s\n", pid_str);
+      } else {
+        current = chosen;
+        engine.reader = &current->reader;
+      }
+      print_targets(targets, target_count, current);
+    } else if (strcmp("exit", command) == 0) {
+      printf("Exiting...\n");
+      break;
     }
 
-    if (ptrace(PTRACE_CONT, pid, NULL, 0) == -1) {
-      exit_error("Error continuing process");
+    // Stop times add up over the targets, as do reads and writes
+    Stats command_stats = stats_create();
+    size_t candidate_bytes = 0;
+
+    for (size_t t = 0; t < target_count; t++) {
+      Target *target = targets[t];
+
+      command_stats.stops += target->tracee.stop_count;
+      tracee_resume(&target->tracee);
+      command_stats.stop_ns += tracee_take_stop_time(&target->tracee);
+
+      stats_add(&command_stats, &target->reader.stats);
+      command_stats.syscalls += target->writer.syscalls;
+      candidate_bytes += scan_results_memory(&target->results);
+
+      target->reader.stats = stats_create();
+      target->writer.syscalls = 0;
+    }
+
+    printf("Target stopped for %.3f ms in %lu stops\n",
+           command_stats.stop_ns / 1e6, command_stats.stops);
+
+    command_stats.wall_ns = stats_now_ns() - command_start;
+    command_stats.commands = 1;
+    command_stats.candidate_bytes = candidate_bytes;
+    stats_add(&session_stats, &command_stats);
+
+    if (stats_summary) {
+      print_stats_line(&command_stats);
     }
   }
 
-  string_destroy(&process_memory_map);
-  ulong_array_destroy(&offset_array);
-  pmregion_array_destroy(&regions);
+  for (size_t t = 0; t < target_count; t++) {
+    target_detach(targets[t]);
+  }
+  free(targets);
 
-  ptrace(PTRACE_DETACH, pid, NULL, NULL);
   return EXIT_SUCCESS;
 }
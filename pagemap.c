@@ -0,0 +1,231 @@
+#include "pagemap.h"
+#include "globals.h"
+#include "reader.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PM_PRESENT (1ULL << 63)
+#define PM_SWAPPED (1ULL << 62)
+#define PM_SOFT_DIRTY (1ULL << 55)
+#define PM_BATCH 512
+
+static bool write_clear_refs(const pid_t pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/clear_refs", pid);
+
+  const int fd = open(path, O_WRONLY);
+  if (fd == -1) {
+    return false;
+  }
+
+  // 4 clears the soft-dirty bits of every page
+  const bool cleared = write(fd, "4", 1) == 1;
+  close(fd);
+
+  return cleared;
+}
+
+static uint64_t own_entry(const int fd, const void *page) {
+  uint64_t entry = 0;
+  const off_t offset = (uintptr_t)page / PAGE_SIZE * sizeof(entry);
+
+  if (pread(fd, &entry, sizeof(entry), offset) != sizeof(entry)) {
+    return 0;
+  }
+
+  return entry;
+}
+
+// Kernels built without CONFIG_MEM_SOFT_DIRTY accept clear_refs but never
+// set the bit, so check on a page of our own
+static bool probe_soft_dirty(void) {
+  volatile unsigned char *page = aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+  bool supported = false;
+
+  if (page == NULL) {
+    return false;
+  }
+
+  page[0] = 1;
+
+  const int fd = open("/proc/self/pagemap", O_RDONLY);
+  if (fd != -1 && write_clear_refs(getpid())) {
+    const bool cleared = (own_entry(fd, (void *)page) & PM_SOFT_DIRTY) == 0;
+    page[0] = 2;
+    supported = cleared && (own_entry(fd, (void *)page) & PM_SOFT_DIRTY);
+  }
+
+  if (fd != -1) {
+    close(fd);
+  }
+  free((void *)page);
+
+  return supported;
+}
+
+PageTracker pagemap_create(const pid_t pid) {
+  PageTracker tracker;
+  tracker.pid = pid;
+  tracker.soft_dirty = probe_soft_dirty();
+  tracker.armed = false;
+
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/pagemap", pid);
+  tracker.pagemap_fd = open(path, O_RDONLY);
+
+  if (tracker.pagemap_fd == -1) {
+    perror("open pagemap");
+  }
+
+  return tracker;
+}
+
+void pagemap_destroy(PageTracker *tracker) {
+  if (tracker->pagemap_fd != -1) {
+    close(tracker->pagemap_fd);
+    tracker->pagemap_fd = -1;
+  }
+}
+
+void pagemap_clear_refs(PageTracker *tracker) {
+  tracker->armed = tracker->soft_dirty && write_clear_refs(tracker->pid);
+}
+
+void pagemap_changed(const PageTracker *tracker, const unsigned long start,
+                     const size_t count, unsigned char *out) {
+  uint64_t entries[PM_BATCH];
+
+  memset(out, 1, count);
+  if (tracker->pagemap_fd == -1) {
+    return;
+  }
+
+  for (size_t done = 0; done < count;) {
+    const size_t batch = count - done < PM_BATCH ? count - done : PM_BATCH;
+    const off_t offset = (start / PAGE_SIZE + done) * sizeof(uint64_t);
+    const ssize_t got =
+        pread(tracker->pagemap_fd, entries, batch * sizeof(uint64_t), offset);
+
+    if (got <= 0) {
+      return;
+    }
+
+    const size_t n = got / sizeof(uint64_t);
+    for (size_t i = 0; i < n; i++) {
+      const uint64_t entry = entries[i];
+      // Pages that were never faulted in still read as they did last time
+      bool changed = (entry & (PM_PRESENT | PM_SWAPPED)) != 0;
+
+      if (tracker->armed) {
+        changed = changed && (entry & PM_SOFT_DIRTY);
+      }
+
+      out[done + i] = changed;
+    }
+
+    done += n;
+  }
+}
+
+const char *pagemap_mode_name(const PageTracker *tracker) {
+  return tracker->soft_dirty ? "soft-dirty pages" : "present pages";
+}
+
+PageChanges page_changes_create(void) {
+  PageChanges changes = {0};
+  return changes;
+}
+
+void page_changes_destroy(PageChanges *changes) {
+  free(changes->runs);
+  free(changes->changed);
+  *changes = page_changes_create();
+}
+
+void page_changes_add(PageChanges *changes, const unsigned long first,
+                      const size_t count) {
+  if (changes->size == changes->capacity) {
+    changes->capacity = changes->capacity > 0 ? changes->capacity * 2 : 64;
+    changes->runs =
+        realloc(changes->runs, changes->capacity * sizeof(PageRun));
+
+    if (changes->runs == NULL) {
+      exit_error("Error allocating page runs");
+    }
+  }
+
+  changes->runs[changes->size++] =
+      (PageRun){.first = first, .count = count, .offset = 0};
+}
+
+static int compare_runs(const void *a, const void *b) {
+  const PageRun *x = a;
+  const PageRun *y = b;
+  return (x->first > y->first) - (x->first < y->first);
+}
+
+void page_changes_read(PageChanges *changes, const PageTracker *tracker) {
+  qsort(changes->runs, changes->size, sizeof(PageRun), compare_runs);
+
+  // Overlapping and touching runs become one, so each page is read once
+  size_t merged = 0;
+  for (size_t i = 0; i < changes->size; i++) {
+    const PageRun run = changes->runs[i];
+    PageRun *last = merged > 0 ? &changes->runs[merged - 1] : NULL;
+
+    if (last != NULL && run.first <= last->first + last->count) {
+      const unsigned long end = run.first + run.count;
+      if (end > last->first + last->count) {
+        last->count = end - last->first;
+      }
+    } else {
+      changes->runs[merged++] = run;
+    }
+  }
+  changes->size = merged;
+
+  changes->total = 0;
+  for (size_t i = 0; i < changes->size; i++) {
+    changes->runs[i].offset = changes->total;
+    changes->total += changes->runs[i].count;
+  }
+
+  free(changes->changed);
+  changes->changed = malloc(changes->total > 0 ? changes->total : 1);
+  if (changes->changed == NULL) {
+    exit_error("Error allocating page map");
+  }
+
+  changes->changed_count = 0;
+  for (size_t i = 0; i < changes->size; i++) {
+    const PageRun *run = &changes->runs[i];
+    pagemap_changed(tracker, run->first * PAGE_SIZE, run->count,
+                    changes->changed + run->offset);
+  }
+  for (size_t i = 0; i < changes->total; i++) {
+    changes->changed_count += changes->changed[i];
+  }
+}
+
+const unsigned char *page_changes_find(const PageChanges *changes,
+                                       const unsigned long first) {
+  size_t low = 0;
+  size_t high = changes->size;
+
+  // The last run starting at or before first
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (changes->runs[mid].first <= first) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  const PageRun *run = &changes->runs[low - 1];
+  return changes->changed + run->offset + (first - run->first);
+}
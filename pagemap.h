@@ -0,0 +1,66 @@
+#ifndef PAGEMAP_H
+#define PAGEMAP_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Tells which pages of the target may have changed since the last scan, from
+// /proc/<pid>/pagemap. With soft-dirty bits, a page counts as changed when
+// the target wrote to it after the bits were last cleared. Without them,
+// when it is present in memory at all.
+typedef struct {
+  pid_t pid;
+  int pagemap_fd;
+  bool soft_dirty; // The kernel keeps soft-dirty bits
+  bool armed;      // Bits were cleared at the last scan
+} PageTracker;
+
+PageTracker pagemap_create(pid_t pid);
+
+void pagemap_destroy(PageTracker *tracker);
+
+// Clears the target's soft-dirty bits, to be called before reading memory so
+// that writes made during the scan are caught by the next one
+void pagemap_clear_refs(PageTracker *tracker);
+
+// Sets out[i] to whether page i from start (page aligned) may have changed.
+// Pages whose entry can't be read count as changed.
+void pagemap_changed(const PageTracker *tracker, unsigned long start,
+                     size_t count, unsigned char *out);
+
+const char *pagemap_mode_name(const PageTracker *tracker);
+
+// A run of pages and where its bytes start in PageChanges.changed
+typedef struct {
+  unsigned long first; // Page number
+  size_t count;
+  size_t offset;
+} PageRun;
+
+// Which pages of a set of runs may have changed, read once so that every
+// candidate set of a target is filtered against the same view
+typedef struct {
+  size_t size;
+  size_t capacity;
+  PageRun *runs;
+  unsigned char *changed;
+  size_t total;
+  size_t changed_count;
+} PageChanges;
+
+PageChanges page_changes_create(void);
+
+void page_changes_destroy(PageChanges *changes);
+
+// Adds count pages from page number first to the pages to read. Runs may
+// overlap and come in any order.
+void page_changes_add(PageChanges *changes, unsigned long first, size_t count);
+
+// Merges the runs added so far and reads whether each of their pages changed
+void page_changes_read(PageChanges *changes, const PageTracker *tracker);
+
+// A byte per page from page number first on, inside a run that was read
+const unsigned char *page_changes_find(const PageChanges *changes,
+                                       unsigned long first);
+
+#endif
@@ -0,0 +1,348 @@
+#include "pattern.h"
+#include "globals.h"
+#include "kernels.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PATTERN_X86
+#include <immintrin.h>
+#endif
+
+static void pattern_alloc(Pattern *pattern, const size_t capacity) {
+  pattern->len = 0;
+  pattern->bytes = malloc(capacity > 0 ? capacity : 1);
+  pattern->mask = malloc(capacity > 0 ? capacity : 1);
+
+  if (pattern->bytes == NULL || pattern->mask == NULL) {
+    exit_error("Error allocating pattern");
+  }
+}
+
+static void pattern_push(Pattern *pattern, const unsigned char byte,
+                         const unsigned char mask) {
+  pattern->bytes[pattern->len] = byte & mask;
+  pattern->mask[pattern->len] = mask;
+  pattern->len++;
+}
+
+static int hex_nibble(const char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Whitespace separated tokens of hex digit pairs. A lone ? is a whole
+// wildcard byte, otherwise ? only stands for its own nibble.
+static bool parse_hex(Pattern *pattern, const char *text) {
+  const char *c = text;
+
+  while (*c != '\0') {
+    if (isspace((unsigned char)*c)) {
+      c++;
+      continue;
+    }
+
+    size_t token = 0;
+    while (c[token] != '\0' && !isspace((unsigned char)c[token])) {
+      token++;
+    }
+
+    if (token == 1 && c[0] == '?') {
+      pattern_push(pattern, 0, 0x00);
+    } else if (token % 2 != 0) {
+      return false;
+    } else {
+      for (size_t i = 0; i < token; i += 2) {
+        unsigned char byte = 0;
+        unsigned char mask = 0;
+
+        for (size_t j = 0; j < 2; j++) {
+          const int nibble = hex_nibble(c[i + j]);
+          byte <<= 4;
+          mask <<= 4;
+
+          if (nibble >= 0) {
+            byte |= nibble;
+            mask |= 0xF;
+          } else if (c[i + j] != '?') {
+            return false;
+          }
+        }
+
+        pattern_push(pattern, byte, mask);
+      }
+    }
+
+    c += token;
+  }
+
+  return true;
+}
+
+// Decodes one UTF-8 sequence, returning its length or 0 when malformed
+static size_t utf8_decode(const unsigned char *s, uint32_t *code) {
+  if (s[0] < 0x80) {
+    *code = s[0];
+    return 1;
+  }
+
+  size_t len;
+  if ((s[0] & 0xE0) == 0xC0) {
+    len = 2;
+    *code = s[0] & 0x1F;
+  } else if ((s[0] & 0xF0) == 0xE0) {
+    len = 3;
+    *code = s[0] & 0x0F;
+  } else if ((s[0] & 0xF8) == 0xF0) {
+    len = 4;
+    *code = s[0] & 0x07;
+  } else {
+    return 0;
+  }
+
+  for (size_t i = 1; i < len; i++) {
+    if ((s[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+    *code = (*code << 6) | (s[i] & 0x3F);
+  }
+
+  return *code <= 0x10FFFF ? len : 0;
+}
+
+static void push_utf16(Pattern *pattern, const uint32_t unit) {
+  pattern_push(pattern, unit & 0xFF, 0xFF);
+  pattern_push(pattern, unit >> 8, 0xFF);
+}
+
+static bool parse_utf16(Pattern *pattern, const char *text) {
+  const unsigned char *s = (const unsigned char *)text;
+
+  while (*s != '\0') {
+    uint32_t code;
+    const size_t len = utf8_decode(s, &code);
+    if (len == 0) {
+      return false;
+    }
+
+    if (code >= 0x10000) {
+      code -= 0x10000;
+      push_utf16(pattern, 0xD800 | (code >> 10));
+      push_utf16(pattern, 0xDC00 | (code & 0x3FF));
+    } else {
+      push_utf16(pattern, code);
+    }
+
+    s += len;
+  }
+
+  return true;
+}
+
+bool pattern_parse(Pattern *pattern, const PatternKind kind,
+                   const char *text) {
+  const size_t text_len = strlen(text);
+  bool parsed = true;
+
+  // Every byte of UTF-8 takes at most two bytes of UTF-16
+  pattern_alloc(pattern, kind == PATTERN_UTF16 ? text_len * 2 : text_len);
+
+  switch (kind) {
+  case PATTERN_HEX:
+    parsed = parse_hex(pattern, text);
+    break;
+  case PATTERN_UTF16:
+    parsed = parse_utf16(pattern, text);
+    break;
+  default:
+    for (size_t i = 0; i < text_len; i++) {
+      pattern_push(pattern, text[i], 0xFF);
+    }
+  }
+
+  if (!parsed || pattern->len == 0) {
+    pattern_destroy(pattern);
+    return false;
+  }
+
+  pattern->anchored = false;
+  pattern->first = 0;
+  pattern->last = 0;
+
+  for (size_t i = 0; i < pattern->len; i++) {
+    if (pattern->mask[i] == 0xFF) {
+      if (!pattern->anchored) {
+        pattern->first = i;
+      }
+      pattern->anchored = true;
+      pattern->last = i;
+    }
+  }
+
+  return true;
+}
+
+void pattern_destroy(Pattern *pattern) {
+  free(pattern->bytes);
+  free(pattern->mask);
+  pattern->bytes = NULL;
+  pattern->mask = NULL;
+  pattern->len = 0;
+}
+
+bool pattern_match_at(const Pattern *pattern, const unsigned char *buf) {
+  for (size_t i = 0; i < pattern->len; i++) {
+    if ((buf[i] & pattern->mask[i]) != pattern->bytes[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Checks the positions from start up to count, jumping between occurrences
+// of the first anchor
+static void find_scalar(const Pattern *pattern, const unsigned char *buf,
+                        size_t start, const size_t count,
+                        const unsigned long address, ULongArray *hits) {
+  if (!pattern->anchored) {
+    for (size_t i = start; i < count; i++) {
+      if (pattern_match_at(pattern, buf + i)) {
+        ulong_array_insert(hits, address + i);
+      }
+    }
+    return;
+  }
+
+  const unsigned char anchor = pattern->bytes[pattern->first];
+
+  while (start < count) {
+    const unsigned char *found =
+        memchr(buf + start + pattern->first, anchor, count - start);
+    if (found == NULL) {
+      return;
+    }
+
+    const size_t i = found - buf - pattern->first;
+    if (pattern_match_at(pattern, buf + i)) {
+      ulong_array_insert(hits, address + i);
+    }
+    start = i + 1;
+  }
+}
+
+#ifdef PATTERN_X86
+
+// mask has a bit for every position where both anchors are in place
+static inline void verify_hits(const Pattern *pattern, unsigned int mask,
+                               const unsigned char *buf,
+                               const unsigned long address, ULongArray *hits) {
+  while (mask != 0) {
+    const unsigned int i = __builtin_ctz(mask);
+    if (pattern_match_at(pattern, buf + i)) {
+      ulong_array_insert(hits, address + i);
+    }
+    mask &= mask - 1;
+  }
+}
+
+// Loads reach last + 16 bytes past a position, which stays inside avail as
+// long as the whole vector of positions is below count
+static size_t find_sse2(const Pattern *pattern, const unsigned char *buf,
+                        const size_t count, const unsigned long address,
+                        ULongArray *hits) {
+  const __m128i first = _mm_set1_epi8((char)pattern->bytes[pattern->first]);
+  const __m128i last = _mm_set1_epi8((char)pattern->bytes[pattern->last]);
+  size_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    const __m128i head =
+        _mm_loadu_si128((const __m128i *)(buf + i + pattern->first));
+    const __m128i tail =
+        _mm_loadu_si128((const __m128i *)(buf + i + pattern->last));
+    const unsigned int mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+    if (mask != 0) {
+      verify_hits(pattern, mask, buf + i, address + i, hits);
+    }
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2"))) static size_t
+find_avx2(const Pattern *pattern, const unsigned char *buf, const size_t count,
+          const unsigned long address, ULongArray *hits) {
+  const __m256i first = _mm256_set1_epi8((char)pattern->bytes[pattern->first]);
+  const __m256i last = _mm256_set1_epi8((char)pattern->bytes[pattern->last]);
+  size_t i = 0;
+
+  for (; i + 32 <= count; i += 32) {
+    const __m256i head =
+        _mm256_loadu_si256((const __m256i *)(buf + i + pattern->first));
+    const __m256i tail =
+        _mm256_loadu_si256((const __m256i *)(buf + i + pattern->last));
+    const unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last)));
+    if (mask != 0) {
+      verify_hits(pattern, mask, buf + i, address + i, hits);
+    }
+  }
+
+  return i;
+}
+
+#endif
+
+void pattern_find(const Pattern *pattern, const unsigned char *buf,
+                  const size_t len, const size_t avail,
+                  const unsigned long address, ULongArray *hits) {
+  if (avail < pattern->len) {
+    return;
+  }
+
+  // Positions where a whole match fits
+  const size_t fit = avail - pattern->len + 1;
+  const size_t count = len < fit ? len : fit;
+  size_t done = 0;
+
+#ifdef PATTERN_X86
+  if (pattern->anchored) {
+    switch (kernel_isa()) {
+    case ISA_AVX2:
+      done = find_avx2(pattern, buf, count, address, hits);
+      break;
+    case ISA_SSE2:
+      done = find_sse2(pattern, buf, count, address, hits);
+      break;
+    default:
+      break;
+    }
+  }
+#endif
+
+  find_scalar(pattern, buf, done, count, address, hits);
+}
+
+void pattern_print_bytes(const unsigned char *bytes, const size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    printf("%02x ", bytes[i]);
+  }
+
+  printf("\"");
+  for (size_t i = 0; i < len; i++) {
+    putchar(isprint(bytes[i]) ? bytes[i] : '.');
+  }
+  printf("\"");
+}
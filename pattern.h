@@ -0,0 +1,43 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ulong_array.h"
+
+typedef enum {
+  PATTERN_TEXT,    // ASCII or UTF-8 text, as is
+  PATTERN_UTF16,   // Text encoded as UTF-16LE
+  PATTERN_HEX,     // Hex bytes, where ? stands for any nibble
+} PatternKind;
+
+// A byte string where each byte matches when (memory & mask) == bytes.
+// first and last index the outermost bytes that are fully known, which are
+// looked for before checking the rest.
+typedef struct {
+  size_t len;
+  unsigned char *bytes;
+  unsigned char *mask;
+  bool anchored;
+  size_t first;
+  size_t last;
+} Pattern;
+
+// Builds a pattern from text of the given kind, such as "48 8B ?? ?? 89" or
+// "488B????89" for hex. Returns false when text is empty or malformed.
+bool pattern_parse(Pattern *pattern, PatternKind kind, const char *text);
+
+void pattern_destroy(Pattern *pattern);
+
+bool pattern_match_at(const Pattern *pattern, const unsigned char *buf);
+
+// Appends address + offset for every match starting in the first len bytes
+// of buf, in address order. Matches may extend into the first avail bytes.
+void pattern_find(const Pattern *pattern, const unsigned char *buf,
+                  size_t len, size_t avail, unsigned long address,
+                  ULongArray *hits);
+
+// Prints the bytes of a match, along with their text when printable
+void pattern_print_bytes(const unsigned char *bytes, size_t len);
+
+#endif
@@ -0,0 +1,542 @@
+#include "ptrscan.h"
+#include "globals.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POINTER_SIZE sizeof(unsigned long)
+#define SAMPLES_PER_BUCKET 64
+#define MAX_CHAIN_NODES (1UL << 22)
+
+typedef struct {
+  PMRegionArray targets; // Coalesced readable mappings
+} PointerScanContext;
+
+static bool is_pointer(const PMRegionArray *targets, const unsigned long value) {
+  if (targets->size == 0 || value < targets->regions[0].start ||
+      value >= targets->regions[targets->size - 1].end) {
+    return false;
+  }
+
+  size_t low = 0;
+  size_t high = targets->size;
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (targets->regions[mid].end <= value) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low < targets->size && targets->regions[low].start <= value;
+}
+
+// Keeps the aligned words of a piece that hold pointers, as a candidate
+// block whose values are the pointers
+static void scan_chunk_pointers(const ScanPiece *piece, void *ctx,
+                                ScanOutput *out) {
+  const PointerScanContext *scan = ctx;
+  const size_t slots = piece->len / POINTER_SIZE + 1;
+  unsigned long *locations = malloc(slots * sizeof(unsigned long));
+  unsigned long *values = malloc(slots * sizeof(unsigned long));
+  size_t count = 0;
+
+  if (locations == NULL || values == NULL) {
+    exit_error("Error allocating pointer scan buffers");
+  }
+
+  const size_t first = (POINTER_SIZE - piece->address % POINTER_SIZE) %
+                       POINTER_SIZE;
+  for (size_t offset = first; offset + POINTER_SIZE <= piece->len;
+       offset += POINTER_SIZE) {
+    unsigned long value;
+    memcpy(&value, piece->buf + offset, sizeof(value));
+
+    if (is_pointer(&scan->targets, value)) {
+      locations[count] = piece->address + offset;
+      values[count] = value;
+      count++;
+    }
+  }
+
+  if (count > 0) {
+    candidates_push(&out->blocks,
+                    candidate_block_encode(POINTER_SIZE, POINTER_SIZE,
+                                           piece->address, piece->len,
+                                           locations,
+                                           (const unsigned char *)values,
+                                           count));
+  }
+
+  free(locations);
+  free(values);
+}
+
+static void swap_pair(unsigned long *values, unsigned long *locations,
+                      const size_t i, const size_t j) {
+  const unsigned long value = values[i];
+  const unsigned long location = locations[i];
+  values[i] = values[j];
+  locations[i] = locations[j];
+  values[j] = value;
+  locations[j] = location;
+}
+
+// Quicksort on both arrays at once, by value
+static void sort_pairs(unsigned long *values, unsigned long *locations,
+                       size_t count) {
+  while (count > 16) {
+    const size_t mid = count / 2;
+    if (values[mid] < values[0]) {
+      swap_pair(values, locations, mid, 0);
+    }
+    if (values[count - 1] < values[0]) {
+      swap_pair(values, locations, count - 1, 0);
+    }
+    if (values[count - 1] < values[mid]) {
+      swap_pair(values, locations, count - 1, mid);
+    }
+
+    const unsigned long pivot = values[mid];
+    size_t i = 0;
+    size_t j = count - 1;
+    while (true) {
+      while (values[i] < pivot) {
+        i++;
+      }
+      while (values[j] > pivot) {
+        j--;
+      }
+      if (i >= j) {
+        break;
+      }
+      swap_pair(values, locations, i, j);
+      i++;
+      j--;
+    }
+
+    // Recurse on the smaller side so the stack stays shallow
+    const size_t left = j + 1;
+    if (left < count - left) {
+      sort_pairs(values, locations, left);
+      values += left;
+      locations += left;
+      count -= left;
+    } else {
+      sort_pairs(values + left, locations + left, count - left);
+      count = left;
+    }
+  }
+
+  for (size_t i = 1; i < count; i++) {
+    for (size_t j = i; j > 0 && values[j] < values[j - 1]; j--) {
+      swap_pair(values, locations, j, j - 1);
+    }
+  }
+}
+
+typedef struct {
+  unsigned long *values;
+  unsigned long *locations;
+  size_t count;
+  bool threaded; // Sorted by a thread of its own, to be joined
+} SortBucket;
+
+static void *sort_bucket(void *arg) {
+  SortBucket *bucket = arg;
+  sort_pairs(bucket->values, bucket->locations, bucket->count);
+  return NULL;
+}
+
+static int compare_ulong(const void *a, const void *b) {
+  const unsigned long x = *(const unsigned long *)a;
+  const unsigned long y = *(const unsigned long *)b;
+  return (x > y) - (x < y);
+}
+
+// Bucket of value among the sorted splitters
+static size_t find_bucket(const unsigned long *splitters, const size_t count,
+                          const unsigned long value) {
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (splitters[mid] <= value) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// Sample sort: values are split into one bucket per thread around sampled
+// splitters, scattered straight into place, then every bucket is sorted on
+// its own thread
+static void index_fill(PointerIndex *index, CandidateSet *pointers,
+                       const size_t threads) {
+  const size_t bucket_count = threads > 0 ? threads : 1;
+  const size_t sample_count = bucket_count * SAMPLES_PER_BUCKET;
+  const size_t sample_step =
+      pointers->count / sample_count > 0 ? pointers->count / sample_count : 1;
+  unsigned long *samples = malloc(sample_count * sizeof(unsigned long));
+  size_t *offsets = calloc(bucket_count + 1, sizeof(size_t));
+  size_t sampled = 0;
+  size_t seen = 0;
+
+  if (samples == NULL || offsets == NULL) {
+    exit_error("Error allocating pointer index");
+  }
+
+  for (size_t i = 0; i < pointers->size; i++) {
+    const CandidateBlock *block = &pointers->blocks[i];
+    for (size_t n = 0; n < block->count; n++, seen++) {
+      if (seen % sample_step == 0 && sampled < sample_count) {
+        memcpy(&samples[sampled++], block->values + n * POINTER_SIZE,
+               POINTER_SIZE);
+      }
+    }
+  }
+
+  qsort(samples, sampled, sizeof(unsigned long), compare_ulong);
+
+  unsigned long *splitters = samples;
+  size_t splitter_count = 0;
+  for (size_t b = 1; b < bucket_count && sampled > 0; b++) {
+    splitters[splitter_count++] = samples[b * sampled / bucket_count];
+  }
+
+  for (size_t i = 0; i < pointers->size; i++) {
+    const CandidateBlock *block = &pointers->blocks[i];
+    for (size_t n = 0; n < block->count; n++) {
+      unsigned long value;
+      memcpy(&value, block->values + n * POINTER_SIZE, POINTER_SIZE);
+      offsets[find_bucket(splitters, splitter_count, value) + 1]++;
+    }
+  }
+  for (size_t b = 0; b < bucket_count; b++) {
+    offsets[b + 1] += offsets[b];
+  }
+
+  index->count = pointers->count;
+  index->values = malloc(index->count * sizeof(unsigned long) + 1);
+  index->locations = malloc(index->count * sizeof(unsigned long) + 1);
+
+  if (index->values == NULL || index->locations == NULL) {
+    exit_error("Error allocating pointer index");
+  }
+
+  // Scatter, freeing each block as soon as it is placed
+  ULongArray locations = ulong_array_create(1024);
+  for (size_t i = 0; i < pointers->size; i++) {
+    CandidateBlock *block = &pointers->blocks[i];
+
+    ulong_array_clear(&locations);
+    candidates_decode_block(pointers, i, &locations);
+
+    for (size_t n = 0; n < block->count; n++) {
+      unsigned long value;
+      memcpy(&value, block->values + n * POINTER_SIZE, POINTER_SIZE);
+
+      const size_t slot =
+          offsets[find_bucket(splitters, splitter_count, value)]++;
+      index->values[slot] = value;
+      index->locations[slot] = locations.items[n];
+    }
+
+    candidate_block_destroy(block);
+  }
+  ulong_array_destroy(&locations);
+
+  pthread_t *sorters = malloc(bucket_count * sizeof(pthread_t));
+  SortBucket *buckets = malloc(bucket_count * sizeof(SortBucket));
+  if (sorters == NULL || buckets == NULL) {
+    exit_error("Error allocating pointer index");
+  }
+
+  // offsets now holds the end of every bucket
+  for (size_t b = 0; b < bucket_count; b++) {
+    const size_t start = b > 0 ? offsets[b - 1] : 0;
+    buckets[b].values = index->values + start;
+    buckets[b].locations = index->locations + start;
+    buckets[b].count = offsets[b] - start;
+    buckets[b].threaded =
+        pthread_create(&sorters[b], NULL, sort_bucket, &buckets[b]) == 0;
+
+    // Without a thread, the bucket is sorted here instead
+    if (!buckets[b].threaded) {
+      sort_bucket(&buckets[b]);
+    }
+  }
+  for (size_t b = 0; b < bucket_count; b++) {
+    if (buckets[b].threaded) {
+      pthread_join(sorters[b], NULL);
+    }
+  }
+
+  free(sorters);
+  free(buckets);
+  free(samples);
+  free(offsets);
+}
+
+PointerIndex pointer_index_build(ScanEngine *engine, const RegionMap *map,
+                                 const PMRegionArray *regions) {
+  PointerScanContext scan;
+  PMRegionArray readable = pmregion_array_create(map->regions.size);
+  scan.targets = pmregion_array_create(map->regions.size);
+
+  for (size_t i = 0; i < map->regions.size; i++) {
+    if (map->regions.regions[i].permission.read) {
+      pmregion_array_insert(&readable, map->regions.regions[i]);
+    }
+  }
+  pmregion_array_coalesce(&readable, &scan.targets);
+
+  CandidateSet pointers = candidates_create(POINTER_SIZE, POINTER_SIZE);
+  scan_regions(engine, regions, 0, scan_chunk_pointers, &scan, &pointers);
+
+  PointerIndex index;
+  index_fill(&index, &pointers, engine->threads);
+
+  // The blocks were freed as they were scattered
+  pointers.size = 0;
+  candidates_destroy(&pointers);
+  pmregion_array_destroy(&readable);
+  pmregion_array_destroy(&scan.targets);
+
+  return index;
+}
+
+void pointer_index_destroy(PointerIndex *index) {
+  free(index->values);
+  free(index->locations);
+  index->values = NULL;
+  index->locations = NULL;
+  index->count = 0;
+}
+
+// A module's mappings, plus the anonymous .bss right after them
+typedef struct {
+  unsigned long start;
+  unsigned long end;
+  unsigned long base;
+  const char *name;
+} StaticRange;
+
+static size_t static_ranges(const RegionMap *map, StaticRange *out) {
+  size_t count = 0;
+
+  for (size_t i = 0; i < map->regions.size; i++) {
+    const ProcessMemoryRegion *region = &map->regions.regions[i];
+    StaticRange *last = count > 0 ? &out[count - 1] : NULL;
+
+    if (region->kind == REGION_FILE) {
+      const char *slash = strrchr(region->path, '/');
+      const char *name = slash != NULL ? slash + 1 : region->path;
+
+      if (last != NULL && last->end == region->start &&
+          strcmp(last->name, name) == 0) {
+        last->end = region->end;
+      } else {
+        // Later segments of a module share the base of its first one
+        size_t first = count;
+        while (first > 0 && strcmp(out[first - 1].name, name) != 0) {
+          first--;
+        }
+
+        out[count].start = region->start;
+        out[count].end = region->end;
+        out[count].base = first > 0 ? out[first - 1].base
+                                    : region->start - region->offset;
+        out[count].name = name;
+        count++;
+      }
+    } else if (region->kind == REGION_ANON && last != NULL &&
+               last->end == region->start) {
+      last->end = region->end;
+    }
+  }
+
+  return count;
+}
+
+static const StaticRange *find_static(const StaticRange *ranges,
+                                      const size_t count,
+                                      const unsigned long address) {
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (ranges[mid].end <= address) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low < count && ranges[low].start <= address ? &ranges[low] : NULL;
+}
+
+// First index whose value is at least value
+static size_t lower_bound(const PointerIndex *index,
+                          const unsigned long value) {
+  size_t low = 0;
+  size_t high = index->count;
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (index->values[mid] < value) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// A location holding a pointer that, plus offset, gives its parent's address
+typedef struct {
+  unsigned long address;
+  unsigned long offset;
+  size_t parent;
+} ChainNode;
+
+// Open addressing set of heap locations already reached, so that cycles
+// and shared paths are walked once. It takes no more than half its capacity,
+// so that probing always ends on an empty slot.
+typedef struct {
+  size_t capacity;
+  size_t count;
+  unsigned long *slots;
+} VisitedSet;
+
+static bool visited_full(const VisitedSet *set) {
+  return set->count >= set->capacity / 2;
+}
+
+static bool visited_insert(VisitedSet *set, const unsigned long address) {
+  size_t i = (address * 0x9E3779B97F4A7C15UL) & (set->capacity - 1);
+
+  while (set->slots[i] != 0) {
+    if (set->slots[i] == address) {
+      return false;
+    }
+    i = (i + 1) & (set->capacity - 1);
+  }
+
+  set->slots[i] = address;
+  set->count++;
+  return true;
+}
+
+static void print_chain(const ChainNode *nodes, size_t node,
+                        const StaticRange *base) {
+  printf("\"%s\"+0x%lx", base->name, nodes[node].address - base->base);
+
+  // Offsets apply from the static end towards the target
+  while (nodes[node].parent != SIZE_MAX) {
+    printf(" -> 0x%lx", nodes[node].offset);
+    node = nodes[node].parent;
+  }
+
+  printf(" = 0x%lx\n", nodes[node].address);
+}
+
+size_t pointer_scan(const PointerIndex *index, const RegionMap *map,
+                    const unsigned long target,
+                    const PointerScanOptions *options) {
+  StaticRange *ranges = malloc((map->regions.size + 1) * sizeof(StaticRange));
+  ChainNode *nodes = malloc(MAX_CHAIN_NODES * sizeof(ChainNode));
+  VisitedSet visited = {.capacity = MAX_CHAIN_NODES * 2, .count = 0};
+  visited.slots = calloc(visited.capacity, sizeof(unsigned long));
+
+  if (ranges == NULL || nodes == NULL || visited.slots == NULL) {
+    exit_error("Error allocating pointer scan");
+  }
+
+  const size_t range_count = static_ranges(map, ranges);
+  size_t node_count = 1;
+  size_t level_start = 0;
+  size_t found = 0;
+  bool truncated = false;
+
+  nodes[0].address = target;
+  nodes[0].offset = 0;
+  nodes[0].parent = SIZE_MAX;
+  visited_insert(&visited, target);
+
+  for (size_t level = 0; level < options->depth && found < options->max_results;
+       level++) {
+    const size_t level_end = node_count;
+
+    for (size_t n = level_start; n < level_end && found < options->max_results;
+         n++) {
+      const unsigned long address = nodes[n].address;
+      const unsigned long low =
+          address > options->max_offset ? address - options->max_offset : 0;
+
+      for (size_t i = lower_bound(index, low);
+           i < index->count && index->values[i] <= address &&
+           found < options->max_results;
+           i++) {
+        const unsigned long location = index->locations[i];
+        const StaticRange *base = find_static(ranges, range_count, location);
+
+        if (node_count == MAX_CHAIN_NODES) {
+          truncated = true;
+          continue;
+        }
+
+        // A static location ends a chain, so it may end several. Heap
+        // locations are only followed, and so only remembered, before the
+        // last level.
+        if (base == NULL) {
+          if (level + 1 == options->depth) {
+            continue;
+          }
+          if (visited_full(&visited)) {
+            truncated = true;
+            continue;
+          }
+          if (!visited_insert(&visited, location)) {
+            continue;
+          }
+        }
+
+        ChainNode *node = &nodes[node_count];
+        node->address = location;
+        node->offset = address - index->values[i];
+        node->parent = n;
+
+        if (base != NULL) {
+          print_chain(nodes, node_count, base);
+          found++;
+        } else {
+          // Only heap locations are followed further
+          node_count++;
+        }
+      }
+    }
+
+    printf("Level %zu: %zu addresses to follow\n", level + 1,
+           node_count - level_end);
+    fflush(stdout);
+    level_start = level_end;
+  }
+
+  if (truncated) {
+    printf("Stopped following new addresses after %lu of them, chains "
+           "through the rest are missing\n",
+           MAX_CHAIN_NODES);
+  }
+
+  free(ranges);
+  free(nodes);
+  free(visited.slots);
+
+  return found;
+}
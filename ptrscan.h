@@ -0,0 +1,35 @@
+#ifndef PTRSCAN_H
+#define PTRSCAN_H
+#include <stddef.h>
+
+#include "regions.h"
+#include "scan.h"
+
+// Every aligned word of the scanned regions that points into a mapping,
+// sorted by the pointer value. Values and locations are kept in two arrays
+// so that binary searches only touch the values.
+typedef struct {
+  size_t count;
+  unsigned long *values;
+  unsigned long *locations; // locations[i] holds values[i]
+} PointerIndex;
+
+typedef struct {
+  size_t depth;
+  unsigned long max_offset;
+  size_t max_results;
+} PointerScanOptions;
+
+// Scans regions in parallel for pointers into any mapping of map
+PointerIndex pointer_index_build(ScanEngine *engine, const RegionMap *map,
+                                 const PMRegionArray *regions);
+
+void pointer_index_destroy(PointerIndex *index);
+
+// Prints chains from a static address, inside a module or its .bss, through
+// at most depth pointers with offsets up to max_offset, that lead to target.
+// Returns how many were found.
+size_t pointer_scan(const PointerIndex *index, const RegionMap *map,
+                    unsigned long target, const PointerScanOptions *options);
+
+#endif
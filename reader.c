@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+#include "reader.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+MemoryReader reader_create(const pid_t pid) {
+  MemoryReader reader;
+  reader.pid = pid;
+  reader.backend = READER_VM;
+  reader.mem_fd = -1;
+  reader.tracee = NULL;
+  reader.stats = stats_create();
+
+  return reader;
+}
+
+MemoryReader reader_clone(const MemoryReader *reader) {
+  MemoryReader clone = reader_create(reader->pid);
+  clone.backend = reader->backend;
+
+  if (clone.backend == READER_PROCMEM) {
+    char mem_path[64];
+    snprintf(mem_path, sizeof(mem_path), "/proc/%d/mem", reader->pid);
+
+    clone.mem_fd = open(mem_path, O_RDONLY);
+    if (clone.mem_fd == -1) {
+      clone.backend = READER_PTRACE;
+    }
+  }
+
+  return clone;
+}
+
+void reader_destroy(MemoryReader *reader) {
+  if (reader->mem_fd != -1) {
+    close(reader->mem_fd);
+    reader->mem_fd = -1;
+  }
+}
+
+const char *reader_backend_name(const ReaderBackend backend) {
+  switch (backend) {
+  case READER_VM:
+    return "process_vm_readv";
+  case READER_PROCMEM:
+    return "/proc/pid/mem";
+  case READER_PTRACE:
+    return "ptrace";
+  default:
+    return "unknown";
+  }
+}
+
+bool reader_backend_parse(ReaderBackend *backend, const char *name) {
+  if (strcmp(name, "vm") == 0) {
+    *backend = READER_VM;
+  } else if (strcmp(name, "procmem") == 0) {
+    *backend = READER_PROCMEM;
+  } else if (strcmp(name, "ptrace") == 0) {
+    *backend = READER_PTRACE;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+bool reader_set_backend(MemoryReader *reader, const ReaderBackend backend) {
+  if (backend == READER_PROCMEM && reader->mem_fd == -1) {
+    char mem_path[64];
+    snprintf(mem_path, sizeof(mem_path), "/proc/%d/mem", reader->pid);
+
+    reader->mem_fd = open(mem_path, O_RDONLY);
+    if (reader->mem_fd == -1) {
+      return false;
+    }
+  }
+
+  reader->backend = backend;
+  return true;
+}
+
+// Moves to the next backend when the current one is unavailable altogether,
+// as opposed to failing on a single address
+static void reader_fallback(MemoryReader *reader) {
+  if (reader->backend == READER_VM) {
+    char mem_path[64];
+    snprintf(mem_path, sizeof(mem_path), "/proc/%d/mem", reader->pid);
+
+    reader->mem_fd = open(mem_path, O_RDONLY);
+    if (reader->mem_fd != -1) {
+      reader->backend = READER_PROCMEM;
+      return;
+    }
+  }
+
+  reader->backend = READER_PTRACE;
+}
+
+static bool backend_unavailable(const int error) {
+  return error == ENOSYS || error == EPERM || error == EACCES;
+}
+
+static ssize_t read_vm(const MemoryReader *reader, const unsigned long address,
+                       void *buf, const size_t len) {
+  const struct iovec local = {.iov_base = buf, .iov_len = len};
+  const struct iovec remote = {.iov_base = (void *)address, .iov_len = len};
+
+  return process_vm_readv(reader->pid, &local, 1, &remote, 1, 0);
+}
+
+static ssize_t read_procmem(const MemoryReader *reader,
+                            const unsigned long address, void *buf,
+                            const size_t len) {
+  return pread(reader->mem_fd, buf, len, (off_t)address);
+}
+
+static size_t read_ptrace(MemoryReader *reader,
+                          const unsigned long address, unsigned char *buf,
+                          const size_t len) {
+  size_t done = 0;
+
+  while (done < len) {
+    errno = 0;
+    const long data =
+        ptrace(PTRACE_PEEKDATA, reader->pid, address + done, NULL);
+    reader->stats.syscalls++;
+
+    if (data == -1 && errno != 0) {
+      break;
+    }
+
+    const size_t step = len - done < sizeof(long) ? len - done : sizeof(long);
+    memcpy(buf + done, &data, step);
+    done += step;
+  }
+
+  return done;
+}
+
+static size_t read_range(MemoryReader *reader, const unsigned long address,
+                         void *buf, const size_t len) {
+  size_t done = 0;
+
+  while (done < len) {
+    ssize_t bytes_read;
+
+    if (reader->backend == READER_VM) {
+      bytes_read = read_vm(reader, address + done, (char *)buf + done,
+                           len - done);
+    } else if (reader->backend == READER_PROCMEM) {
+      bytes_read = read_procmem(reader, address + done, (char *)buf + done,
+                                len - done);
+    } else {
+      const size_t peeked = read_ptrace(reader, address + done,
+                                        (unsigned char *)buf + done,
+                                        len - done);
+      reader->stats.bytes_read += peeked;
+      done += peeked;
+      break;
+    }
+
+    reader->stats.syscalls++;
+
+    if (bytes_read == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (backend_unavailable(errno)) {
+        reader_fallback(reader);
+        continue;
+      }
+      // EFAULT / EIO: the page at address + done is not mapped or readable
+      break;
+    }
+
+    if (bytes_read == 0) {
+      break;
+    }
+
+    // A short read stops at a fault, the next iteration confirms it
+    done += bytes_read;
+    reader->stats.bytes_read += bytes_read;
+  }
+
+  if (done == 0) {
+    reader->stats.failed_reads++;
+  } else if (done < len) {
+    reader->stats.partial_reads++;
+  }
+
+  return done;
+}
+
+// PEEKDATA needs a stopped target whatever the pause mode
+static bool needs_stop(const MemoryReader *reader) {
+  return reader->tracee != NULL && (reader->tracee->mode == PAUSE_CHUNK ||
+                                    reader->backend == READER_PTRACE);
+}
+
+size_t reader_read(MemoryReader *reader, const unsigned long address,
+                   void *buf, const size_t len) {
+  const unsigned long start = stats_now_ns();
+  size_t done = 0;
+
+  if (!needs_stop(reader) || reader->tracee->stopped) {
+    done = read_range(reader, address, buf, len);
+  } else if (tracee_stop(reader->tracee)) {
+    // Stopped for this read only
+    done = read_range(reader, address, buf, len);
+    tracee_resume(reader->tracee);
+  }
+
+  reader->stats.read_ns += stats_now_ns() - start;
+  return done;
+}
+
+void reader_visit(MemoryReader *reader, unsigned long start,
+                  const unsigned long end, unsigned char *buf,
+                  const size_t buf_size, const ChunkVisitor visit, void *ctx) {
+  while (start < end) {
+    const size_t want = end - start < buf_size ? end - start : buf_size;
+    const size_t got = reader_read(reader, start, buf, want);
+
+    if (got > 0) {
+      visit(start, buf, got, ctx);
+    }
+
+    if (got == want) {
+      start += got;
+      continue;
+    }
+
+    // Skip the page that failed and carry on after it
+    start = ((start + got) & ~(PAGE_SIZE - 1)) + PAGE_SIZE;
+  }
+}
+
+// Addresses closer than this are fetched with a single read
+#define GATHER_MAX_GAP 4096UL
+
+void reader_gather(MemoryReader *reader, const unsigned long *addresses,
+                   const size_t count, const size_t width, unsigned char *buf,
+                   const size_t buf_size, const GatherVisitor visit,
+                   void *ctx) {
+  size_t i = 0;
+
+  while (i < count) {
+    const unsigned long window_start = addresses[i];
+    size_t j = i + 1;
+    while (j < count && addresses[j] - addresses[j - 1] <= GATHER_MAX_GAP &&
+           addresses[j] + width - window_start <= buf_size) {
+      j++;
+    }
+
+    const size_t window_len = addresses[j - 1] + width - window_start;
+    const size_t got = reader_read(reader, window_start, buf, window_len);
+
+    for (; i < j && addresses[i] - window_start + width <= got; i++) {
+      visit(addresses[i], buf + (addresses[i] - window_start), ctx);
+    }
+
+    // The read stopped at a hole: the next window starts after it
+    if (i < j && addresses[i] == window_start) {
+      visit(addresses[i], NULL, ctx);
+      i++;
+    }
+  }
+}
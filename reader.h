@@ -0,0 +1,69 @@
+#ifndef READER_H
+#define READER_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "stats.h"
+#include "tracee.h"
+
+#define READ_CHUNK_SIZE (1UL << 20) // 1MB
+#define PAGE_SIZE 4096UL
+
+typedef enum {
+  READER_VM,      // process_vm_readv, one syscall per chunk
+  READER_PROCMEM, // pread on /proc/<pid>/mem
+  READER_PTRACE,  // PTRACE_PEEKDATA, one syscall per word
+} ReaderBackend;
+
+typedef struct {
+  pid_t pid;
+  ReaderBackend backend;
+  int mem_fd;
+  Tracee *tracee; // Stopped around reads when it asks for it, may be NULL
+  Stats stats; // Reads and their time, the rest is left to callers
+} MemoryReader;
+
+// Called with every readable piece of a range, in address order
+typedef void (*ChunkVisitor)(unsigned long address, const unsigned char *buf,
+                             size_t len, void *ctx);
+
+// Called with the current bytes at one gathered address, NULL if unreadable
+typedef void (*GatherVisitor)(unsigned long address,
+                              const unsigned char *value, void *ctx);
+
+MemoryReader reader_create(pid_t pid);
+
+// Opens an independent reader on the same process with the same backend, for
+// use from another thread
+MemoryReader reader_clone(const MemoryReader *reader);
+
+void reader_destroy(MemoryReader *reader);
+
+const char *reader_backend_name(ReaderBackend backend);
+
+// Parses vm, procmem or ptrace
+bool reader_backend_parse(ReaderBackend *backend, const char *name);
+
+// Uses backend from now on instead of the first one that works. Returns
+// false when it can't be opened.
+bool reader_set_backend(MemoryReader *reader, ReaderBackend backend);
+
+// Returns how many bytes starting at address could be read, stopping at the
+// first unreadable page
+size_t reader_read(MemoryReader *reader, unsigned long address, void *buf,
+                   size_t len);
+
+// Reads [start, end) through buf in pieces of at most buf_size bytes,
+// skipping over unreadable pages
+void reader_visit(MemoryReader *reader, unsigned long start,
+                  unsigned long end, unsigned char *buf, size_t buf_size,
+                  ChunkVisitor visit, void *ctx);
+
+// Reads width bytes at each of count sorted addresses, fetching runs of
+// nearby addresses through buf with a single read
+void reader_gather(MemoryReader *reader, const unsigned long *addresses,
+                   size_t count, size_t width, unsigned char *buf,
+                   size_t buf_size, GatherVisitor visit, void *ctx);
+
+#endif
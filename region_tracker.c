@@ -0,0 +1,96 @@
+#include "region_tracker.h"
+#include <stdlib.h>
+
+RegionTracker region_tracker_create(void) {
+  RegionTracker tracker;
+  tracker.active = false;
+  tracker.known = pmregion_array_create(64);
+  tracker.pending = pmregion_array_create(16);
+
+  return tracker;
+}
+
+void region_tracker_destroy(RegionTracker *tracker) {
+  pmregion_array_destroy(&tracker->known);
+  pmregion_array_destroy(&tracker->pending);
+}
+
+// Appends the parts of a not covered by b to out, returning their size
+static size_t subtract(const PMRegionArray *a, const PMRegionArray *b,
+                       PMRegionArray *out) {
+  size_t bytes = 0;
+  size_t j = 0;
+
+  for (size_t i = 0; i < a->size; i++) {
+    unsigned long start = a->regions[i].start;
+    const unsigned long end = a->regions[i].end;
+
+    while (j < b->size && b->regions[j].end <= start) {
+      j++;
+    }
+
+    for (size_t k = j; k < b->size && b->regions[k].start < end; k++) {
+      if (b->regions[k].start > start) {
+        ProcessMemoryRegion range = a->regions[i];
+        range.start = start;
+        range.end = b->regions[k].start;
+        pmregion_array_insert(out, range);
+        bytes += range.end - range.start;
+      }
+      start = b->regions[k].end > start ? b->regions[k].end : start;
+    }
+
+    if (start < end) {
+      ProcessMemoryRegion range = a->regions[i];
+      range.start = start;
+      pmregion_array_insert(out, range);
+      bytes += end - start;
+    }
+  }
+
+  return bytes;
+}
+
+void region_tracker_reset(RegionTracker *tracker,
+                          const PMRegionArray *regions) {
+  pmregion_array_coalesce(regions, &tracker->known);
+  pmregion_array_clear(&tracker->pending);
+  tracker->active = true;
+}
+
+static int compare_start(const void *a, const void *b) {
+  const unsigned long x = ((const ProcessMemoryRegion *)a)->start;
+  const unsigned long y = ((const ProcessMemoryRegion *)b)->start;
+  return (x > y) - (x < y);
+}
+
+RegionChanges region_tracker_update(RegionTracker *tracker,
+                                    const PMRegionArray *regions) {
+  RegionChanges changes;
+  PMRegionArray current = pmregion_array_create(tracker->known.size + 1);
+  PMRegionArray gone = pmregion_array_create(16);
+  PMRegionArray pending = pmregion_array_create(tracker->pending.size + 1);
+
+  pmregion_array_coalesce(regions, &current);
+
+  changes.added = subtract(&current, &tracker->known, &tracker->pending);
+  changes.removed = subtract(&tracker->known, &current, &gone);
+
+  // Pending ranges unmapped since are no longer pending
+  qsort(tracker->pending.regions, tracker->pending.size,
+        sizeof(ProcessMemoryRegion), compare_start);
+  pmregion_array_coalesce(&tracker->pending, &pending);
+  pmregion_array_clear(&tracker->pending);
+  subtract(&pending, &gone, &tracker->pending);
+
+  pmregion_array_destroy(&tracker->known);
+  pmregion_array_destroy(&gone);
+  pmregion_array_destroy(&pending);
+  tracker->known = current;
+
+  return changes;
+}
+
+void region_tracker_catch_up(RegionTracker *tracker) {
+  pmregion_array_clear(&tracker->pending);
+}
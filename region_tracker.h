@@ -0,0 +1,37 @@
+#ifndef REGION_TRACKER_H
+#define REGION_TRACKER_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "regions.h"
+
+// Follows the selected regions of the target from one command to the next.
+// Ranges are coalesced, so regions being split or merged by the kernel
+// don't show up as changes, only bytes being mapped or unmapped do.
+typedef struct {
+  bool active;           // A scan has set the baseline
+  PMRegionArray known;   // Every range currently selected
+  PMRegionArray pending; // Part of known mapped since the scan, not scanned
+} RegionTracker;
+
+// Bytes that appeared and disappeared since the last update
+typedef struct {
+  size_t added;
+  size_t removed;
+} RegionChanges;
+
+RegionTracker region_tracker_create(void);
+
+void region_tracker_destroy(RegionTracker *tracker);
+
+// Makes regions the scanned baseline, with nothing pending
+void region_tracker_reset(RegionTracker *tracker, const PMRegionArray *regions);
+
+// Diffs regions against the known ranges. New ranges become pending.
+RegionChanges region_tracker_update(RegionTracker *tracker,
+                                    const PMRegionArray *regions);
+
+// Marks the pending ranges as scanned
+void region_tracker_catch_up(RegionTracker *tracker);
+
+#endif
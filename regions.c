@@ -0,0 +1,525 @@
+#include "regions.h"
+#include "globals.h"
+#include "reader.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAPS_INITIAL_SIZE (64 * 1024)
+
+PMRegionArray pmregion_array_create(const size_t capacity) {
+  PMRegionArray pmregion_array;
+
+  pmregion_array.capacity = capacity > 0 ? capacity : 1;
+  pmregion_array.size = 0;
+
+  pmregion_array.regions =
+      calloc(pmregion_array.capacity, sizeof(ProcessMemoryRegion));
+
+  if (pmregion_array.regions == NULL) {
+    exit_error("Error allocating memory regions");
+  }
+
+  return pmregion_array;
+}
+
+void pmregion_array_insert(PMRegionArray *array,
+                           const ProcessMemoryRegion region) {
+  if (array->size >= array->capacity) {
+    array->capacity *= GROWTH_FACTOR;
+    ProcessMemoryRegion *regions =
+        realloc(array->regions, array->capacity * sizeof(ProcessMemoryRegion));
+
+    if (regions == NULL) {
+      exit_error("Error allocating memory regions");
+    }
+
+    array->regions = regions;
+  }
+
+  array->regions[array->size] = region;
+  array->size++;
+}
+
+void pmregion_array_clear(PMRegionArray *array) { array->size = 0; }
+
+void pmregion_array_coalesce(const PMRegionArray *regions,
+                             PMRegionArray *out) {
+  pmregion_array_clear(out);
+
+  for (size_t i = 0; i < regions->size; i++) {
+    const ProcessMemoryRegion *region = &regions->regions[i];
+
+    if (out->size > 0 && out->regions[out->size - 1].end >= region->start) {
+      ProcessMemoryRegion *last = &out->regions[out->size - 1];
+      last->end = region->end > last->end ? region->end : last->end;
+    } else {
+      ProcessMemoryRegion range = *region;
+      range.path = "";
+      pmregion_array_insert(out, range);
+    }
+  }
+}
+
+void pmregion_array_destroy(const PMRegionArray *pmregion_array) {
+  free(pmregion_array->regions);
+}
+
+RegionMap region_map_create(const pid_t pid) {
+  RegionMap map;
+  map.pid = pid;
+  map.size = 0;
+  map.capacity = MAPS_INITIAL_SIZE;
+  map.buf = malloc(map.capacity);
+  map.regions = pmregion_array_create(256);
+
+  if (map.buf == NULL) {
+    exit_error("Error allocating maps buffer");
+  }
+
+  char maps_path[64];
+  snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", pid);
+
+  map.fd = open(maps_path, O_RDONLY);
+  if (map.fd == -1) {
+    exit_error("Error opening process maps");
+  }
+
+  return map;
+}
+
+void region_map_destroy(RegionMap *map) {
+  close(map->fd);
+  free(map->buf);
+  pmregion_array_destroy(&map->regions);
+  map->fd = -1;
+  map->buf = NULL;
+}
+
+// Reads the whole file into buf, growing it as needed. The kernel hands out
+// at most a page per read, so asking for the whole buffer at once still
+// takes a few calls, but never one per byte.
+static void read_maps(RegionMap *map) {
+  if (lseek(map->fd, 0, SEEK_SET) == -1) {
+    exit_error("Error rewinding process maps");
+  }
+
+  map->size = 0;
+
+  while (true) {
+    // Keep a byte for the terminator
+    if (map->capacity - map->size <= 1) {
+      map->capacity *= GROWTH_FACTOR;
+      char *buf = realloc(map->buf, map->capacity);
+
+      if (buf == NULL) {
+        exit_error("Error allocating maps buffer");
+      }
+
+      map->buf = buf;
+    }
+
+    const ssize_t bytes_read =
+        read(map->fd, map->buf + map->size, map->capacity - map->size - 1);
+
+    if (bytes_read == -1) {
+      exit_error("Error reading process maps");
+    }
+
+    if (bytes_read == 0) {
+      break;
+    }
+
+    map->size += bytes_read;
+  }
+
+  map->buf[map->size] = '\0';
+}
+
+static unsigned long parse_hex(char **cursor) {
+  unsigned long value = 0;
+  char *c = *cursor;
+
+  while (true) {
+    if (*c >= '0' && *c <= '9') {
+      value = value * 16 + (*c - '0');
+    } else if (*c >= 'a' && *c <= 'f') {
+      value = value * 16 + (*c - 'a' + 10);
+    } else {
+      break;
+    }
+    c++;
+  }
+
+  *cursor = c;
+  return value;
+}
+
+static unsigned long parse_dec(char **cursor) {
+  unsigned long value = 0;
+  char *c = *cursor;
+
+  while (*c >= '0' && *c <= '9') {
+    value = value * 10 + (*c - '0');
+    c++;
+  }
+
+  *cursor = c;
+  return value;
+}
+
+static char *skip_field(char *c) {
+  while (*c != ' ' && *c != '\0') {
+    c++;
+  }
+  while (*c == ' ') {
+    c++;
+  }
+  return c;
+}
+
+static MemoryPermission parse_permissions(const char *perm_str) {
+  const MemoryPermission permissions = {
+      .read = perm_str[0] == 'r',
+      .write = perm_str[1] == 'w',
+      .execute = perm_str[2] == 'x',
+      .private = perm_str[3] == 'p',
+      .shared = perm_str[3] == 's',
+  };
+
+  return permissions;
+}
+
+static RegionKind parse_kind(const char *path) {
+  if (path[0] == '\0' || strncmp(path, "[anon", 5) == 0) {
+    return REGION_ANON;
+  }
+  if (strcmp(path, "[heap]") == 0) {
+    return REGION_HEAP;
+  }
+  if (strncmp(path, "[stack", 6) == 0) {
+    return REGION_STACK;
+  }
+  if (path[0] == '[') {
+    return REGION_VDSO;
+  }
+
+  return REGION_FILE;
+}
+
+// Lines look like
+// 7f1c2a000000-7f1c2a021000 rw-p 00000000 00:00 0          [heap]
+// Every field is parsed where it lies, the path is cut off at the newline.
+void region_map_read(RegionMap *map) {
+  read_maps(map);
+  pmregion_array_clear(&map->regions);
+
+  char *line = map->buf;
+  char *buf_end = map->buf + map->size;
+
+  while (line < buf_end) {
+    char *line_end = memchr(line, '\n', buf_end - line);
+    if (line_end == NULL) {
+      line_end = buf_end;
+    }
+    *line_end = '\0';
+
+    ProcessMemoryRegion region;
+    char *c = line;
+
+    region.start = parse_hex(&c);
+    c++; // '-'
+    region.end = parse_hex(&c);
+    c = skip_field(c);
+
+    region.permission = parse_permissions(c);
+    c = skip_field(c);
+
+    region.offset = parse_hex(&c);
+    c = skip_field(skip_field(c)); // device
+
+    region.inode = parse_dec(&c);
+    while (*c == ' ') {
+      c++;
+    }
+
+    region.path = c;
+    region.kind = parse_kind(c);
+
+    pmregion_array_insert(&map->regions, region);
+    line = line_end + 1;
+  }
+}
+
+RegionFilter region_filter_default(void) {
+  RegionFilter filter;
+  filter.kinds = ~0U;
+  filter.exclude_lib = false;
+  filter.module[0] = '\0';
+  filter.min_size = 0;
+  filter.max_size = 0;
+  filter.range_start = 0;
+  filter.range_end = 0;
+
+  return filter;
+}
+
+bool region_filter_equal(const RegionFilter *a, const RegionFilter *b) {
+  return a->kinds == b->kinds && a->exclude_lib == b->exclude_lib &&
+         strcmp(a->module, b->module) == 0 && a->min_size == b->min_size &&
+         a->max_size == b->max_size && a->range_start == b->range_start &&
+         a->range_end == b->range_end;
+}
+
+static const char *path_basename(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash != NULL ? slash + 1 : path;
+}
+
+static bool is_library(const ProcessMemoryRegion *region) {
+  return region->kind == REGION_FILE &&
+         strstr(path_basename(region->path), ".so") != NULL;
+}
+
+static bool is_module(const ProcessMemoryRegion *region, const char *module) {
+  return region->kind == REGION_FILE &&
+         strstr(path_basename(region->path), module) != NULL;
+}
+
+void region_map_select(const RegionMap *map, const RegionFilter *filter,
+                       PMRegionArray *out) {
+  // A module's .bss is the anonymous mapping right after its file mappings
+  unsigned long module_end = 0;
+
+  pmregion_array_clear(out);
+
+  for (size_t i = 0; i < map->regions.size; i++) {
+    const ProcessMemoryRegion *region = &map->regions.regions[i];
+    const unsigned long size = region->end - region->start;
+    bool keep = region->permission.write &&
+                (filter->kinds & (1U << region->kind)) != 0;
+
+    if (filter->module[0] != '\0') {
+      const bool in_module =
+          is_module(region, filter->module) ||
+          (region->kind == REGION_ANON && region->start == module_end);
+      module_end = in_module ? region->end : module_end;
+      keep = keep && in_module;
+    }
+
+    if (filter->exclude_lib && is_library(region)) {
+      keep = false;
+    }
+    if (size < filter->min_size ||
+        (filter->max_size != 0 && size > filter->max_size)) {
+      keep = false;
+    }
+    if (filter->range_end != 0 && (region->end <= filter->range_start ||
+                                   region->start >= filter->range_end)) {
+      keep = false;
+    }
+
+    if (keep) {
+      ProcessMemoryRegion clipped = *region;
+
+      // Only the part inside the range is scanned
+      if (filter->range_end != 0) {
+        clipped.start = clipped.start > filter->range_start
+                            ? clipped.start
+                            : filter->range_start;
+        clipped.end =
+            clipped.end < filter->range_end ? clipped.end : filter->range_end;
+      }
+
+      pmregion_array_insert(out, clipped);
+    }
+  }
+}
+
+static bool parse_kinds(unsigned int *kinds, const char *list) {
+  char kind_str[64];
+  *kinds = 0;
+
+  while (*list != '\0') {
+    const size_t len = strcspn(list, ",");
+    if (len == 0 || len >= sizeof(kind_str)) {
+      return false;
+    }
+
+    memcpy(kind_str, list, len);
+    kind_str[len] = '\0';
+
+    if (strcmp(kind_str, "all") == 0) {
+      *kinds = ~0U;
+    } else {
+      RegionKind kind = REGION_ANON;
+      while (kind <= REGION_VDSO &&
+             strcmp(kind_str, region_kind_name(kind)) != 0) {
+        kind++;
+      }
+
+      if (kind > REGION_VDSO) {
+        return false;
+      }
+      *kinds |= 1U << kind;
+    }
+
+    list += len;
+    list += *list == ',';
+  }
+
+  return true;
+}
+
+// Sizes take an optional K, M or G suffix
+static unsigned long parse_size(const char *size_str) {
+  char *end;
+  unsigned long size = strtoul(size_str, &end, 0);
+
+  switch (*end) {
+  case 'G':
+  case 'g':
+    size <<= 10;
+    // fall through
+  case 'M':
+  case 'm':
+    size <<= 10;
+    // fall through
+  case 'K':
+  case 'k':
+    size <<= 10;
+    break;
+  default:
+    break;
+  }
+
+  return size;
+}
+
+bool region_filter_parse(RegionFilter *filter, const char *first) {
+  *filter = region_filter_default();
+
+  const char *arg = first;
+  if (arg != NULL && strncmp(arg, "--", 2) != 0) {
+    if (!parse_kinds(&filter->kinds, arg)) {
+      return false;
+    }
+    arg = strtok(NULL, " ");
+  }
+
+  for (; arg != NULL; arg = strtok(NULL, " ")) {
+    if (strcmp(arg, "--exclude-lib") == 0) {
+      filter->exclude_lib = true;
+      continue;
+    }
+
+    const char *value = strtok(NULL, " ");
+    if (value == NULL) {
+      return false;
+    }
+
+    if (strcmp(arg, "--only-module") == 0) {
+      snprintf(filter->module, sizeof(filter->module), "%s", value);
+    } else if (strcmp(arg, "--min-size") == 0) {
+      filter->min_size = parse_size(value);
+    } else if (strcmp(arg, "--max-size") == 0) {
+      filter->max_size = parse_size(value);
+    } else if (strcmp(arg, "--range") == 0) {
+      char *end;
+      filter->range_start = strtoul(value, &end, 16);
+      if (*end != '-') {
+        return false;
+      }
+      filter->range_end = strtoul(end + 1, NULL, 16);
+
+      // Scans assume regions start on a page, so the range is shrunk to
+      // the whole pages inside it
+      filter->range_start =
+          (filter->range_start + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+      filter->range_end = filter->range_end / PAGE_SIZE * PAGE_SIZE;
+      if (filter->range_end <= filter->range_start) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void print_region_filter(const RegionFilter *filter) {
+  printf("Kinds:");
+  for (RegionKind kind = REGION_ANON; kind <= REGION_VDSO; kind++) {
+    if (filter->kinds & (1U << kind)) {
+      printf(" %s", region_kind_name(kind));
+    }
+  }
+  printf("\n");
+
+  if (filter->exclude_lib) {
+    printf("Excluding shared libraries\n");
+  }
+  if (filter->module[0] != '\0') {
+    printf("Only module: %s\n", filter->module);
+  }
+  if (filter->min_size != 0) {
+    printf("At least %lu bytes\n", filter->min_size);
+  }
+  if (filter->max_size != 0) {
+    printf("At most %lu bytes\n", filter->max_size);
+  }
+  if (filter->range_end != 0) {
+    printf("Range: [0x%lx - 0x%lx]\n", filter->range_start,
+           filter->range_end);
+  }
+}
+
+size_t pmregion_array_bytes(const PMRegionArray *array) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < array->size; i++) {
+    bytes += array->regions[i].end - array->regions[i].start;
+  }
+  return bytes;
+}
+
+const char *region_kind_name(const RegionKind kind) {
+  switch (kind) {
+  case REGION_ANON:
+    return "anon";
+  case REGION_HEAP:
+    return "heap";
+  case REGION_STACK:
+    return "stack";
+  case REGION_FILE:
+    return "file";
+  case REGION_VDSO:
+    return "vdso";
+  default:
+    return "unknown";
+  }
+}
+
+void print_memory_region(const ProcessMemoryRegion region) {
+  // Print the memory region start and end addresses
+  printf("Range: [0x%lx - 0x%lx]\tPermissions: [", region.start, region.end);
+
+  // Print the permissions
+  printf("%c", region.permission.read ? 'r' : '-');    // Read permission
+  printf("%c", region.permission.write ? 'w' : '-');   // Write permission
+  printf("%c", region.permission.execute ? 'x' : '-'); // Execute permission
+  printf("%c", region.permission.shared
+                   ? 's'
+                   : 'p'); // Shared/Private (s = shared, p = private)
+
+  printf("]\t%s %s\n", region_kind_name(region.kind), region.path);
+}
+
+void print_memory_regions(const PMRegionArray *pmregion_array) {
+  printf("Found regions: %ld\n", pmregion_array->size);
+  for (size_t i = 0; i < pmregion_array->size; i++) {
+    print_memory_region(pmregion_array->regions[i]);
+  }
+}
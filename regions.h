@@ -0,0 +1,110 @@
+#ifndef REGIONS_H
+#define REGIONS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct {
+  bool read;
+  bool write;
+  bool execute;
+  bool private;
+  bool shared;
+} MemoryPermission;
+
+typedef enum {
+  REGION_ANON,  // No backing file
+  REGION_HEAP,  // [heap]
+  REGION_STACK, // [stack]
+  REGION_FILE,  // Mapped from a file
+  REGION_VDSO,  // [vdso], [vvar], [vsyscall] and other kernel mappings
+} RegionKind;
+
+// path points into the RegionMap it was parsed from and is only valid until
+// that map is read again. It is empty for anonymous mappings.
+typedef struct {
+  unsigned long start;
+  unsigned long end;
+  MemoryPermission permission;
+  unsigned long offset;
+  unsigned long inode;
+  RegionKind kind;
+  const char *path;
+} ProcessMemoryRegion;
+
+typedef struct {
+  size_t size;
+  size_t capacity;
+  ProcessMemoryRegion *regions;
+} PMRegionArray;
+
+// Every mapping of a process, parsed in place from /proc/<pid>/maps. The file
+// stays open so that reading it again costs a seek and a few large reads.
+typedef struct {
+  pid_t pid;
+  int fd;
+  size_t size;
+  size_t capacity;
+  char *buf;
+  PMRegionArray regions;
+} RegionMap;
+
+// Which writable regions get scanned. Zero sizes and an empty range mean no
+// limit, an empty module means any.
+typedef struct {
+  unsigned int kinds; // Bit per RegionKind
+  bool exclude_lib;
+  char module[256];
+  unsigned long min_size;
+  unsigned long max_size;
+  unsigned long range_start;
+  unsigned long range_end;
+} RegionFilter;
+
+PMRegionArray pmregion_array_create(size_t capacity);
+
+void pmregion_array_insert(PMRegionArray *array, ProcessMemoryRegion region);
+
+void pmregion_array_clear(PMRegionArray *array);
+
+// Sorted, disjoint and non-adjacent ranges covering regions, which must be
+// sorted by start
+void pmregion_array_coalesce(const PMRegionArray *regions, PMRegionArray *out);
+
+void pmregion_array_destroy(const PMRegionArray *pmregion_array);
+
+RegionMap region_map_create(pid_t pid);
+
+// Reads and parses the maps again, reusing the map's buffers
+void region_map_read(RegionMap *map);
+
+void region_map_destroy(RegionMap *map);
+
+// Copies the writable regions of map that pass filter into out, replacing
+// its contents
+void region_map_select(const RegionMap *map, const RegionFilter *filter,
+                       PMRegionArray *out);
+
+// Every writable region
+RegionFilter region_filter_default(void);
+
+bool region_filter_equal(const RegionFilter *a, const RegionFilter *b);
+
+// Parses the arguments of the regions command from strtok, starting with
+// first: an optional kind list such as heap,anon,stack followed by
+// --exclude-lib, --only-module <name>, --min-size <n>, --max-size <n> and
+// --range <start>-<end>, shrunk to whole pages. Returns false on a bad
+// argument or a range holding no whole page.
+bool region_filter_parse(RegionFilter *filter, const char *first);
+
+void print_region_filter(const RegionFilter *filter);
+
+size_t pmregion_array_bytes(const PMRegionArray *array);
+
+const char *region_kind_name(RegionKind kind);
+
+void print_memory_region(ProcessMemoryRegion region);
+
+void print_memory_regions(const PMRegionArray *pmregion_array);
+
+#endif
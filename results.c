@@ -0,0 +1,83 @@
+#include "results.h"
+#include "globals.h"
+#include <stdio.h>
+
+ScanResults scan_results_create(void) {
+  ScanResults results;
+  results.size = 0;
+
+  return results;
+}
+
+void scan_results_clear(ScanResults *results) {
+  for (size_t i = 0; i < results->size; i++) {
+    candidates_destroy(&results->sets[i]);
+  }
+
+  results->size = 0;
+}
+
+void scan_results_add(ScanResults *results, const ValueType type,
+                      const CandidateSet set) {
+  if (results->size == RESULTS_MAX) {
+    exit_error("Too many result sets");
+  }
+
+  results->types[results->size] = type;
+  results->sets[results->size] = set;
+  results->size++;
+}
+
+size_t scan_results_count(const ScanResults *results) {
+  size_t count = 0;
+  for (size_t i = 0; i < results->size; i++) {
+    count += results->sets[i].count;
+  }
+
+  return count;
+}
+
+size_t scan_results_memory(const ScanResults *results) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < results->size; i++) {
+    bytes += candidates_memory(&results->sets[i]);
+  }
+
+  return bytes;
+}
+
+void scan_results_merge(ScanResults *results, ScanResults *found) {
+  if (results->size == 0) {
+    *results = *found;
+    found->size = 0;
+    return;
+  }
+
+  // The same scan adds its sets in the same order
+  for (size_t i = 0; i < found->size; i++) {
+    candidates_merge(&results->sets[i], &found->sets[i]);
+  }
+
+  found->size = 0;
+}
+
+void print_scan_results(const ScanResults *results) {
+  if (results->size == 0) {
+    printf("0 candidates\n");
+    return;
+  }
+
+  for (size_t i = 0; i < results->size; i++) {
+    const CandidateSet *set = &results->sets[i];
+
+    if (results->size > 1) {
+      printf("%s: ", value_type_name(results->types[i]));
+    }
+    printf("%zu candidates in %zu blocks, %zu bytes\n", set->count, set->size,
+           candidates_memory(set));
+  }
+
+  if (results->size > 1) {
+    printf("%zu candidates in total\n", scan_results_count(results));
+  }
+}
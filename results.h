@@ -0,0 +1,37 @@
+#ifndef RESULTS_H
+#define RESULTS_H
+#include <stddef.h>
+
+#include "candidates.h"
+#include "value_type.h"
+
+#define RESULTS_MAX (DOUBLE64 + 1)
+
+// The candidate sets of the last new, one per type it looked for
+typedef struct {
+  size_t size;
+  ValueType types[RESULTS_MAX];
+  CandidateSet sets[RESULTS_MAX];
+} ScanResults;
+
+ScanResults scan_results_create(void);
+
+// Destroys every set
+void scan_results_clear(ScanResults *results);
+
+// Takes ownership of set
+void scan_results_add(ScanResults *results, ValueType type,
+                      CandidateSet set);
+
+size_t scan_results_count(const ScanResults *results);
+
+// Heap bytes held by every set
+size_t scan_results_memory(const ScanResults *results);
+
+// Merges the sets of found into those of results, which must come from the
+// same scan over other regions, and empties found
+void scan_results_merge(ScanResults *results, ScanResults *found);
+
+void print_scan_results(const ScanResults *results);
+
+#endif
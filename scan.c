@@ -0,0 +1,445 @@
+#include "scan.h"
+#include "globals.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+  unsigned long start;
+  unsigned long end;
+  unsigned long region_end;
+  size_t source;
+} ScanChunk;
+
+// A worker owns the chunk indices [head, tail). The owner takes from the
+// head, thieves split off the back half.
+typedef struct {
+  pthread_mutex_t lock;
+  size_t head;
+  size_t tail;
+} ChunkDeque;
+
+// Where a chunk's blocks ended up: a slice of one worker's block list
+typedef struct {
+  size_t worker;
+  size_t begin;
+  size_t count;
+} ChunkBlocks;
+
+typedef struct {
+  ScanChunk *chunks;
+  size_t chunk_count;
+  ChunkBlocks *chunk_blocks; // out_count entries per chunk
+  const ScanSource *sources;
+  size_t source_count;
+  size_t out_count;
+  ChunkDeque *deques;
+  size_t worker_count;
+  size_t overlap;
+  ScanVisitor visit;
+  void *ctx;
+} ScanJob;
+
+// Workers other than the first read through readers of their own, one per
+// source
+typedef struct {
+  size_t id;
+  ScanJob *job;
+  MemoryReader **readers;
+  MemoryReader *own_readers;
+  unsigned char *buf;
+  ScanOutput *outs;
+} ScanWorker;
+
+typedef struct {
+  ScanVisitor visit;
+  void *ctx;
+  ScanOutput *out;
+  unsigned long chunk_end;
+} VisitAdapter;
+
+ScanEngine scan_engine_create(MemoryReader *reader, const size_t threads) {
+  ScanEngine engine;
+  engine.reader = reader;
+  engine.threads = threads > 0 ? threads : 1;
+
+  return engine;
+}
+
+static bool deque_pop(ChunkDeque *deque, size_t *index) {
+  bool found = false;
+
+  pthread_mutex_lock(&deque->lock);
+  if (deque->head < deque->tail) {
+    *index = deque->head++;
+    found = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+
+  return found;
+}
+
+// Moves the back half of the fullest other deque into the worker's own
+static bool deque_steal(ScanJob *job, const size_t thief) {
+  while (true) {
+    size_t victim = thief;
+    size_t most = 0;
+
+    for (size_t i = 0; i < job->worker_count; i++) {
+      // Unlocked peek, only used to pick a victim
+      const size_t head = job->deques[i].head;
+      const size_t tail = job->deques[i].tail;
+      const size_t remaining = tail > head ? tail - head : 0;
+
+      if (i != thief && remaining > most) {
+        most = remaining;
+        victim = i;
+      }
+    }
+
+    if (victim == thief) {
+      return false;
+    }
+
+    ChunkDeque *from = &job->deques[victim];
+    size_t head = 0;
+    size_t tail = 0;
+
+    pthread_mutex_lock(&from->lock);
+    if (from->head < from->tail) {
+      tail = from->tail;
+      head = from->head + (from->tail - from->head) / 2;
+      from->tail = head;
+    }
+    pthread_mutex_unlock(&from->lock);
+
+    if (head == tail) {
+      continue;
+    }
+
+    ChunkDeque *to = &job->deques[thief];
+    pthread_mutex_lock(&to->lock);
+    to->head = head;
+    to->tail = tail;
+    pthread_mutex_unlock(&to->lock);
+
+    return true;
+  }
+}
+
+static void visit_adapter(const unsigned long address,
+                          const unsigned char *buf, const size_t len,
+                          void *ctx) {
+  const VisitAdapter *adapter = ctx;
+
+  // Everything past chunk_end is overlap owned by the next chunk
+  if (address >= adapter->chunk_end) {
+    return;
+  }
+
+  const ScanPiece piece = {
+      .address = address,
+      .buf = buf,
+      .len = address + len > adapter->chunk_end ? adapter->chunk_end - address
+                                                : len,
+      .avail = len,
+  };
+
+  adapter->visit(&piece, adapter->ctx, adapter->out);
+}
+
+static void *scan_worker_run(void *arg) {
+  ScanWorker *worker = arg;
+  ScanJob *job = worker->job;
+  VisitAdapter adapter = {
+      .visit = job->visit,
+      .ctx = job->ctx,
+      .out = worker->outs,
+  };
+
+  while (true) {
+    size_t index;
+
+    if (!deque_pop(&job->deques[worker->id], &index)) {
+      if (!deque_steal(job, worker->id)) {
+        break;
+      }
+      continue;
+    }
+
+    const ScanChunk chunk = job->chunks[index];
+    const CandidateSet *outs = job->sources[chunk.source].outs;
+    MemoryReader *reader = worker->readers[chunk.source];
+    ChunkBlocks *chunk_blocks = &job->chunk_blocks[index * job->out_count];
+    const unsigned long end = chunk.region_end - chunk.end > job->overlap
+                                  ? chunk.end + job->overlap
+                                  : chunk.region_end;
+
+    for (size_t i = 0; i < job->out_count; i++) {
+      chunk_blocks[i].worker = worker->id;
+      chunk_blocks[i].begin = worker->outs[i].blocks.size;
+    }
+
+    // Whatever the chunk costs beyond its reads goes to comparing
+    Stats *stats = &reader->stats;
+    const unsigned long start = stats_now_ns();
+    const unsigned long read_ns = stats->read_ns;
+
+    adapter.chunk_end = chunk.end;
+    reader_visit(reader, chunk.start, end, worker->buf,
+                 SCAN_CHUNK_SIZE + job->overlap, visit_adapter, &adapter);
+
+    for (size_t i = 0; i < job->out_count; i++) {
+      ScanOutput *out = &worker->outs[i];
+
+      // Encode right away so a worker never holds more than a chunk of hits
+      if (out->hits.size > 0) {
+        candidates_push(&out->blocks,
+                        candidate_block_encode(outs[i].stride,
+                                               outs[i].width, chunk.start,
+                                               chunk.end - chunk.start,
+                                               out->hits.items, NULL,
+                                               out->hits.size));
+        ulong_array_clear(&out->hits);
+      }
+
+      chunk_blocks[i].count = out->blocks.size - chunk_blocks[i].begin;
+    }
+
+    stats->compare_ns += stats_now_ns() - start - (stats->read_ns - read_ns);
+  }
+
+  return NULL;
+}
+
+// The part of a region inside the source's window, false if none is
+static bool window_clip(const ScanSource *source,
+                        const ProcessMemoryRegion *region,
+                        unsigned long *start, unsigned long *end) {
+  *start = region->start;
+  *end = region->end;
+
+  if (source->window_end != 0) {
+    *start = *start > source->window_start ? *start : source->window_start;
+    *end = *end < source->window_end ? *end : source->window_end;
+  }
+
+  return *start < *end;
+}
+
+static ScanChunk *split_regions(const ScanSource *sources,
+                                const size_t source_count, size_t *count) {
+  size_t chunk_count = 0;
+  for (size_t s = 0; s < source_count; s++) {
+    const PMRegionArray *regions = sources[s].regions;
+
+    for (size_t i = 0; i < regions->size; i++) {
+      unsigned long start;
+      unsigned long end;
+
+      if (window_clip(&sources[s], &regions->regions[i], &start, &end)) {
+        chunk_count += (end - start + SCAN_CHUNK_SIZE - 1) / SCAN_CHUNK_SIZE;
+      }
+    }
+  }
+
+  ScanChunk *chunks = malloc((chunk_count + 1) * sizeof(ScanChunk));
+  if (chunks == NULL) {
+    exit_error("Error allocating scan chunks");
+  }
+
+  // Sources follow each other, so each one's chunks stay in address order
+  size_t n = 0;
+  for (size_t s = 0; s < source_count; s++) {
+    const PMRegionArray *regions = sources[s].regions;
+
+    for (size_t i = 0; i < regions->size; i++) {
+      unsigned long start;
+      unsigned long end;
+
+      if (!window_clip(&sources[s], &regions->regions[i], &start, &end)) {
+        continue;
+      }
+
+      while (start < end) {
+        chunks[n].start = start;
+        chunks[n].end = end - start > SCAN_CHUNK_SIZE ? start + SCAN_CHUNK_SIZE
+                                                      : end;
+        chunks[n].region_end = regions->regions[i].end;
+        chunks[n].source = s;
+        start = chunks[n].end;
+        n++;
+      }
+    }
+  }
+
+  *count = n;
+  return chunks;
+}
+
+void scan_regions(ScanEngine *engine, const PMRegionArray *regions,
+                  const size_t overlap, const ScanVisitor visit, void *ctx,
+                  CandidateSet *out) {
+  scan_regions_multi(engine, regions, overlap, visit, ctx, out, 1);
+}
+
+void scan_regions_multi(ScanEngine *engine, const PMRegionArray *regions,
+                        const size_t overlap, const ScanVisitor visit,
+                        void *ctx, CandidateSet *outs, const size_t count) {
+  const ScanSource source = {
+      .reader = engine->reader,
+      .regions = regions,
+      .outs = outs,
+  };
+
+  scan_sources(engine, &source, 1, overlap, visit, ctx, count);
+}
+
+void scan_sources(ScanEngine *engine, const ScanSource *sources,
+                  const size_t source_count, const size_t overlap,
+                  const ScanVisitor visit, void *ctx, const size_t count) {
+  ScanJob job;
+  job.chunks = split_regions(sources, source_count, &job.chunk_count);
+  job.sources = sources;
+  job.source_count = source_count;
+  job.out_count = count;
+  job.overlap = overlap;
+  job.visit = visit;
+  job.ctx = ctx;
+
+  if (job.chunk_count == 0) {
+    free(job.chunks);
+    return;
+  }
+
+  size_t worker_count = engine->threads;
+  for (size_t s = 0, i = 0; s < source_count; s++) {
+    const MemoryReader *reader = sources[s].reader;
+
+    // Settle each backend first: ptrace only works from the tracing thread
+    while (i < job.chunk_count && job.chunks[i].source < s) {
+      i++;
+    }
+    if (i < job.chunk_count && job.chunks[i].source == s) {
+      unsigned char probe;
+      reader_read(sources[s].reader, job.chunks[i].start, &probe,
+                  sizeof(probe));
+    }
+
+    // So do the stops around each chunk when pausing per chunk
+    if (reader->backend == READER_PTRACE ||
+        (reader->tracee != NULL && reader->tracee->mode == PAUSE_CHUNK)) {
+      worker_count = 1;
+    }
+  }
+  if (worker_count > job.chunk_count) {
+    worker_count = job.chunk_count;
+  }
+
+  job.worker_count = worker_count;
+  job.chunk_blocks = calloc(job.chunk_count * count, sizeof(ChunkBlocks));
+  job.deques = calloc(worker_count, sizeof(ChunkDeque));
+  ScanWorker *workers = calloc(worker_count, sizeof(ScanWorker));
+  pthread_t *threads = calloc(worker_count, sizeof(pthread_t));
+
+  if (job.chunk_blocks == NULL || job.deques == NULL || workers == NULL ||
+      threads == NULL) {
+    exit_error("Error allocating scan workers");
+  }
+
+  // Equal shares of chunks to start with, stealing evens out the rest
+  for (size_t i = 0; i < worker_count; i++) {
+    pthread_mutex_init(&job.deques[i].lock, NULL);
+    job.deques[i].head = job.chunk_count * i / worker_count;
+    job.deques[i].tail = job.chunk_count * (i + 1) / worker_count;
+
+    workers[i].id = i;
+    workers[i].job = &job;
+    workers[i].outs = calloc(count, sizeof(ScanOutput));
+    workers[i].buf = malloc(SCAN_CHUNK_SIZE + overlap);
+    workers[i].readers = calloc(source_count, sizeof(MemoryReader *));
+
+    if (workers[i].outs == NULL || workers[i].buf == NULL ||
+        workers[i].readers == NULL) {
+      exit_error("Error allocating scan buffer");
+    }
+
+    // Every source makes sets of the same width and stride for output n
+    for (size_t n = 0; n < count; n++) {
+      workers[i].outs[n].hits = ulong_array_create(1024);
+      workers[i].outs[n].blocks = candidates_create(sources[0].outs[n].width,
+                                                    sources[0].outs[n].stride);
+    }
+
+    if (i == 0) {
+      for (size_t s = 0; s < source_count; s++) {
+        workers[i].readers[s] = sources[s].reader;
+      }
+      continue;
+    }
+
+    workers[i].own_readers = calloc(source_count, sizeof(MemoryReader));
+    if (workers[i].own_readers == NULL) {
+      exit_error("Error allocating scan readers");
+    }
+
+    for (size_t s = 0; s < source_count; s++) {
+      workers[i].own_readers[s] = reader_clone(sources[s].reader);
+      workers[i].readers[s] = &workers[i].own_readers[s];
+    }
+  }
+
+  for (size_t i = 1; i < worker_count; i++) {
+    if (pthread_create(&threads[i], NULL, scan_worker_run, &workers[i]) != 0) {
+      exit_error("Error creating scan thread");
+    }
+  }
+
+  scan_worker_run(&workers[0]);
+
+  for (size_t i = 1; i < worker_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // Chunks are numbered in address order within each source, so pushing
+  // their blocks in order merges what the workers found. The blocks change
+  // owner.
+  for (size_t i = 0; i < job.chunk_count * count; i++) {
+    const ChunkBlocks *chunk_blocks = &job.chunk_blocks[i];
+    const CandidateSet *blocks =
+        &workers[chunk_blocks->worker].outs[i % count].blocks;
+    CandidateSet *outs = sources[job.chunks[i / count].source].outs;
+
+    for (size_t n = 0; n < chunk_blocks->count; n++) {
+      candidates_push(&outs[i % count],
+                      blocks->blocks[chunk_blocks->begin + n]);
+    }
+  }
+
+  for (size_t i = 0; i < worker_count; i++) {
+    pthread_mutex_destroy(&job.deques[i].lock);
+    for (size_t n = 0; n < count; n++) {
+      ulong_array_destroy(&workers[i].outs[n].hits);
+      workers[i].outs[n].blocks.size = 0;
+      candidates_destroy(&workers[i].outs[n].blocks);
+    }
+    free(workers[i].outs);
+    free(workers[i].buf);
+    free(workers[i].readers);
+
+    if (i != 0) {
+      for (size_t s = 0; s < source_count; s++) {
+        stats_add(&sources[s].reader->stats, &workers[i].own_readers[s].stats);
+        reader_destroy(&workers[i].own_readers[s]);
+      }
+      free(workers[i].own_readers);
+    }
+  }
+
+  free(threads);
+  free(workers);
+  free(job.deques);
+  free(job.chunk_blocks);
+  free(job.chunks);
+}
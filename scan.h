@@ -0,0 +1,73 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <stddef.h>
+
+#include "candidates.h"
+#include "reader.h"
+#include "regions.h"
+#include "ulong_array.h"
+
+#define SCAN_CHUNK_SIZE READ_CHUNK_SIZE
+
+// A readable piece of a chunk. Hits must start before address + len, but
+// buf holds avail >= len bytes so values may run into the next chunk.
+typedef struct {
+  unsigned long address;
+  const unsigned char *buf;
+  size_t len;
+  size_t avail;
+} ScanPiece;
+
+// What a worker collects for the chunk it is on. Visitors add matches to
+// hits in increasing address order, or push whole blocks they build
+// themselves, such as snapshots, to blocks.
+typedef struct {
+  ULongArray hits;
+  CandidateSet blocks;
+} ScanOutput;
+
+// Called by a worker for every piece of a chunk
+typedef void (*ScanVisitor)(const ScanPiece *piece, void *ctx,
+                            ScanOutput *out);
+
+typedef struct {
+  MemoryReader *reader;
+  size_t threads;
+} ScanEngine;
+
+// One process of a scan over several: its reader, its regions and the sets
+// its hits go to. A window, unless window_end is 0, limits the scan to the
+// chunks inside [window_start, window_end), which must start on a chunk of
+// its region. Reads still run up to the overlap past it, so a region can be
+// scanned one window at a time without missing values across their edges.
+typedef struct {
+  MemoryReader *reader;
+  const PMRegionArray *regions;
+  CandidateSet *outs;
+  unsigned long window_start;
+  unsigned long window_end;
+} ScanSource;
+
+ScanEngine scan_engine_create(MemoryReader *reader, size_t threads);
+
+// Splits every region into SCAN_CHUNK_SIZE chunks, visits them on the
+// engine's worker threads and adds all hits to out in address order.
+// Each chunk is read with up to overlap extra bytes from the same region.
+void scan_regions(ScanEngine *engine, const PMRegionArray *regions,
+                  size_t overlap, ScanVisitor visit, void *ctx,
+                  CandidateSet *out);
+
+// Fills count sets from a single read of each chunk. Visitors get an array
+// of count outputs instead, in the order of outs.
+void scan_regions_multi(ScanEngine *engine, const PMRegionArray *regions,
+                        size_t overlap, ScanVisitor visit, void *ctx,
+                        CandidateSet *outs, size_t count);
+
+// Like scan_regions_multi over the regions of every source at once, so the
+// chunks of all of them share the engine's threads. The engine's reader is
+// not used, and each source's outs get only its own hits.
+void scan_sources(ScanEngine *engine, const ScanSource *sources,
+                  size_t source_count, size_t overlap, ScanVisitor visit,
+                  void *ctx, size_t count);
+
+#endif
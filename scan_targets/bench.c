@@ -0,0 +1,333 @@
+// Drives memsniffer against bench_target and prints one CSV row per command:
+// how long it took, how much it read and through how many syscalls, its
+// peak RSS and how long it kept the target stopped.
+//
+// bench [--heap-mb <n>] [--regions <n>] [--density <n>] [--mutations <n>]
+//       [--types <type,...>] [--backends <vm,procmem,ptrace>]
+//       [--memsniffer <path>] [--target <path>]
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define PROMPT "[memsniffer]>_ "
+
+typedef struct {
+  pid_t pid;
+  FILE *in;
+  int out_fd;
+} Child;
+
+// What memsniffer printed in answer to one command
+typedef struct {
+  double seconds;
+  unsigned long bytes_read;
+  unsigned long syscalls;
+  double stop_ms;
+  unsigned long candidates;
+  unsigned long first_address; // First address lookall showed
+  unsigned long peak_rss_kb;
+} CommandResult;
+
+static void die(const char *message) {
+  perror(message);
+  exit(EXIT_FAILURE);
+}
+
+static Child spawn(char *const argv[]) {
+  int in[2];
+  int out[2];
+  Child child;
+
+  if (pipe(in) == -1 || pipe(out) == -1) {
+    die("pipe");
+  }
+
+  child.pid = fork();
+  if (child.pid == -1) {
+    die("fork");
+  }
+
+  if (child.pid == 0) {
+    dup2(in[0], STDIN_FILENO);
+    dup2(out[1], STDOUT_FILENO);
+    close(in[1]);
+    close(out[0]);
+    execv(argv[0], argv);
+    die(argv[0]);
+  }
+
+  close(in[0]);
+  close(out[1]);
+  child.in = fdopen(in[1], "w");
+  child.out_fd = out[0];
+
+  return child;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void parse_line(const char *line, CommandResult *result) {
+  unsigned long a;
+  unsigned long b;
+  double ms;
+
+  if (strncmp(line, PROMPT, strlen(PROMPT)) == 0) {
+    line += strlen(PROMPT);
+  }
+
+  if (sscanf(line, "Read %lu bytes in %lu syscalls", &a, &b) == 2) {
+    result->bytes_read = a;
+    result->syscalls = b;
+  } else if (sscanf(line, "Target stopped for %lf ms", &ms) == 1) {
+    result->stop_ms = ms;
+  } else if (strstr(line, " candidates in total") != NULL ||
+             strstr(line, " candidates in ") == line + strcspn(line, " ")) {
+    // Sets of several types are summed up in a total line last
+    sscanf(line, "%lu", &result->candidates);
+  } else if (result->first_address == 0 &&
+             sscanf(line, "Value at 0x%lx", &a) == 1) {
+    result->first_address = a;
+  }
+}
+
+// Reads lines until memsniffer prompts again, which it only does once it
+// waits for the next command. Output is parsed as it comes and never kept
+// whole, lookall can print millions of lines.
+static void read_until_prompt(const Child *child, CommandResult *result) {
+  char buf[1 << 16];
+  size_t len = 0;
+
+  while (true) {
+    const ssize_t got = read(child->out_fd, buf + len, sizeof(buf) - 1 - len);
+    if (got <= 0) {
+      fprintf(stderr, "memsniffer exited\n");
+      exit(EXIT_FAILURE);
+    }
+    len += got;
+    buf[len] = '\0';
+
+    char *line = buf;
+    char *end;
+    while ((end = strchr(line, '\n')) != NULL) {
+      *end = '\0';
+      parse_line(line, result);
+      line = end + 1;
+    }
+
+    len -= line - buf;
+    memmove(buf, line, len);
+
+    if (len == strlen(PROMPT) && memcmp(buf, PROMPT, len) == 0) {
+      return;
+    }
+
+    // A line longer than the buffer is of no interest
+    if (len == sizeof(buf) - 1) {
+      len = 0;
+    }
+  }
+}
+
+static unsigned long peak_rss_kb(const pid_t pid) {
+  char path[64];
+  char line[256];
+  unsigned long kb = 0;
+
+  snprintf(path, sizeof(path), "/proc/%d/status", pid);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return 0;
+  }
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    sscanf(line, "VmHWM: %lu", &kb);
+  }
+  fclose(file);
+
+  return kb;
+}
+
+// Resets the peak RSS of pid to its current RSS
+static void reset_peak_rss(const pid_t pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/clear_refs", pid);
+
+  FILE *file = fopen(path, "w");
+  if (file != NULL) {
+    fputs("5", file);
+    fclose(file);
+  }
+}
+
+static CommandResult run_command(const Child *child, const char *command) {
+  CommandResult result;
+  memset(&result, 0, sizeof(result));
+
+  reset_peak_rss(child->pid);
+  const double start = now();
+
+  fprintf(child->in, "%s\n", command);
+  fflush(child->in);
+  read_until_prompt(child, &result);
+
+  result.seconds = now() - start;
+  result.peak_rss_kb = peak_rss_kb(child->pid);
+
+  return result;
+}
+
+static const char *needle(const char *type) {
+  static const char *needles[][2] = {
+      {"int8", NEEDLE_INT8},       {"int16", NEEDLE_INT16},
+      {"int32", NEEDLE_INT32},     {"int64", NEEDLE_INT64},
+      {"float32", NEEDLE_FLOAT32}, {"double64", NEEDLE_DOUBLE64},
+  };
+
+  for (size_t i = 0; i < sizeof(needles) / sizeof(needles[0]); i++) {
+    if (strcmp(type, needles[i][0]) == 0) {
+      return needles[i][1];
+    }
+  }
+
+  return NULL;
+}
+
+static void print_row(const char *config, const char *backend,
+                      const char *type, const char *command,
+                      const CommandResult *result) {
+  const double gb_per_s =
+      result->seconds > 0 ? result->bytes_read / result->seconds / 1e9 : 0;
+
+  printf("%s,%s,%s,%s,%.6f,%lu,%.3f,%lu,%lu,%.3f,%lu\n", config, backend,
+         type, command, result->seconds, result->bytes_read, gb_per_s,
+         result->syscalls, result->peak_rss_kb, result->stop_ms,
+         result->candidates);
+  fflush(stdout);
+}
+
+static void bench_type(const Child *sniffer, const char *config,
+                       const char *backend, const char *type) {
+  const char *value = needle(type);
+  char command[256];
+
+  if (value == NULL) {
+    fprintf(stderr, "No needle for type %s\n", type);
+    return;
+  }
+
+  snprintf(command, sizeof(command), "new %s %s", type, value);
+  CommandResult result = run_command(sniffer, command);
+  print_row(config, backend, type, "new", &result);
+
+  snprintf(command, sizeof(command), "next %s", value);
+  result = run_command(sniffer, command);
+  print_row(config, backend, type, "next", &result);
+
+  snprintf(command, sizeof(command), "lookall %s", type);
+  result = run_command(sniffer, command);
+  print_row(config, backend, type, "lookall", &result);
+
+  if (result.first_address != 0) {
+    snprintf(command, sizeof(command), "update %s %lx %s", type,
+             result.first_address, value);
+    result = run_command(sniffer, command);
+    print_row(config, backend, type, "update", &result);
+  }
+}
+
+int main(const int argc, const char *argv[]) {
+  const char *heap_mb = "256";
+  const char *regions = "16";
+  const char *density = "4";
+  const char *mutations = "0";
+  char types[256] = "int32,int64,float32,double64";
+  char backends[256] = "vm,procmem,ptrace";
+  const char *memsniffer = "./memsniffer";
+  const char *target = "./scan_targets/bench_target";
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--heap-mb") == 0) {
+      heap_mb = argv[i + 1];
+    } else if (strcmp(argv[i], "--regions") == 0) {
+      regions = argv[i + 1];
+    } else if (strcmp(argv[i], "--density") == 0) {
+      density = argv[i + 1];
+    } else if (strcmp(argv[i], "--mutations") == 0) {
+      mutations = argv[i + 1];
+    } else if (strcmp(argv[i], "--types") == 0) {
+      snprintf(types, sizeof(types), "%s", argv[i + 1]);
+    } else if (strcmp(argv[i], "--backends") == 0) {
+      snprintf(backends, sizeof(backends), "%s", argv[i + 1]);
+    } else if (strcmp(argv[i], "--memsniffer") == 0) {
+      memsniffer = argv[i + 1];
+    } else if (strcmp(argv[i], "--target") == 0) {
+      target = argv[i + 1];
+    }
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  char *target_argv[] = {(char *)target,    "--heap-mb",   (char *)heap_mb,
+                         "--regions",       (char *)regions,
+                         "--density",       (char *)density,
+                         "--mutations",     (char *)mutations, NULL};
+  Child bench_target = spawn(target_argv);
+
+  char ready[64] = "";
+  FILE *target_out = fdopen(bench_target.out_fd, "r");
+  if (fgets(ready, sizeof(ready), target_out) == NULL ||
+      strncmp(ready, BENCH_READY, strlen(BENCH_READY)) != 0) {
+    fprintf(stderr, "bench_target failed to start\n");
+    return EXIT_FAILURE;
+  }
+
+  char config[256];
+  snprintf(config, sizeof(config), "%s,%s,%s,%s", heap_mb, regions, density,
+           mutations);
+  printf("heap_mb,regions,density,mutations,backend,type,command,seconds,"
+         "bytes_read,gb_per_s,syscalls,peak_rss_kb,stop_ms,candidates\n");
+
+  for (char *backend = strtok(backends, ","); backend != NULL;
+       backend = strtok(NULL, ",")) {
+    // The target is found by name, the way a user would run it
+    const char *name = strrchr(target, '/') != NULL ? strrchr(target, '/') + 1
+                                                    : target;
+    char *sniffer_argv[] = {(char *)memsniffer, "--reader", backend,
+                            (char *)name, NULL};
+    Child sniffer = spawn(sniffer_argv);
+    CommandResult banner;
+    memset(&banner, 0, sizeof(banner));
+    read_until_prompt(&sniffer, &banner);
+
+    // types is split with strtok_r, backends already uses strtok
+    char type_list[256];
+    char *save;
+    snprintf(type_list, sizeof(type_list), "%s", types);
+    for (char *type = strtok_r(type_list, ",", &save); type != NULL;
+         type = strtok_r(NULL, ",", &save)) {
+      bench_type(&sniffer, config, backend, type);
+    }
+
+    fprintf(sniffer.in, "exit\n");
+    fclose(sniffer.in);
+    close(sniffer.out_fd);
+    waitpid(sniffer.pid, NULL, 0);
+  }
+
+  fclose(bench_target.in);
+  fclose(target_out);
+  waitpid(bench_target.pid, NULL, 0);
+
+  return EXIT_SUCCESS;
+}
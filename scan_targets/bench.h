@@ -0,0 +1,16 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Values bench_target plants in its memory, one per type, which bench then
+// looks for
+#define NEEDLE_INT8 "123"
+#define NEEDLE_INT16 "12345"
+#define NEEDLE_INT32 "123456789"
+#define NEEDLE_INT64 "1234567890123"
+#define NEEDLE_FLOAT32 "1234.5"
+#define NEEDLE_DOUBLE64 "9876.25"
+
+// bench_target prints this followed by its pid once its memory is ready
+#define BENCH_READY "ready"
+
+#endif
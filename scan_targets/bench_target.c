@@ -0,0 +1,147 @@
+// Synthetic target for make bench. Maps --heap-mb megabytes in --regions
+// separate mappings, fills them with noise and plants the needle of every
+// type --density times per megabyte. A thread flips --mutations planted
+// int32 values per second. Runs until its stdin is closed.
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define PAGE 4096UL
+
+typedef struct {
+  int32_t **slots;
+  size_t count;
+  unsigned long rate;
+} Mutator;
+
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void fill_noise(unsigned char *buf, const size_t len, uint64_t *state) {
+  for (size_t i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    const uint64_t word = next_random(state);
+    memcpy(buf + i, &word, sizeof(word));
+  }
+}
+
+// Writes value at a random offset aligned to its width
+static void *plant(unsigned char *buf, const size_t len, const void *value,
+                   const size_t width, uint64_t *state) {
+  unsigned char *at = buf + next_random(state) % (len / width) * width;
+  memcpy(at, value, width);
+  return at;
+}
+
+// Flips the low bit of a random planted int32, rate times a second, so
+// they keep moving between the needle and a value next to it
+static void *mutate(void *arg) {
+  const Mutator *mutator = arg;
+  const struct timespec tick = {.tv_nsec = 10000000}; // 10ms
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+  unsigned long debt = 0;
+
+  while (mutator->count > 0) {
+    nanosleep(&tick, NULL);
+    debt += mutator->rate;
+
+    for (; debt >= 100; debt -= 100) {
+      volatile int32_t *slot =
+          mutator->slots[next_random(&state) % mutator->count];
+      *slot ^= 1;
+    }
+  }
+
+  return NULL;
+}
+
+int main(const int argc, const char *argv[]) {
+  unsigned long heap_mb = 256;
+  unsigned long regions = 16;
+  unsigned long density = 4;
+  unsigned long mutations = 0;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const unsigned long value = strtoul(argv[i + 1], NULL, 10);
+
+    if (strcmp(argv[i], "--heap-mb") == 0) {
+      heap_mb = value;
+    } else if (strcmp(argv[i], "--regions") == 0) {
+      regions = value > 0 ? value : 1;
+    } else if (strcmp(argv[i], "--density") == 0) {
+      density = value;
+    } else if (strcmp(argv[i], "--mutations") == 0) {
+      mutations = value;
+    }
+  }
+
+  // Lets the scanner attach without being our parent
+  prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY);
+
+  const int8_t int8 = strtol(NEEDLE_INT8, NULL, 10);
+  const int16_t int16 = strtol(NEEDLE_INT16, NULL, 10);
+  const int32_t int32 = strtol(NEEDLE_INT32, NULL, 10);
+  const int64_t int64 = strtoll(NEEDLE_INT64, NULL, 10);
+  const float float32 = strtof(NEEDLE_FLOAT32, NULL);
+  const double double64 = strtod(NEEDLE_DOUBLE64, NULL);
+
+  const size_t region_size =
+      ((heap_mb << 20) / regions + PAGE - 1) / PAGE * PAGE;
+  const size_t plants = density * (region_size >> 20) + 1;
+  Mutator mutator = {.rate = mutations};
+  uint64_t state = 0x2545F4914F6CDD1DULL;
+
+  mutator.slots = malloc(regions * plants * sizeof(int32_t *));
+  if (mutator.slots == NULL) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+
+  for (unsigned long r = 0; r < regions; r++) {
+    // A guard page keeps the kernel from merging neighbouring mappings
+    unsigned char *buf = mmap(NULL, region_size + PAGE, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+      perror("mmap");
+      return EXIT_FAILURE;
+    }
+    mprotect(buf + region_size, PAGE, PROT_NONE);
+
+    fill_noise(buf, region_size, &state);
+
+    for (size_t p = 0; p < plants; p++) {
+      plant(buf, region_size, &int8, sizeof(int8), &state);
+      plant(buf, region_size, &int16, sizeof(int16), &state);
+      mutator.slots[mutator.count++] =
+          plant(buf, region_size, &int32, sizeof(int32), &state);
+      plant(buf, region_size, &int64, sizeof(int64), &state);
+      plant(buf, region_size, &float32, sizeof(float32), &state);
+      plant(buf, region_size, &double64, sizeof(double64), &state);
+    }
+  }
+
+  pthread_t thread;
+  if (mutations > 0) {
+    pthread_create(&thread, NULL, mutate, &mutator);
+  }
+
+  printf("%s %d\n", BENCH_READY, getpid());
+  fflush(stdout);
+
+  char line[64];
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,398 @@
+#include "session.h"
+#include "globals.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SESSION_MAGIC "MEMSESS1"
+#define SESSION_ALIGN 8
+
+// Offsets are from the start of the file
+typedef struct {
+  char magic[8];
+  uint64_t pid;
+  uint64_t file_size;
+  uint64_t scan_offset;
+  uint64_t scan_size;
+  uint64_t known_offset;
+  uint64_t known_count;
+  uint64_t pending_offset;
+  uint64_t pending_count;
+  uint64_t set_offset;
+  uint64_t set_count;
+} SessionHeader;
+
+typedef struct {
+  uint64_t start;
+  uint64_t end;
+} SessionRange;
+
+typedef struct {
+  uint64_t type;
+  uint64_t width;
+  uint64_t stride;
+  uint64_t uniform;
+  uint64_t value;
+  uint64_t block_offset;
+  uint64_t block_count;
+} SessionSet;
+
+// An offset of 0 means the block has no such data
+typedef struct {
+  uint64_t base;
+  uint64_t span;
+  uint64_t count;
+  uint64_t kind;
+  uint64_t data_offset;
+  uint64_t data_size;
+  uint64_t values_offset;
+  uint64_t snapshot_len;
+  uint64_t page_offset;
+  uint64_t page_count;
+  uint64_t snapshot_offset;
+  uint64_t snapshot_size;
+} SessionBlock;
+
+typedef struct {
+  FILE *file;
+  uint64_t offset;
+} SessionWriter;
+
+// Appends size bytes at the next aligned offset, returning that offset
+static uint64_t write_section(SessionWriter *writer, const void *data,
+                              const size_t size) {
+  static const unsigned char zeros[SESSION_ALIGN];
+  const size_t padding =
+      (SESSION_ALIGN - writer->offset % SESSION_ALIGN) % SESSION_ALIGN;
+  const uint64_t offset = writer->offset + padding;
+
+  fwrite(zeros, 1, padding, writer->file);
+  if (size > 0) {
+    fwrite(data, 1, size, writer->file);
+  }
+  writer->offset = offset + size;
+
+  return offset;
+}
+
+static uint64_t write_ranges(SessionWriter *writer,
+                             const PMRegionArray *ranges) {
+  SessionRange *saved = malloc(ranges->size * sizeof(SessionRange) + 1);
+  if (saved == NULL) {
+    exit_error("Error allocating session ranges");
+  }
+
+  for (size_t i = 0; i < ranges->size; i++) {
+    saved[i].start = ranges->regions[i].start;
+    saved[i].end = ranges->regions[i].end;
+  }
+
+  const uint64_t offset =
+      write_section(writer, saved, ranges->size * sizeof(SessionRange));
+  free(saved);
+
+  return offset;
+}
+
+// Writes the data of every block, then the table pointing at it
+static void write_set(SessionWriter *writer, const CandidateSet *set,
+                      SessionSet *saved) {
+  SessionBlock *blocks = calloc(set->size + 1, sizeof(SessionBlock));
+  if (blocks == NULL) {
+    exit_error("Error allocating session blocks");
+  }
+
+  for (size_t i = 0; i < set->size; i++) {
+    const CandidateBlock *block = &set->blocks[i];
+    SessionBlock *out = &blocks[i];
+
+    out->base = block->base;
+    out->span = block->span;
+    out->count = block->count;
+    out->kind = block->kind;
+    out->data_size = block->data_size;
+    out->data_offset = write_section(writer, block->data, block->data_size);
+
+    if (block->values != NULL) {
+      out->values_offset =
+          write_section(writer, block->values, block->count * set->width);
+    }
+
+    if (block->kind == BLOCK_ALL) {
+      const Snapshot *snapshot = &block->snapshot;
+      out->snapshot_len = snapshot->len;
+      out->page_count = snapshot->page_count;
+      out->page_offset =
+          write_section(writer, snapshot->pages,
+                        snapshot->page_count * sizeof(SnapshotPage));
+      out->snapshot_size = snapshot->data_size;
+      out->snapshot_offset =
+          write_section(writer, snapshot->data, snapshot->data_size);
+    }
+  }
+
+  saved->width = set->width;
+  saved->stride = set->stride;
+  saved->uniform = set->uniform;
+  saved->value = set->value;
+  saved->block_count = set->size;
+  saved->block_offset =
+      write_section(writer, blocks, set->size * sizeof(SessionBlock));
+
+  free(blocks);
+}
+
+bool session_save(const char *path, const pid_t pid,
+                  const RegionTracker *tracker, const ScanResults *results,
+                  const void *scan, const size_t scan_size) {
+  // The file is written aside and renamed over path, so that a session
+  // mapped from path stays intact until then
+  char temp_path[4096];
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+  FILE *file = fopen(temp_path, "wb");
+  if (file == NULL) {
+    perror("Error opening session file");
+    return false;
+  }
+
+  SessionHeader header;
+  SessionSet sets[RESULTS_MAX];
+  SessionWriter writer = {.file = file, .offset = 0};
+
+  memset(&header, 0, sizeof(header));
+  memset(sets, 0, sizeof(sets));
+
+  // The header is written again once every offset is known
+  write_section(&writer, &header, sizeof(header));
+
+  header.scan_size = scan_size;
+  header.scan_offset = write_section(&writer, scan, scan_size);
+  header.known_count = tracker->known.size;
+  header.known_offset = write_ranges(&writer, &tracker->known);
+  header.pending_count = tracker->pending.size;
+  header.pending_offset = write_ranges(&writer, &tracker->pending);
+
+  for (size_t i = 0; i < results->size; i++) {
+    sets[i].type = results->types[i];
+    write_set(&writer, &results->sets[i], &sets[i]);
+  }
+
+  header.set_count = results->size;
+  header.set_offset =
+      write_section(&writer, sets, results->size * sizeof(SessionSet));
+
+  memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+  header.pid = pid;
+  header.file_size = writer.offset;
+
+  rewind(file);
+  fwrite(&header, 1, sizeof(header), file);
+
+  const bool failed = ferror(file);
+  if (fclose(file) != 0 || failed || rename(temp_path, path) != 0) {
+    perror("Error writing session file");
+    unlink(temp_path);
+    return false;
+  }
+
+  return true;
+}
+
+// Whether count items of size bytes starting at offset lie inside the file
+static bool in_file(const Session *session, const uint64_t offset,
+                    const uint64_t count, const uint64_t size) {
+  return offset <= session->size &&
+         count <= (session->size - offset) / size;
+}
+
+static CandidateBlock mapped_block(const Session *session,
+                                   const SessionBlock *saved) {
+  CandidateBlock block;
+  memset(&block, 0, sizeof(block));
+  block.base = saved->base;
+  block.span = saved->span;
+  block.count = saved->count;
+  block.kind = saved->kind;
+  block.data_size = saved->data_size;
+  block.data = session->map + saved->data_offset;
+  block.mapped = true;
+
+  if (saved->values_offset != 0) {
+    block.values = session->map + saved->values_offset;
+  }
+
+  if (block.kind == BLOCK_ALL) {
+    block.snapshot.len = saved->snapshot_len;
+    block.snapshot.page_count = saved->page_count;
+    block.snapshot.pages = (SnapshotPage *)(session->map + saved->page_offset);
+    block.snapshot.data_size = saved->snapshot_size;
+    block.snapshot.data = session->map + saved->snapshot_offset;
+  }
+
+  return block;
+}
+
+// Checks that a block's sections lie inside the file, then that their
+// contents agree with its count and span
+static bool block_valid(const Session *session, const SessionBlock *block,
+                        const SessionSet *set) {
+  const uint64_t width = set->width;
+
+  if (block->kind > BLOCK_ALL ||
+      !in_file(session, block->data_offset, block->data_size, 1)) {
+    return false;
+  }
+
+  if (block->values_offset != 0 &&
+      (block->count > SIZE_MAX / width ||
+       !in_file(session, block->values_offset, block->count * width, 1))) {
+    return false;
+  }
+
+  if (block->kind == BLOCK_ALL &&
+      (!in_file(session, block->page_offset, block->page_count,
+                sizeof(SnapshotPage)) ||
+       !in_file(session, block->snapshot_offset, block->snapshot_size, 1))) {
+    return false;
+  }
+
+  const CandidateBlock mapped = mapped_block(session, block);
+  return candidate_block_valid(&mapped, set->width, set->stride);
+}
+
+// Checks that every table and every block lies inside the file and that
+// blocks hold what they claim, so that they can point into it without
+// further checks
+static bool session_valid(const Session *session, const size_t scan_size) {
+  const SessionHeader *header = (const SessionHeader *)session->map;
+
+  if (memcmp(header->magic, SESSION_MAGIC, sizeof(header->magic)) != 0 ||
+      header->file_size != session->size || header->scan_size != scan_size ||
+      header->set_count > RESULTS_MAX ||
+      !in_file(session, header->scan_offset, scan_size, 1) ||
+      !in_file(session, header->known_offset, header->known_count,
+               sizeof(SessionRange)) ||
+      !in_file(session, header->pending_offset, header->pending_count,
+               sizeof(SessionRange)) ||
+      !in_file(session, header->set_offset, header->set_count,
+               sizeof(SessionSet))) {
+    return false;
+  }
+
+  const SessionSet *sets =
+      (const SessionSet *)(session->map + header->set_offset);
+
+  for (size_t i = 0; i < header->set_count; i++) {
+    const SessionSet *set = &sets[i];
+    if (set->type >= UNKNOWN || set->width == 0 || set->stride == 0 ||
+        !in_file(session, set->block_offset, set->block_count,
+                 sizeof(SessionBlock))) {
+      return false;
+    }
+
+    const SessionBlock *blocks =
+        (const SessionBlock *)(session->map + set->block_offset);
+    for (size_t j = 0; j < set->block_count; j++) {
+      if (!block_valid(session, &blocks[j], set)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static void load_ranges(const Session *session, const uint64_t offset,
+                        const uint64_t count, PMRegionArray *out) {
+  const SessionRange *ranges = (const SessionRange *)(session->map + offset);
+
+  for (size_t i = 0; i < count; i++) {
+    const ProcessMemoryRegion range = {
+        .start = ranges[i].start,
+        .end = ranges[i].end,
+        .path = "",
+    };
+    pmregion_array_insert(out, range);
+  }
+}
+
+bool session_load(const char *path, Session *session, const pid_t pid,
+                  RegionTracker *tracker, ScanResults *results, void *scan,
+                  const size_t scan_size) {
+  const int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("Error opening session file");
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    perror("Error reading session file");
+    close(fd);
+    return false;
+  }
+
+  // Nothing is read up front, pages come in as the sets are used
+  Session loaded = {.map = MAP_FAILED, .size = st.st_size};
+  if (loaded.size >= sizeof(SessionHeader)) {
+    loaded.map = mmap(NULL, loaded.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+
+  if (loaded.map == MAP_FAILED || !session_valid(&loaded, scan_size)) {
+    printf("Not a session file: %s\n", path);
+    loaded.map = loaded.map != MAP_FAILED ? loaded.map : NULL;
+    session_unmap(&loaded);
+    return false;
+  }
+
+  const SessionHeader *header = (const SessionHeader *)loaded.map;
+  const SessionSet *sets =
+      (const SessionSet *)(loaded.map + header->set_offset);
+
+  for (size_t i = 0; i < header->set_count; i++) {
+    const SessionBlock *blocks =
+        (const SessionBlock *)(loaded.map + sets[i].block_offset);
+    CandidateSet set = candidates_create(sets[i].width, sets[i].stride);
+    set.uniform = sets[i].uniform;
+    set.value = sets[i].value;
+
+    for (size_t j = 0; j < sets[i].block_count; j++) {
+      candidates_push(&set, mapped_block(&loaded, &blocks[j]));
+    }
+
+    scan_results_add(results, sets[i].type, set);
+  }
+
+  memcpy(scan, loaded.map + header->scan_offset, scan_size);
+
+  PMRegionArray known = pmregion_array_create(header->known_count + 1);
+  load_ranges(&loaded, header->known_offset, header->known_count, &known);
+  region_tracker_reset(tracker, &known);
+  load_ranges(&loaded, header->pending_offset, header->pending_count,
+              &tracker->pending);
+  pmregion_array_destroy(&known);
+
+  if (header->pid != (uint64_t)pid) {
+    printf("Session was saved from process %lu, addresses may have moved\n",
+           (unsigned long)header->pid);
+  }
+
+  *session = loaded;
+  return true;
+}
+
+void session_unmap(Session *session) {
+  if (session->map != NULL) {
+    munmap(session->map, session->size);
+  }
+
+  session->map = NULL;
+  session->size = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef SESSION_H
+#define SESSION_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "region_tracker.h"
+#include "results.h"
+
+// A session file mapped back into memory. Blocks loaded from it point into
+// the mapping, which has to outlive them.
+typedef struct {
+  unsigned char *map;
+  size_t size;
+} Session;
+
+// Writes the result sets, the ranges they were scanned from and scan, an
+// opaque record of the scan that found them, to path. Every section lies at
+// an aligned offset in the layout it has in memory, so loading it back is a
+// single mmap. Returns false, after printing why, when path can't be written.
+bool session_save(const char *path, pid_t pid, const RegionTracker *tracker,
+                  const ScanResults *results, const void *scan,
+                  size_t scan_size);
+
+// Maps path as session and adds its sets to results, which must be empty.
+// The tracker is reset to the saved ranges and scan receives the saved
+// record, which must be scan_size bytes. Returns false, after printing why,
+// when path isn't a session file, leaving everything untouched.
+bool session_load(const char *path, Session *session, pid_t pid,
+                  RegionTracker *tracker, ScanResults *results, void *scan,
+                  size_t scan_size);
+
+void session_unmap(Session *session);
+
+#endif
@@ -0,0 +1,180 @@
+#include "snapshot.h"
+#include "globals.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORDS_PER_PAGE (PAGE_SIZE / sizeof(uint64_t))
+#define SPARSE_BITMAP_SIZE (WORDS_PER_PAGE / 8)
+
+static bool page_is_fill(const unsigned char *page, const size_t len) {
+  return len == 0 || memcmp(page, page + 1, len - 1) == 0;
+}
+
+static size_t encode_sparse(const unsigned char *page, unsigned char *out) {
+  unsigned char *bitmap = out;
+  unsigned char *words = out + SPARSE_BITMAP_SIZE;
+  size_t count = 0;
+
+  memset(bitmap, 0, SPARSE_BITMAP_SIZE);
+
+  for (size_t i = 0; i < WORDS_PER_PAGE; i++) {
+    uint64_t word;
+    memcpy(&word, page + i * sizeof(word), sizeof(word));
+
+    if (word != 0) {
+      bitmap[i / 8] |= (unsigned char)(1 << (i % 8));
+      memcpy(words + count * sizeof(word), &word, sizeof(word));
+      count++;
+    }
+  }
+
+  return SPARSE_BITMAP_SIZE + count * sizeof(uint64_t);
+}
+
+static size_t count_nonzero_words(const unsigned char *page) {
+  size_t count = 0;
+
+  for (size_t i = 0; i < WORDS_PER_PAGE; i++) {
+    uint64_t word;
+    memcpy(&word, page + i * sizeof(word), sizeof(word));
+    count += word != 0;
+  }
+
+  return count;
+}
+
+Snapshot snapshot_encode(const unsigned char *buf, const size_t len) {
+  Snapshot snapshot;
+  snapshot.len = len;
+  snapshot.page_count = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+  snapshot.pages = malloc(snapshot.page_count * sizeof(SnapshotPage));
+  snapshot.data = malloc(len > 0 ? len : 1);
+  snapshot.data_size = 0;
+
+  if (snapshot.pages == NULL || snapshot.data == NULL) {
+    exit_error("Error allocating snapshot");
+  }
+
+  for (size_t i = 0; i < snapshot.page_count; i++) {
+    const unsigned char *page = buf + i * PAGE_SIZE;
+    const size_t page_len = len - i * PAGE_SIZE < PAGE_SIZE
+                                ? len - i * PAGE_SIZE
+                                : PAGE_SIZE;
+    SnapshotPage *entry = &snapshot.pages[i];
+    entry->offset = snapshot.data_size;
+    entry->fill = page[0];
+
+    if (page_is_fill(page, page_len)) {
+      entry->kind = PAGE_FILL;
+      entry->size = 0;
+    } else if (page_len == PAGE_SIZE &&
+               SPARSE_BITMAP_SIZE +
+                       count_nonzero_words(page) * sizeof(uint64_t) <
+                   PAGE_SIZE) {
+      entry->kind = PAGE_SPARSE;
+      entry->size = encode_sparse(page, snapshot.data + snapshot.data_size);
+    } else {
+      entry->kind = PAGE_RAW;
+      entry->size = page_len;
+      memcpy(snapshot.data + snapshot.data_size, page, page_len);
+    }
+
+    snapshot.data_size += entry->size;
+  }
+
+  unsigned char *data =
+      realloc(snapshot.data, snapshot.data_size > 0 ? snapshot.data_size : 1);
+  if (data != NULL) {
+    snapshot.data = data;
+  }
+
+  return snapshot;
+}
+
+void snapshot_page(const Snapshot *snapshot, const size_t i,
+                   unsigned char *out) {
+  const SnapshotPage *entry = &snapshot->pages[i];
+  const size_t page_len = snapshot->len - i * PAGE_SIZE < PAGE_SIZE
+                              ? snapshot->len - i * PAGE_SIZE
+                              : PAGE_SIZE;
+  const unsigned char *data = snapshot->data + entry->offset;
+
+  switch (entry->kind) {
+  case PAGE_FILL:
+    memset(out, entry->fill, page_len);
+    break;
+  case PAGE_SPARSE: {
+    const unsigned char *words = data + SPARSE_BITMAP_SIZE;
+    size_t count = 0;
+
+    memset(out, 0, PAGE_SIZE);
+    for (size_t w = 0; w < WORDS_PER_PAGE; w++) {
+      if (data[w / 8] & (1 << (w % 8))) {
+        memcpy(out + w * sizeof(uint64_t), words + count * sizeof(uint64_t),
+               sizeof(uint64_t));
+        count++;
+      }
+    }
+    break;
+  }
+  default:
+    memcpy(out, data, page_len);
+  }
+}
+
+bool snapshot_valid(const Snapshot *snapshot) {
+  if (snapshot->page_count != (snapshot->len + PAGE_SIZE - 1) / PAGE_SIZE) {
+    return false;
+  }
+
+  for (size_t i = 0; i < snapshot->page_count; i++) {
+    const SnapshotPage *entry = &snapshot->pages[i];
+    const size_t page_len = snapshot->len - i * PAGE_SIZE < PAGE_SIZE
+                                ? snapshot->len - i * PAGE_SIZE
+                                : PAGE_SIZE;
+
+    if (entry->offset > snapshot->data_size ||
+        entry->size > snapshot->data_size - entry->offset) {
+      return false;
+    }
+
+    const unsigned char *data = snapshot->data + entry->offset;
+
+    if (entry->kind == PAGE_SPARSE) {
+      if (page_len != PAGE_SIZE || entry->size < SPARSE_BITMAP_SIZE) {
+        return false;
+      }
+
+      size_t count = 0;
+      for (size_t b = 0; b < SPARSE_BITMAP_SIZE; b++) {
+        count += __builtin_popcount(data[b]);
+      }
+      if (entry->size < SPARSE_BITMAP_SIZE + count * sizeof(uint64_t)) {
+        return false;
+      }
+    } else if (entry->kind == PAGE_RAW) {
+      if (entry->size < page_len) {
+        return false;
+      }
+    } else if (entry->kind != PAGE_FILL) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+size_t snapshot_memory(const Snapshot *snapshot) {
+  return snapshot->page_count * sizeof(SnapshotPage) + snapshot->data_size;
+}
+
+void snapshot_destroy(Snapshot *snapshot) {
+  free(snapshot->pages);
+  free(snapshot->data);
+  snapshot->pages = NULL;
+  snapshot->data = NULL;
+  snapshot->page_count = 0;
+  snapshot->data_size = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "reader.h"
+
+typedef enum {
+  PAGE_FILL,   // Every byte is the same, only that byte is kept
+  PAGE_SPARSE, // Bitmap of non-zero 8-byte words followed by those words
+  PAGE_RAW,    // Stored as is
+} PageKind;
+
+typedef struct {
+  unsigned char kind;
+  unsigned char fill;
+  unsigned int size;
+  size_t offset;
+} SnapshotPage;
+
+// Copy of a readable piece of memory, compressed page by page. Heaps are
+// mostly zero or untouched pages, which cost a few bytes each here.
+typedef struct {
+  size_t len;
+  size_t page_count;
+  SnapshotPage *pages;
+  size_t data_size;
+  unsigned char *data;
+} Snapshot;
+
+Snapshot snapshot_encode(const unsigned char *buf, size_t len);
+
+// Writes page i back out as PAGE_SIZE bytes, or fewer for the last page
+void snapshot_page(const Snapshot *snapshot, size_t i, unsigned char *out);
+
+// Whether every page lies inside data and holds as much as its kind needs,
+// for snapshots read back from a file
+bool snapshot_valid(const Snapshot *snapshot);
+
+size_t snapshot_memory(const Snapshot *snapshot);
+
+void snapshot_destroy(Snapshot *snapshot);
+
+#endif
@@ -0,0 +1,207 @@
+#include "spill.h"
+#include "globals.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "reader.h"
+
+#define SPILL_ALIGN 8
+
+Spill spill_create(const size_t limit) {
+  Spill spill;
+  spill.limit = limit;
+  spill.fd = -1;
+  spill.size = 0;
+  spill.spilled = 0;
+  spill.count = 0;
+  spill.capacity = 0;
+  spill.mappings = NULL;
+
+  return spill;
+}
+
+void spill_destroy(Spill *spill) {
+  spill_reset(spill);
+  free(spill->mappings);
+  spill->mappings = NULL;
+  spill->capacity = 0;
+
+  if (spill->fd != -1) {
+    close(spill->fd);
+    spill->fd = -1;
+  }
+}
+
+bool spill_needed(const Spill *spill, const size_t heap_bytes) {
+  return spill->limit != 0 && heap_bytes > spill->limit;
+}
+
+static void spill_open(Spill *spill) {
+  const char *dir = getenv("TMPDIR");
+  char path[4096];
+
+  snprintf(path, sizeof(path), "%s/memsniffer-spill-XXXXXX",
+           dir != NULL ? dir : "/tmp");
+  spill->fd = mkstemp(path);
+  if (spill->fd == -1) {
+    exit_error("Error creating spill file");
+  }
+
+  // Gone from the directory, the file lives until it is closed
+  unlink(path);
+}
+
+static size_t align_up(const size_t offset, const size_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Offset of size bytes past *offset, moving *offset past them
+static size_t place(size_t *offset, const size_t size) {
+  const size_t at = align_up(*offset, SPILL_ALIGN);
+  *offset = at + size;
+  return at;
+}
+
+static void write_at(const Spill *spill, const void *data, const size_t size,
+                     const size_t offset) {
+  size_t done = 0;
+
+  while (done < size) {
+    const ssize_t written = pwrite(spill->fd, (const char *)data + done,
+                                   size - done, offset + done);
+    if (written <= 0) {
+      exit_error("Error writing spill file");
+    }
+    done += written;
+  }
+}
+
+static void spill_add_mapping(Spill *spill, void *map, const size_t size) {
+  if (spill->count == spill->capacity) {
+    spill->capacity = spill->capacity > 0 ? spill->capacity * GROWTH_FACTOR : 16;
+    SpillMapping *mappings =
+        realloc(spill->mappings, spill->capacity * sizeof(SpillMapping));
+
+    if (mappings == NULL) {
+      exit_error("Error allocating spill mappings");
+    }
+
+    spill->mappings = mappings;
+  }
+
+  spill->mappings[spill->count].map = map;
+  spill->mappings[spill->count].size = size;
+  spill->count++;
+}
+
+void spill_set(Spill *spill, CandidateSet *set) {
+  const size_t width = set->width;
+  size_t size = 0;
+
+  // Lays out every section first, so the whole spill is a single mapping
+  for (size_t i = 0; i < set->size; i++) {
+    const CandidateBlock *block = &set->blocks[i];
+
+    if (block->mapped) {
+      continue;
+    }
+
+    place(&size, block->data_size);
+    if (block->values != NULL) {
+      place(&size, block->count * width);
+    }
+    if (block->kind == BLOCK_ALL) {
+      place(&size, block->snapshot.page_count * sizeof(SnapshotPage));
+      place(&size, block->snapshot.data_size);
+    }
+  }
+
+  if (size == 0) {
+    return;
+  }
+
+  if (spill->fd == -1) {
+    spill_open(spill);
+  }
+
+  // Mappings start on a page boundary of the file
+  const size_t base = spill->size;
+  size_t offset = 0;
+
+  for (size_t i = 0; i < set->size; i++) {
+    const CandidateBlock *block = &set->blocks[i];
+
+    if (block->mapped) {
+      continue;
+    }
+
+    write_at(spill, block->data, block->data_size,
+             base + place(&offset, block->data_size));
+    if (block->values != NULL) {
+      write_at(spill, block->values, block->count * width,
+               base + place(&offset, block->count * width));
+    }
+    if (block->kind == BLOCK_ALL) {
+      const Snapshot *snapshot = &block->snapshot;
+      const size_t pages_size = snapshot->page_count * sizeof(SnapshotPage);
+      write_at(spill, snapshot->pages, pages_size,
+               base + place(&offset, pages_size));
+      write_at(spill, snapshot->data, snapshot->data_size,
+               base + place(&offset, snapshot->data_size));
+    }
+  }
+
+  unsigned char *map =
+      mmap(NULL, size, PROT_READ, MAP_SHARED, spill->fd, base);
+  if (map == MAP_FAILED) {
+    exit_error("Error mapping spill file");
+  }
+
+  spill_add_mapping(spill, map, size);
+  spill->size = align_up(base + size, PAGE_SIZE);
+
+  // Points every block at its copy, in the same order as it was written
+  offset = 0;
+  for (size_t i = 0; i < set->size; i++) {
+    CandidateBlock *block = &set->blocks[i];
+
+    if (block->mapped) {
+      continue;
+    }
+
+    spill->spilled += candidate_block_memory(block, width);
+    CandidateBlock moved = *block;
+
+    moved.data = map + place(&offset, block->data_size);
+    if (block->values != NULL) {
+      moved.values = map + place(&offset, block->count * width);
+    }
+    if (block->kind == BLOCK_ALL) {
+      moved.snapshot.pages =
+          (SnapshotPage *)(map + place(&offset, block->snapshot.page_count *
+                                                    sizeof(SnapshotPage)));
+      moved.snapshot.data = map + place(&offset, block->snapshot.data_size);
+    }
+    moved.mapped = true;
+
+    candidate_block_destroy(block);
+    *block = moved;
+  }
+}
+
+void spill_reset(Spill *spill) {
+  for (size_t i = 0; i < spill->count; i++) {
+    munmap(spill->mappings[i].map, spill->mappings[i].size);
+  }
+
+  spill->count = 0;
+  spill->size = 0;
+  spill->spilled = 0;
+
+  if (spill->fd != -1 && ftruncate(spill->fd, 0) != 0) {
+    perror("Error truncating spill file");
+  }
+}
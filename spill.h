@@ -0,0 +1,41 @@
+#ifndef SPILL_H
+#define SPILL_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "candidates.h"
+
+typedef struct {
+  void *map;
+  size_t size;
+} SpillMapping;
+
+// Candidate data moved off the heap into a temp file once sets hold more
+// than limit bytes. The file is unlinked as soon as it is created, and each
+// spill maps what it wrote back in, so blocks keep working as mapped blocks
+// while the page cache decides what stays in memory.
+typedef struct {
+  size_t limit; // Heap bytes before spilling, 0 for no limit
+  int fd;
+  size_t size;    // Bytes written to the file
+  size_t spilled; // Bytes moved off the heap since the last reset
+  size_t count;
+  size_t capacity;
+  SpillMapping *mappings;
+} Spill;
+
+Spill spill_create(size_t limit);
+
+void spill_destroy(Spill *spill);
+
+// Whether heap_bytes is past the limit
+bool spill_needed(const Spill *spill, size_t heap_bytes);
+
+// Moves the data of every block of set that is still on the heap to the
+// file, in a single write and mapping
+void spill_set(Spill *spill, CandidateSet *set);
+
+// Empties the file. No set may point into it anymore.
+void spill_reset(Spill *spill);
+
+#endif
@@ -0,0 +1,56 @@
+#include "stats.h"
+#include <stdio.h>
+#include <time.h>
+
+Stats stats_create(void) {
+  const Stats stats = {0};
+  return stats;
+}
+
+unsigned long stats_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+void stats_add(Stats *to, const Stats *from) {
+  to->bytes_read += from->bytes_read;
+  to->syscalls += from->syscalls;
+  to->failed_reads += from->failed_reads;
+  to->partial_reads += from->partial_reads;
+  to->read_ns += from->read_ns;
+  to->compare_ns += from->compare_ns;
+  to->stop_ns += from->stop_ns;
+  to->stops += from->stops;
+  to->wall_ns += from->wall_ns;
+  to->commands += from->commands;
+
+  if (from->candidate_bytes > to->candidate_bytes) {
+    to->candidate_bytes = from->candidate_bytes;
+  }
+}
+
+void print_stats_line(const Stats *stats) {
+  printf("Read %lu bytes in %lu syscalls (%lu failed, %lu partial), "
+         "%.3f ms reading, %.3f ms comparing, %.3f ms total\n",
+         stats->bytes_read, stats->syscalls, stats->failed_reads,
+         stats->partial_reads, stats->read_ns / 1e6, stats->compare_ns / 1e6,
+         stats->wall_ns / 1e6);
+}
+
+void print_stats(const Stats *stats) {
+  const double read_mb_per_s =
+      stats->read_ns > 0 ? stats->bytes_read * 1e3 / stats->read_ns : 0;
+
+  printf("%lu commands in %.3f ms\n", stats->commands, stats->wall_ns / 1e6);
+  printf("Read %lu bytes in %lu syscalls, %lu failed and %lu partial "
+         "reads\n",
+         stats->bytes_read, stats->syscalls, stats->failed_reads,
+         stats->partial_reads);
+  printf("Thread time: %.3f ms reading (%.1f MB/s), %.3f ms comparing\n",
+         stats->read_ns / 1e6, read_mb_per_s, stats->compare_ns / 1e6);
+  printf("Target stopped for %.3f ms in %lu stops\n", stats->stop_ns / 1e6,
+         stats->stops);
+  printf("Peak candidate memory: %zu bytes\n", stats->candidate_bytes);
+}
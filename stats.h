@@ -0,0 +1,35 @@
+#ifndef STATS_H
+#define STATS_H
+#include <stddef.h>
+
+// Counters and timers of one command, or of the session once added up. Each
+// scan thread counts into the stats of its own reader, which are added to
+// the main reader's after the join, so nothing on the hot path is shared.
+typedef struct {
+  unsigned long bytes_read;
+  unsigned long syscalls;
+  unsigned long failed_reads;  // Reads that got nothing back
+  unsigned long partial_reads; // Reads cut short by an unreadable page
+  unsigned long read_ns;       // Summed over threads
+  unsigned long compare_ns;    // Summed over threads
+  unsigned long stop_ns;       // Target kept stopped
+  unsigned long stops;
+  unsigned long wall_ns;
+  unsigned long commands;
+  size_t candidate_bytes; // Heap held by candidates, the peak once added up
+} Stats;
+
+Stats stats_create(void);
+
+// CLOCK_MONOTONIC in nanoseconds
+unsigned long stats_now_ns(void);
+
+// Adds from to to, keeping the larger of their candidate_bytes
+void stats_add(Stats *to, const Stats *from);
+
+// The summary line shown after each command
+void print_stats_line(const Stats *stats);
+
+void print_stats(const Stats *stats);
+
+#endif
@@ -53,18 +53,22 @@ void string_readfile(String *string, const char *filename) {
 
   if (fd == -1) {
     perror("open");
+    return;
   }
 
-  char read_buf[1];
+  char read_buf[4096];
 
   ssize_t bytes_read;
 
-  // This is poorly optimized as fuck
-  while ((bytes_read = read(fd, read_buf, 1)) != 0) {
+  while ((bytes_read = read(fd, read_buf, sizeof(read_buf))) != 0) {
     if (bytes_read == -1) {
       exit_error("Error reading from process file");
     }
 
-    string_insert(string, read_buf);
+    for (ssize_t i = 0; i < bytes_read; i++) {
+      string_insert(string, &read_buf[i]);
+    }
   }
+
+  close(fd);
 }
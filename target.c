@@ -0,0 +1,163 @@
+#include "target.h"
+#include "globals.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static bool is_number(const char *str) {
+  if (*str == '\0') {
+    return false;
+  }
+
+  for (; *str != '\0'; str++) {
+    if (*str < '0' || *str > '9') {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static int compare_pids(const void *a, const void *b) {
+  const unsigned long left = *(const unsigned long *)a;
+  const unsigned long right = *(const unsigned long *)b;
+
+  return (left > right) - (left < right);
+}
+
+void find_processes(const char *name, ULongArray *pids) {
+  const pid_t self = getpid();
+  char path[64];
+
+  if (is_number(name)) {
+    snprintf(path, sizeof(path), "/proc/%s", name);
+    if (access(path, F_OK) == 0) {
+      ulong_array_insert(pids, strtoul(name, NULL, 10));
+    }
+    return;
+  }
+
+  DIR *proc = opendir("/proc");
+  if (proc == NULL) {
+    exit_error("Error opening /proc");
+  }
+
+  const size_t begin = pids->size;
+  struct dirent *entry;
+
+  while ((entry = readdir(proc)) != NULL) {
+    if (!is_number(entry->d_name)) {
+      continue;
+    }
+
+    const pid_t pid = strtol(entry->d_name, NULL, 10);
+    char comm[TARGET_COMM_MAX + 2] = "";
+
+    snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+    FILE *file = fopen(path, "r");
+
+    // Processes may exit while the directory is walked
+    if (file == NULL) {
+      continue;
+    }
+    if (fgets(comm, sizeof(comm), file) == NULL) {
+      comm[0] = '\0';
+    }
+    fclose(file);
+
+    comm[strcspn(comm, "\n")] = '\0';
+    if (pid != self && strncmp(comm, name, TARGET_COMM_MAX) == 0 &&
+        strlen(comm) == (strlen(name) < TARGET_COMM_MAX ? strlen(name)
+                                                        : TARGET_COMM_MAX)) {
+      ulong_array_insert(pids, pid);
+    }
+  }
+
+  closedir(proc);
+  qsort(pids->items + begin, pids->size - begin, sizeof(unsigned long),
+        compare_pids);
+}
+
+Target *target_attach(const pid_t pid, const PauseMode mode,
+                      const size_t mem_limit, const bool incremental) {
+  if (ptrace(PTRACE_SEIZE, pid, NULL, NULL) == -1) {
+    fprintf(stderr, "Could not seize %d: ", pid);
+    perror("ptrace seize");
+    return NULL;
+  }
+
+  Target *target = malloc(sizeof(Target));
+  if (target == NULL) {
+    exit_error("Error allocating target");
+  }
+
+  target->pid = pid;
+  target->tracee = tracee_create(pid, mode);
+  target->reader = reader_create(pid);
+  target->reader.tracee = &target->tracee;
+  target->writer = writer_create(pid);
+  target->writer.tracee = &target->tracee;
+  target->freezer = freezer_create(pid);
+  target->region_map = region_map_create(pid);
+  target->regions = pmregion_array_create(256);
+  target->region_tracker = region_tracker_create();
+  target->tracker.pagemap_fd = -1;
+  target->results = scan_results_create();
+  target->session.map = NULL;
+  target->spill = spill_create(mem_limit);
+
+  // Only pages written to since the previous scan are read again by next
+  if (incremental) {
+    target->tracker = pagemap_create(pid);
+  }
+
+  return target;
+}
+
+bool target_alive(const Target *target) {
+  char path[64];
+  char stat[512];
+
+  snprintf(path, sizeof(path), "/proc/%d/stat", target->pid);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+
+  const bool got = fgets(stat, sizeof(stat), file) != NULL;
+  fclose(file);
+
+  // The state follows the name, which is in parentheses and may hold any
+  // character
+  const char *name_end = got ? strrchr(stat, ')') : NULL;
+  return name_end != NULL && name_end[1] == ' ' && name_end[2] != 'Z' &&
+         name_end[2] != 'X';
+}
+
+void target_detach(Target *target) {
+  // Detaching needs a stopped target, a process that exited is reaped
+  // instead so that its parent can see it go
+  if (target_alive(target)) {
+    tracee_stop(&target->tracee);
+  } else {
+    waitpid(target->pid, NULL, WNOHANG | __WALL);
+  }
+
+  reader_destroy(&target->reader);
+  writer_destroy(&target->writer);
+  freezer_destroy(&target->freezer);
+  pagemap_destroy(&target->tracker);
+  region_map_destroy(&target->region_map);
+  region_tracker_destroy(&target->region_tracker);
+  scan_results_clear(&target->results);
+  session_unmap(&target->session);
+  spill_destroy(&target->spill);
+  pmregion_array_destroy(&target->regions);
+
+  ptrace(PTRACE_DETACH, target->pid, NULL, NULL);
+  free(target);
+}
@@ -0,0 +1,56 @@
+#ifndef TARGET_H
+#define TARGET_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "freezer.h"
+#include "pagemap.h"
+#include "reader.h"
+#include "region_tracker.h"
+#include "regions.h"
+#include "results.h"
+#include "session.h"
+#include "spill.h"
+#include "tracee.h"
+#include "ulong_array.h"
+#include "writer.h"
+
+// /proc/<pid>/comm holds at most this many characters of a name
+#define TARGET_COMM_MAX 15
+
+// A process attached to, with its memory and the candidates found in it.
+// Targets are allocated one at a time and never move, since their reader
+// and writer point at their tracee.
+typedef struct {
+  pid_t pid;
+  Tracee tracee;
+  MemoryReader reader;
+  MemoryWriter writer;
+  Freezer freezer;
+  RegionMap region_map;
+  PMRegionArray regions;
+  RegionTracker region_tracker;
+  PageTracker tracker; // pagemap_fd is -1 unless scans are incremental
+  ScanResults results;
+  Session session;
+  Spill spill;
+} Target;
+
+// Adds to pids every process but this one whose comm is name, cut to
+// TARGET_COMM_MAX characters as the kernel does, in increasing order.
+// A name made of digits is taken as a pid. Walks /proc, nothing is forked.
+void find_processes(const char *name, ULongArray *pids);
+
+// Seizes pid and sets up everything kept about it. Returns NULL, after
+// printing why, if it can't be seized.
+Target *target_attach(pid_t pid, PauseMode mode, size_t mem_limit,
+                      bool incremental);
+
+// Whether the process is still running, rather than gone or a zombie
+bool target_alive(const Target *target);
+
+// Frees the target and detaches from its process, which keeps running
+void target_detach(Target *target);
+
+#endif
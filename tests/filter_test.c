@@ -0,0 +1,99 @@
+// Checks that the kernel a first scan compiles a filter to finds the same
+// values as filter_match, which next uses, for bounds past the type's range.
+// Build and run with make test.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../filter.h"
+#include "../kernels.h"
+#include "../ulong_array.h"
+#include "../value_type.h"
+
+// Every value of 8 and 16 bit types, and a spread of 32 and 64 bit ones
+#define SAMPLES 65536
+
+typedef struct {
+  ValueType type;
+  const char *args;
+} Case;
+
+static const Case cases[] = {
+    {INT8, "< 1000"},         {INT8, "> 1000"},
+    {INT8, "> -1000"},        {INT8, "< -1000"},
+    {INT8, "between -300 300"}, {INT8, "between 200 300"},
+    {UINT8, "between 0 300"}, {UINT8, "< 256"},
+    {UINT8, "> 255"},         {INT16, "> -40000"},
+    {INT16, "< 40000"},       {INT16, "between -70000 -100"},
+    {UINT16, "between 10 70000"}, {INT32, "> -3000000000"},
+    {INT32, "< 3000000000"},  {UINT32, "between 5 5000000000"},
+};
+
+static size_t fill(const ValueType type, unsigned char *buf) {
+  const size_t width = get_byte_count(type);
+
+  for (size_t i = 0; i < SAMPLES; i++) {
+    unsigned long bits = i;
+    if (width > 2) {
+      bits = (unsigned long)i * 0x9E3779B97F4A7C15UL;
+    }
+    memcpy(buf + i * width, &bits, width);
+  }
+
+  return width;
+}
+
+static bool check(const Case *test, unsigned char *buf) {
+  char args[64];
+  snprintf(args, sizeof(args), "%s", test->args);
+
+  const size_t width = fill(test->type, buf);
+  Filter filter;
+  if (!filter_parse(&filter, test->type, width, strtok(args, " "))) {
+    printf("FAIL %s %s: does not parse\n", value_type_name(test->type),
+           test->args);
+    return false;
+  }
+
+  KernelArgs kernel_args;
+  const KernelOp op = filter_compile(&filter, &kernel_args);
+  ULongArray hits = ulong_array_create(1024);
+  kernel_match_strided(kernel_select(test->type, op), width, width, buf,
+                       SAMPLES * width, SAMPLES * width, 0, &kernel_args,
+                       &hits);
+
+  size_t expected = 0;
+  size_t hit = 0;
+  bool same = true;
+  for (size_t i = 0; i < SAMPLES; i++) {
+    const bool match = filter_match(&filter, NULL, buf + i * width);
+    const bool found = hit < hits.size && hits.items[hit] == i * width;
+
+    expected += match;
+    hit += found;
+    same = same && match == found;
+  }
+
+  printf("%s %s %s: kernel found %zu, filter_match %zu\n",
+         same ? "ok  " : "FAIL", value_type_name(test->type), test->args,
+         hits.size, expected);
+  ulong_array_destroy(&hits);
+
+  return same && hit == hits.size;
+}
+
+int main(void) {
+  unsigned char *buf = malloc(SAMPLES * sizeof(unsigned long));
+  size_t failed = 0;
+
+  if (buf == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    failed += !check(&cases[i], buf);
+  }
+
+  free(buf);
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
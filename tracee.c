@@ -0,0 +1,96 @@
+#include "tracee.h"
+#include "globals.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+Tracee tracee_create(const pid_t pid, const PauseMode mode) {
+  Tracee tracee;
+  tracee.pid = pid;
+  tracee.mode = mode;
+  tracee.stopped = false;
+  tracee.stopped_ns = 0;
+  tracee.stop_count = 0;
+
+  return tracee;
+}
+
+bool tracee_stop(Tracee *tracee) {
+  if (tracee->stopped) {
+    return true;
+  }
+
+  int status = 0;
+
+  ptrace(PTRACE_INTERRUPT, tracee->pid, NULL, NULL);
+
+  if (waitpid(tracee->pid, &status, 0) == -1) {
+    perror("waitpid");
+    return false;
+  }
+
+  if (!WIFSTOPPED(status)) {
+    return false;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &tracee->stopped_at);
+  tracee->stopped = true;
+  tracee->stop_count++;
+
+  return true;
+}
+
+void tracee_resume(Tracee *tracee) {
+  if (!tracee->stopped) {
+    return;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  tracee->stopped_ns +=
+      (now.tv_sec - tracee->stopped_at.tv_sec) * 1000000000UL +
+      now.tv_nsec - tracee->stopped_at.tv_nsec;
+
+  if (ptrace(PTRACE_CONT, tracee->pid, NULL, 0) == -1) {
+    exit_error("Error continuing process");
+  }
+
+  tracee->stopped = false;
+}
+
+unsigned long tracee_take_stop_time(Tracee *tracee) {
+  const unsigned long stopped_ns = tracee->stopped_ns;
+  tracee->stopped_ns = 0;
+  tracee->stop_count = 0;
+
+  return stopped_ns;
+}
+
+bool pause_mode_parse(PauseMode *mode, const char *mode_str) {
+  if (mode_str == NULL) {
+    return false;
+  }
+
+  for (PauseMode m = PAUSE_NONE; m <= PAUSE_FULL; m++) {
+    if (strcmp(mode_str, pause_mode_name(m)) == 0) {
+      *mode = m;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+const char *pause_mode_name(const PauseMode mode) {
+  switch (mode) {
+  case PAUSE_NONE:
+    return "none";
+  case PAUSE_CHUNK:
+    return "chunk";
+  case PAUSE_FULL:
+    return "full";
+  default:
+    return "unknown";
+  }
+}
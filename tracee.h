@@ -0,0 +1,40 @@
+#ifndef TRACEE_H
+#define TRACEE_H
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+
+typedef enum {
+  PAUSE_NONE,  // The target keeps running, memory is read as it changes
+  PAUSE_CHUNK, // The target is stopped around each chunk read
+  PAUSE_FULL,  // The target is stopped for the whole command
+} PauseMode;
+
+// The seized target, along with how long it was kept stopped
+typedef struct {
+  pid_t pid;
+  PauseMode mode;
+  bool stopped;
+  struct timespec stopped_at;
+  unsigned long stopped_ns; // Since the last tracee_take_stop_time
+  unsigned long stop_count;
+} Tracee;
+
+Tracee tracee_create(pid_t pid, PauseMode mode);
+
+// Stops the target unless it already is. Only works from the thread that
+// seized it. Returns false if the target could not be stopped.
+bool tracee_stop(Tracee *tracee);
+
+// Lets a stopped target run again
+void tracee_resume(Tracee *tracee);
+
+// Total stop time since the last call, in nanoseconds. Also resets
+// stop_count.
+unsigned long tracee_take_stop_time(Tracee *tracee);
+
+bool pause_mode_parse(PauseMode *mode, const char *mode_str);
+
+const char *pause_mode_name(PauseMode mode);
+
+#endif
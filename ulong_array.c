@@ -0,0 +1,58 @@
+#include "ulong_array.h"
+#include "globals.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+ULongArray ulong_array_create(const size_t capacity) {
+  ULongArray array;
+  array.capacity = capacity;
+  array.size = 0;
+  array.items = calloc(array.capacity, sizeof(unsigned long));
+
+  return array;
+}
+
+void ulong_array_destroy(const ULongArray *array) { free(array->items); }
+
+void ulong_array_insert(ULongArray *array, const unsigned long item) {
+  if (array->size >= array->capacity) {
+    array->capacity *= GROWTH_FACTOR;
+    unsigned long *items =
+        realloc(array->items, array->capacity * sizeof(unsigned long));
+
+    if (items == NULL) {
+      perror("reallocate");
+      exit(EXIT_FAILURE);
+    }
+
+    array->items = items;
+  }
+
+  array->items[array->size] = item;
+  array->size++;
+}
+
+void ulong_array_extend(ULongArray *array, const unsigned long *items,
+                        const size_t count) {
+  if (array->size + count > array->capacity) {
+    while (array->size + count > array->capacity) {
+      array->capacity *= GROWTH_FACTOR;
+    }
+
+    unsigned long *grown =
+        realloc(array->items, array->capacity * sizeof(unsigned long));
+
+    if (grown == NULL) {
+      perror("reallocate");
+      exit(EXIT_FAILURE);
+    }
+
+    array->items = grown;
+  }
+
+  memcpy(array->items + array->size, items, count * sizeof(unsigned long));
+  array->size += count;
+}
+
+void ulong_array_clear(ULongArray *array) { array->size = 0; }
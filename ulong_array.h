@@ -0,0 +1,22 @@
+#ifndef ULONG_ARRAY_H
+#define ULONG_ARRAY_H
+#include <stddef.h>
+
+typedef struct {
+  size_t size;
+  size_t capacity;
+  unsigned long *items;
+} ULongArray;
+
+ULongArray ulong_array_create(size_t capacity);
+
+void ulong_array_destroy(const ULongArray *array);
+
+void ulong_array_insert(ULongArray *array, unsigned long item);
+
+void ulong_array_extend(ULongArray *array, const unsigned long *items,
+                        size_t count);
+
+void ulong_array_clear(ULongArray *array);
+
+#endif
@@ -1,9 +1,24 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "value_type.h"
 #include "globals.h"
 #include "strings.h"
 
 ValueType parse_argtype(char *type_str) {
+  const ValueType type = value_type_parse(type_str);
+
+  if (type == UNKNOWN) {
+    exit_error("Invalid type");
+  }
+
+  return type;
+}
+
+ValueType value_type_parse(char *type_str) {
   to_lowercase(type_str);
 
   // Signed Integers
@@ -42,6 +57,314 @@ ValueType parse_argtype(char *type_str) {
     return DOUBLE64;
   }
 
-  exit_error("Invalid type");
+  if (strcmp(type_str, "string") == 0) {
+    return STRING;
+  }
+
   return UNKNOWN;
 }
+
+const char *value_type_name(const ValueType type) {
+  static const char *names[] = {
+      [INT8] = "int8",       [INT16] = "int16",       [INT32] = "int32",
+      [INT64] = "int64",     [UINT8] = "uint8",       [UINT16] = "uint16",
+      [UINT32] = "uint32",   [UINT64] = "uint64",     [FLOAT32] = "float32",
+      [DOUBLE64] = "double64", [STRING] = "string",
+  };
+
+  return type < UNKNOWN ? names[type] : "unknown";
+}
+
+size_t get_byte_count(const ValueType type) {
+  switch (type) {
+  case INT8:
+  case UINT8:
+    return sizeof(int8_t);
+  case INT16:
+  case UINT16:
+    return sizeof(int16_t);
+  case INT32:
+  case UINT32:
+  case FLOAT32:
+    return sizeof(int32_t);
+  case INT64:
+  case UINT64:
+  case DOUBLE64:
+    return sizeof(int64_t);
+
+  case STRING:
+    return 0; // Patterns take the width of their candidate set
+
+  default:
+    exit_error("Invalid type");
+    return 0;
+  }
+}
+
+bool is_float_type(const ValueType type) {
+  return type == FLOAT32 || type == DOUBLE64;
+}
+
+bool is_signed_type(const ValueType type) {
+  return type == INT8 || type == INT16 || type == INT32 || type == INT64;
+}
+
+Value value_load(const ValueType type, const unsigned char *bytes) {
+  Value value = {0};
+
+  switch (type) {
+  case INT8:
+    value.i = *(const int8_t *)bytes;
+    break;
+  case INT16: {
+    int16_t v;
+    memcpy(&v, bytes, sizeof(v));
+    value.i = v;
+    break;
+  }
+  case INT32: {
+    int32_t v;
+    memcpy(&v, bytes, sizeof(v));
+    value.i = v;
+    break;
+  }
+  case INT64:
+    memcpy(&value.i, bytes, sizeof(value.i));
+    break;
+
+  case UINT8:
+    value.u = *bytes;
+    break;
+  case UINT16: {
+    uint16_t v;
+    memcpy(&v, bytes, sizeof(v));
+    value.u = v;
+    break;
+  }
+  case UINT32: {
+    uint32_t v;
+    memcpy(&v, bytes, sizeof(v));
+    value.u = v;
+    break;
+  }
+  case UINT64:
+    memcpy(&value.u, bytes, sizeof(value.u));
+    break;
+
+  case FLOAT32: {
+    float v;
+    memcpy(&v, bytes, sizeof(v));
+    value.f = v;
+    break;
+  }
+  case DOUBLE64:
+    memcpy(&value.f, bytes, sizeof(value.f));
+    break;
+
+  default:
+    exit_error("Invalid type");
+  }
+
+  return value;
+}
+
+unsigned long value_bits(const ValueType type, const Value value) {
+  unsigned long bits = 0;
+
+  if (type == FLOAT32) {
+    const float f = (float)value.f;
+    memcpy(&bits, &f, sizeof(f));
+  } else if (type == DOUBLE64) {
+    memcpy(&bits, &value.f, sizeof(value.f));
+  } else {
+    const size_t byte_count = get_byte_count(type);
+    bits = byte_count == 8 ? value.u : value.u & ((1UL << (byte_count * 8)) - 1);
+  }
+
+  return bits;
+}
+
+Value value_parse(const ValueType type, const char *str) {
+  Value value;
+
+  if (type == FLOAT32) {
+    // Round now so comparisons against loaded float32 values are exact
+    value.f = (float)strtod(str, NULL);
+  } else if (type == DOUBLE64) {
+    value.f = strtod(str, NULL);
+  } else if (is_signed_type(type)) {
+    value.i = strtol(str, NULL, 10);
+  } else {
+    value.u = strtoul(str, NULL, 10);
+  }
+
+  return value;
+}
+
+bool value_try_parse(const ValueType type, const char *str, Value *value) {
+  char *end;
+
+  if (is_float_type(type)) {
+    value->f = strtod(str, &end);
+    if (type == FLOAT32) {
+      value->f = (float)value->f;
+    }
+    return end != str && *end == '\0';
+  }
+
+  if (is_signed_type(type)) {
+    value->i = strtol(str, &end, 10);
+  } else if (str[strspn(str, " ")] == '-') {
+    return false;
+  } else {
+    value->u = strtoul(str, &end, 10);
+  }
+
+  return end != str && *end == '\0' &&
+         value_compare(type, *value, value_min(type)) != -1 &&
+         value_compare(type, *value, value_max(type)) != 1;
+}
+
+void value_format(const ValueType type, const Value value, char *out,
+                  const size_t size) {
+  if (is_float_type(type)) {
+    snprintf(out, size, "%f", value.f);
+  } else if (is_signed_type(type)) {
+    snprintf(out, size, "%ld", value.i);
+  } else {
+    snprintf(out, size, "%lu", value.u);
+  }
+}
+
+int value_compare(const ValueType type, const Value a, const Value b) {
+  if (is_float_type(type)) {
+    if (a.f < b.f) {
+      return -1;
+    }
+    if (a.f > b.f) {
+      return 1;
+    }
+    // Equal, or unordered when either side is NaN
+    return a.f == b.f ? 0 : 2;
+  }
+
+  if (is_signed_type(type)) {
+    return (a.i > b.i) - (a.i < b.i);
+  }
+
+  return (a.u > b.u) - (a.u < b.u);
+}
+
+Value value_min(const ValueType type) {
+  Value value;
+
+  if (is_float_type(type)) {
+    value.f = -INFINITY;
+  } else if (is_signed_type(type)) {
+    value.i = -(long)(1UL << (get_byte_count(type) * 8 - 1));
+  } else {
+    value.u = 0;
+  }
+
+  return value;
+}
+
+Value value_max(const ValueType type) {
+  Value value;
+
+  if (is_float_type(type)) {
+    value.f = INFINITY;
+  } else if (is_signed_type(type)) {
+    value.i = (long)((1UL << (get_byte_count(type) * 8 - 1)) - 1);
+  } else {
+    value.u = value_bits(type, (Value){.i = -1});
+  }
+
+  return value;
+}
+
+Value value_step(const ValueType type, Value value, const int direction) {
+  if (type == FLOAT32) {
+    value.f = nextafterf((float)value.f, direction * INFINITY);
+  } else if (type == DOUBLE64) {
+    value.f = nextafter(value.f, direction * INFINITY);
+  } else if (is_signed_type(type)) {
+    value.i += direction;
+  } else {
+    value.u += direction;
+  }
+
+  return value;
+}
+
+// Digits after the decimal point of a number as written, 0 for integers
+static int decimal_places(const char *str) {
+  const char *dot = strchr(str, '.');
+  int places = 0;
+
+  if (dot == NULL) {
+    return 0;
+  }
+
+  for (const char *c = dot + 1; isdigit((unsigned char)*c); c++) {
+    places++;
+  }
+
+  return places;
+}
+
+void value_float_range(const ValueType type, const char *str,
+                       const FloatMatch match, const double eps, Value *low,
+                       Value *high) {
+  const double target = strtod(str, NULL);
+  double unit = 1.0;
+  double lo = target;
+  double hi = target;
+  bool lo_open = false;
+  bool hi_open = false;
+
+  for (int i = decimal_places(str); i > 0; i--) {
+    unit /= 10;
+  }
+
+  switch (match) {
+  case FLOAT_EPSILON:
+    lo = target - eps;
+    hi = target + eps;
+    break;
+  case FLOAT_ROUNDED:
+    lo = target - unit / 2;
+    hi = target + unit / 2;
+    hi_open = true;
+    break;
+  case FLOAT_TRUNCATED:
+    // Truncation goes towards zero
+    if (str[strspn(str, " ")] == '-') {
+      lo = target - unit;
+      lo_open = true;
+    } else {
+      hi = target + unit;
+      hi_open = true;
+    }
+    break;
+  default:
+    break;
+  }
+
+  // Narrows the bounds to the nearest values of the type inside the range
+  if (type == FLOAT32) {
+    float flo = (float)lo;
+    float fhi = (float)hi;
+    if (flo < lo || (lo_open && flo == lo)) {
+      flo = nextafterf(flo, INFINITY);
+    }
+    if (fhi > hi || (hi_open && fhi == hi)) {
+      fhi = nextafterf(fhi, -INFINITY);
+    }
+    low->f = flo;
+    high->f = fhi;
+  } else {
+    low->f = lo_open ? nextafter(lo, INFINITY) : lo;
+    high->f = hi_open ? nextafter(hi, -INFINITY) : hi;
+  }
+}
@@ -1,5 +1,8 @@
 #ifndef VALUE_TYPE_H
 #define VALUE_TYPE_H
+#include <stdbool.h>
+#include <stddef.h>
+
 typedef enum {
   // Signed Integers
   INT8,
@@ -22,5 +25,63 @@ typedef enum {
   UNKNOWN,
 } ValueType;
 
+// A value widened to 64 bits: i for signed types, u for unsigned ones and f
+// for floats
+typedef union {
+  long i;
+  unsigned long u;
+  double f;
+} Value;
+
+// How a float target given as text matches the values in memory
+typedef enum {
+  FLOAT_EXACT,     // == the target
+  FLOAT_EPSILON,   // Within eps of the target
+  FLOAT_ROUNDED,   // Rounds to the target at as many decimals as it has
+  FLOAT_TRUNCATED, // Truncates to the target at as many decimals as it has
+} FloatMatch;
+
 ValueType parse_argtype(char *type_str);
+
+// Like parse_argtype, but returns UNKNOWN on an unknown type instead of
+// exiting
+ValueType value_type_parse(char *type_str);
+
+const char *value_type_name(ValueType type);
+
+size_t get_byte_count(ValueType type);
+
+bool is_float_type(ValueType type);
+
+bool is_signed_type(ValueType type);
+
+// Widens the little-endian bytes of a value of the given type
+Value value_load(ValueType type, const unsigned char *bytes);
+
+// Narrows a value back to the type's bytes, in the low bytes of the result
+unsigned long value_bits(ValueType type, Value value);
+
+Value value_parse(ValueType type, const char *str);
+
+// Parses the whole of str as a value of type. Returns false when it is not
+// one, or lies outside the type's range.
+bool value_try_parse(ValueType type, const char *str, Value *value);
+
+void value_format(ValueType type, Value value, char *out, size_t size);
+
+// The smallest and largest values of a type, infinities for floats
+Value value_min(ValueType type);
+
+Value value_max(ValueType type);
+
+// The next value of the type up or down, by the direction's sign
+Value value_step(ValueType type, Value value, int direction);
+
+// The values of a float type that match str, as a closed range of values
+// the type can hold
+void value_float_range(ValueType type, const char *str, FloatMatch match,
+                       double eps, Value *low, Value *high);
+
+// Returns -1, 0 or 1, or 2 when a float comparison is unordered (NaN)
+int value_compare(ValueType type, Value a, Value b);
 #endif
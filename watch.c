@@ -0,0 +1,448 @@
+#define _GNU_SOURCE
+#include "watch.h"
+#include "globals.h"
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "ulong_array.h"
+
+#if defined(__x86_64__)
+#define WATCH_X86
+#endif
+
+// Older glibc only has the kernel's name for it
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+#define DR_STATUS 6
+#define DR_CONTROL 7
+#define DR_STATUS_HITS 0xFUL // Which of DR0 to DR3 fired
+#define WATCH_TICK_NS 50000000L // How late a watch may end, 50ms
+
+bool watch_create(Watch *watch, const unsigned long address, const size_t len,
+                  const bool reads) {
+  watch->address = address;
+  watch->len = len;
+  watch->reads = reads;
+  watch->slot_count = 0;
+  watch->capacity = 0;
+  watch->count = 0;
+  watch->sites = NULL;
+  watch->hits = 0;
+  watch->threads = 0;
+
+  // Each slot is the largest aligned piece that fits at its start
+  unsigned long at = address;
+  while (at < address + len) {
+    size_t slot_len = 8;
+    while (at % slot_len != 0 || at + slot_len > address + len) {
+      slot_len /= 2;
+    }
+
+    if (watch->slot_count == WATCH_SLOTS) {
+      return false;
+    }
+
+    watch->slots[watch->slot_count] = at;
+    watch->slot_lens[watch->slot_count] = slot_len;
+    watch->slot_count++;
+    at += slot_len;
+  }
+
+  return len > 0;
+}
+
+void watch_destroy(Watch *watch) {
+  free(watch->sites);
+  watch->sites = NULL;
+  watch->capacity = 0;
+  watch->count = 0;
+}
+
+#ifdef WATCH_X86
+
+static size_t site_slot(const WatchSite *sites, const size_t capacity,
+                        const unsigned long rip) {
+  size_t i = (rip * 0x9E3779B97F4A7C15UL) & (capacity - 1);
+
+  while (sites[i].rip != 0 && sites[i].rip != rip) {
+    i = (i + 1) & (capacity - 1);
+  }
+
+  return i;
+}
+
+static void watch_grow(Watch *watch) {
+  const size_t capacity =
+      watch->capacity > 0 ? watch->capacity * GROWTH_FACTOR : 64;
+  WatchSite *sites = calloc(capacity, sizeof(WatchSite));
+
+  if (sites == NULL) {
+    exit_error("Error allocating watch sites");
+  }
+
+  for (size_t i = 0; i < watch->capacity; i++) {
+    if (watch->sites[i].rip != 0) {
+      sites[site_slot(sites, capacity, watch->sites[i].rip)] =
+          watch->sites[i];
+    }
+  }
+
+  free(watch->sites);
+  watch->sites = sites;
+  watch->capacity = capacity;
+}
+
+static void watch_hit(Watch *watch, const pid_t tid) {
+  struct user_regs_struct regs;
+
+  if (ptrace(PTRACE_GETREGS, tid, NULL, &regs) == -1) {
+    return;
+  }
+
+  // Kept at most half full
+  if ((watch->count + 1) * 2 > watch->capacity) {
+    watch_grow(watch);
+  }
+
+  WatchSite *site =
+      &watch->sites[site_slot(watch->sites, watch->capacity, regs.rip)];
+  if (site->rip == 0) {
+    site->rip = regs.rip;
+    site->regs = regs;
+    watch->count++;
+  }
+
+  site->hits++;
+  watch->hits++;
+}
+
+static bool set_debug_register(const pid_t tid, const size_t index,
+                               const unsigned long value) {
+  const size_t offset =
+      offsetof(struct user, u_debugreg) + index * sizeof(unsigned long);
+
+  return ptrace(PTRACE_POKEUSER, tid, offset, value) != -1;
+}
+
+static unsigned long get_debug_register(const pid_t tid, const size_t index) {
+  const size_t offset =
+      offsetof(struct user, u_debugreg) + index * sizeof(unsigned long);
+
+  return ptrace(PTRACE_PEEKUSER, tid, offset, NULL);
+}
+
+// DR7: a local enable bit per slot, then its access and length bits
+static unsigned long watch_control(const Watch *watch) {
+  unsigned long control = 0;
+
+  for (size_t i = 0; i < watch->slot_count; i++) {
+    // 1, 2, 8 and 4 bytes are encoded as 0 to 3
+    static const unsigned long LEN_BITS[] = {[1] = 0, [2] = 1, [4] = 3,
+                                             [8] = 2};
+    const unsigned long len_bits = LEN_BITS[watch->slot_lens[i]];
+    const unsigned long access_bits = watch->reads ? 3 : 1;
+
+    control |= 1UL << (i * 2);
+    control |= (access_bits | len_bits << 2) << (16 + i * 4);
+  }
+
+  return control;
+}
+
+static bool watch_arm(const Watch *watch, const pid_t tid) {
+  for (size_t i = 0; i < watch->slot_count; i++) {
+    if (!set_debug_register(tid, i, watch->slots[i])) {
+      return false;
+    }
+  }
+
+  return set_debug_register(tid, DR_CONTROL, watch_control(watch));
+}
+
+static void watch_disarm(const pid_t tid) {
+  set_debug_register(tid, DR_CONTROL, 0);
+  set_debug_register(tid, DR_STATUS, 0);
+}
+
+// Counts a hit and lets the thread go on, or delivers the signal that
+// stopped it. Group stops are resumed like the tracee does.
+static void watch_handle_stop(Watch *watch, const pid_t tid,
+                              const int status) {
+  int signal = WSTOPSIG(status);
+
+  if (status >> 16 == PTRACE_EVENT_STOP) {
+    signal = 0;
+  } else if (signal == SIGTRAP &&
+             (get_debug_register(tid, DR_STATUS) & DR_STATUS_HITS) != 0) {
+    watch_hit(watch, tid);
+    set_debug_register(tid, DR_STATUS, 0);
+    signal = 0;
+  }
+
+  ptrace(PTRACE_CONT, tid, NULL, signal);
+}
+
+// Interrupts a seized thread and waits until it stops, handling the stops
+// that come first. Returns false if it is gone.
+static bool watch_stop_thread(Watch *watch, const pid_t tid) {
+  int status;
+
+  ptrace(PTRACE_INTERRUPT, tid, NULL, NULL);
+
+  while (true) {
+    if (waitpid(tid, &status, __WALL) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+
+    if (!WIFSTOPPED(status)) {
+      return false;
+    }
+
+    if (status >> 16 == PTRACE_EVENT_STOP) {
+      return true;
+    }
+
+    watch_handle_stop(watch, tid, status);
+  }
+}
+
+// Seizes and stops every thread of the stopped tracee, which comes first
+static ULongArray watch_seize_threads(Watch *watch, const pid_t pid) {
+  ULongArray threads = ulong_array_create(16);
+  char task_path[64];
+
+  ulong_array_insert(&threads, pid);
+  snprintf(task_path, sizeof(task_path), "/proc/%d/task", pid);
+
+  DIR *task = opendir(task_path);
+  if (task == NULL) {
+    return threads;
+  }
+
+  const struct dirent *entry;
+  while ((entry = readdir(task)) != NULL) {
+    const pid_t tid = strtol(entry->d_name, NULL, 10);
+
+    if (tid <= 0 || tid == pid) {
+      continue;
+    }
+
+    if (ptrace(PTRACE_SEIZE, tid, NULL, NULL) == -1) {
+      continue;
+    }
+
+    if (watch_stop_thread(watch, tid)) {
+      ulong_array_insert(&threads, tid);
+    }
+  }
+
+  closedir(task);
+  return threads;
+}
+
+static void watch_tick(const int signal) { (void)signal; }
+
+// Handles every stop until ms have passed. A timer signal on this thread
+// wakes waitpid up when nothing happens.
+static void watch_loop(Watch *watch, const pid_t pid, const unsigned long ms) {
+  // No SA_RESTART, so waitpid returns on every tick
+  struct sigaction action = {.sa_handler = watch_tick};
+  struct sigaction old_action;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGALRM, &action, &old_action);
+
+  struct sigevent event = {
+      .sigev_notify = SIGEV_THREAD_ID,
+      .sigev_signo = SIGALRM,
+  };
+  event.sigev_notify_thread_id = gettid();
+
+  timer_t timer;
+  if (timer_create(CLOCK_MONOTONIC, &event, &timer) == -1) {
+    exit_error("Error creating watch timer");
+  }
+
+  const struct itimerspec tick = {
+      .it_value = {.tv_nsec = WATCH_TICK_NS},
+      .it_interval = {.tv_nsec = WATCH_TICK_NS},
+  };
+  timer_settime(timer, 0, &tick, NULL);
+
+  const unsigned long deadline = stats_now_ns() + ms * 1000000UL;
+
+  while (stats_now_ns() < deadline) {
+    int status;
+    const pid_t tid = waitpid(-1, &status, __WALL);
+
+    if (tid == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    if (WIFSTOPPED(status)) {
+      watch_handle_stop(watch, tid, status);
+    } else if (tid == pid) {
+      printf("Target exited while watching\n");
+      break;
+    }
+  }
+
+  timer_delete(timer);
+  sigaction(SIGALRM, &old_action, NULL);
+}
+
+bool watch_run(Watch *watch, Tracee *tracee, const unsigned long ms) {
+  if (!tracee_stop(tracee)) {
+    return false;
+  }
+
+  ULongArray threads = watch_seize_threads(watch, tracee->pid);
+  bool armed = true;
+
+  for (size_t i = 0; i < threads.size && armed; i++) {
+    armed = watch_arm(watch, threads.items[i]);
+  }
+
+  if (!armed) {
+    perror("Error setting debug registers");
+  } else {
+    watch->threads = threads.size;
+
+    for (size_t i = 1; i < threads.size; i++) {
+      ptrace(PTRACE_CONT, threads.items[i], NULL, 0);
+    }
+    tracee_resume(tracee);
+
+    watch_loop(watch, tracee->pid, ms);
+
+    // Stopped again to clear the registers, hits on the way still count
+    for (size_t i = 0; i < threads.size; i++) {
+      if (!watch_stop_thread(watch, threads.items[i])) {
+        threads.items[i] = 0;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < threads.size; i++) {
+    const pid_t tid = threads.items[i];
+
+    if (tid == 0) {
+      continue;
+    }
+
+    watch_disarm(tid);
+    if (tid != tracee->pid) {
+      ptrace(PTRACE_DETACH, tid, NULL, 0);
+    } else if (armed) {
+      // The tracee only knows of its own stops
+      ptrace(PTRACE_CONT, tid, NULL, 0);
+    }
+  }
+
+  ulong_array_destroy(&threads);
+  return armed;
+}
+
+static int compare_sites(const void *a, const void *b) {
+  const WatchSite *left = *(const WatchSite *const *)a;
+  const WatchSite *right = *(const WatchSite *const *)b;
+
+  return (left->hits < right->hits) - (left->hits > right->hits);
+}
+
+static void print_site(const WatchSite *site, const RegionMap *map) {
+  const ProcessMemoryRegion *region = NULL;
+
+  for (size_t i = 0; i < map->regions.size && region == NULL; i++) {
+    if (map->regions.regions[i].start <= site->rip &&
+        site->rip < map->regions.regions[i].end) {
+      region = &map->regions.regions[i];
+    }
+  }
+
+  if (region == NULL) {
+    printf("%lu hits at 0x%lx\n", site->hits, site->rip);
+  } else {
+    const char *name = strrchr(region->path, '/') != NULL
+                           ? strrchr(region->path, '/') + 1
+                           : region->path;
+
+    printf("%lu hits at 0x%lx, %s+0x%lx\n", site->hits, site->rip,
+           name[0] != '\0' ? name : region_kind_name(region->kind),
+           site->rip - region->start + region->offset);
+  }
+
+  const struct user_regs_struct *regs = &site->regs;
+  printf("  rax %016llx rbx %016llx rcx %016llx rdx %016llx\n", regs->rax,
+         regs->rbx, regs->rcx, regs->rdx);
+  printf("  rsi %016llx rdi %016llx rbp %016llx rsp %016llx\n", regs->rsi,
+         regs->rdi, regs->rbp, regs->rsp);
+  printf("  r8  %016llx r9  %016llx r10 %016llx r11 %016llx\n", regs->r8,
+         regs->r9, regs->r10, regs->r11);
+  printf("  r12 %016llx r13 %016llx r14 %016llx r15 %016llx\n", regs->r12,
+         regs->r13, regs->r14, regs->r15);
+}
+
+void print_watch(const Watch *watch, const RegionMap *map,
+                 const size_t limit) {
+  printf("%lu hits from %zu instructions on %zu threads, rip is just past "
+         "each\n",
+         watch->hits, watch->count, watch->threads);
+
+  const WatchSite **sites = malloc((watch->count + 1) * sizeof(WatchSite *));
+  if (sites == NULL) {
+    exit_error("Error allocating watch sites");
+  }
+
+  size_t n = 0;
+  for (size_t i = 0; i < watch->capacity; i++) {
+    if (watch->sites[i].rip != 0) {
+      sites[n++] = &watch->sites[i];
+    }
+  }
+
+  qsort(sites, n, sizeof(WatchSite *), compare_sites);
+
+  for (size_t i = 0; i < n && i < limit; i++) {
+    print_site(sites[i], map);
+  }
+
+  free(sites);
+}
+
+#else
+
+bool watch_run(Watch *watch, Tracee *tracee, const unsigned long ms) {
+  (void)watch;
+  (void)tracee;
+  (void)ms;
+  printf("Watchpoints need the x86-64 debug registers\n");
+
+  return false;
+}
+
+void print_watch(const Watch *watch, const RegionMap *map,
+                 const size_t limit) {
+  (void)watch;
+  (void)map;
+  (void)limit;
+}
+
+#endif
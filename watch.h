@@ -0,0 +1,55 @@
+#ifndef WATCH_H
+#define WATCH_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include "regions.h"
+#include "tracee.h"
+
+#define WATCH_SLOTS 4 // DR0 to DR3
+
+// An instruction that touched the watched range. Data breakpoints trap once
+// the instruction is done, so rip is just past it.
+typedef struct {
+  unsigned long rip;
+  unsigned long hits;
+  struct user_regs_struct regs; // As of its first hit
+} WatchSite;
+
+// A range watched through the debug registers of every thread of the
+// target, split into up to four aligned slots of 1, 2, 4 or 8 bytes. Hits
+// are counted per instruction in an open addressing table keyed by rip, so
+// a site firing thousands of times a second costs one counter.
+typedef struct {
+  unsigned long address;
+  size_t len;
+  bool reads; // Reads trap too, not only writes
+  unsigned long slots[WATCH_SLOTS];
+  size_t slot_lens[WATCH_SLOTS];
+  size_t slot_count;
+  size_t capacity;
+  size_t count;
+  WatchSite *sites;
+  unsigned long hits;
+  size_t threads;
+} Watch;
+
+// Returns false when the range needs more than four slots
+bool watch_create(Watch *watch, unsigned long address, size_t len,
+                  bool reads);
+
+void watch_destroy(Watch *watch);
+
+// Arms the registers of every thread of the target and lets it run for ms
+// milliseconds, handling each hit without asking anything of the user.
+// The registers are cleared and the target left running afterwards.
+// Returns false if they could not be set.
+bool watch_run(Watch *watch, Tracee *tracee, unsigned long ms);
+
+// The limit busiest sites, where they are in map and the registers of their
+// first hit
+void print_watch(const Watch *watch, const RegionMap *map, size_t limit);
+
+#endif
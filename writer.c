@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+#include "writer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+MemoryWriter writer_create(const pid_t pid) {
+  MemoryWriter writer;
+  writer.pid = pid;
+  writer.backend = READER_VM;
+  writer.mem_fd = -1;
+  writer.tracee = NULL;
+  writer.syscalls = 0;
+
+  return writer;
+}
+
+void writer_destroy(MemoryWriter *writer) {
+  if (writer->mem_fd != -1) {
+    close(writer->mem_fd);
+    writer->mem_fd = -1;
+  }
+}
+
+static void writer_fallback(MemoryWriter *writer) {
+  if (writer->backend == READER_VM) {
+    char mem_path[64];
+    snprintf(mem_path, sizeof(mem_path), "/proc/%d/mem", writer->pid);
+
+    writer->mem_fd = open(mem_path, O_RDWR);
+    if (writer->mem_fd != -1) {
+      writer->backend = READER_PROCMEM;
+      return;
+    }
+  }
+
+  writer->backend = READER_PTRACE;
+}
+
+static bool backend_unavailable(const int error) {
+  return error == ENOSYS || error == EPERM || error == EACCES;
+}
+
+// One process_vm_writev per IOV_MAX addresses. A short write stops at the
+// first address that faulted, which is skipped before going on. Sets next to
+// where another backend should pick up if this one turns out unavailable.
+static size_t write_vm(MemoryWriter *writer, const unsigned long *addresses,
+                       const size_t count, const unsigned char *values,
+                       const size_t step, const size_t width, size_t *next) {
+  struct iovec local[IOV_MAX];
+  struct iovec remote[IOV_MAX];
+  size_t written = 0;
+  size_t i = 0;
+
+  while (i < count && writer->backend == READER_VM) {
+    const size_t batch = count - i < IOV_MAX ? count - i : IOV_MAX;
+
+    for (size_t n = 0; n < batch; n++) {
+      local[n].iov_base = (void *)(values + (i + n) * step);
+      local[n].iov_len = width;
+      remote[n].iov_base = (void *)addresses[i + n];
+      remote[n].iov_len = width;
+    }
+
+    const ssize_t result =
+        process_vm_writev(writer->pid, local, batch, remote, batch, 0);
+    writer->syscalls++;
+
+    if (result == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (backend_unavailable(errno)) {
+        writer_fallback(writer);
+        break;
+      }
+      // The first address of the batch can't be written
+      i++;
+      continue;
+    }
+
+    // Only whole values count, a torn one is skipped like a fault
+    const size_t done = (size_t)result / width;
+    written += done;
+    i += done;
+    if (done < batch) {
+      i++;
+    }
+  }
+
+  *next = i;
+  return written;
+}
+
+static bool write_one(MemoryWriter *writer, const unsigned long address,
+                      const unsigned char *value, const size_t width) {
+  if (writer->backend == READER_PROCMEM) {
+    const ssize_t result = pwrite(writer->mem_fd, value, width, address);
+    writer->syscalls++;
+    if (result == -1 && backend_unavailable(errno)) {
+      writer_fallback(writer);
+      return write_one(writer, address, value, width);
+    }
+    return result == (ssize_t)width;
+  }
+
+  // Patch the value into the words it spans
+  for (size_t done = 0; done < width;) {
+    const unsigned long word_address = address + done;
+    const size_t step =
+        width - done < sizeof(long) ? width - done : sizeof(long);
+
+    errno = 0;
+    long word = ptrace(PTRACE_PEEKDATA, writer->pid, word_address, NULL);
+    writer->syscalls += 2;
+    if (word == -1 && errno != 0) {
+      return false;
+    }
+
+    memcpy(&word, value + done, step);
+    if (ptrace(PTRACE_POKEDATA, writer->pid, word_address, word) == -1) {
+      return false;
+    }
+    done += step;
+  }
+
+  return true;
+}
+
+static size_t write_batch(MemoryWriter *writer, const unsigned long *addresses,
+                          const size_t count, const unsigned char *values,
+                          const size_t step, const size_t width) {
+  size_t written = 0;
+  size_t i = 0;
+
+  if (writer->backend == READER_VM) {
+    written = write_vm(writer, addresses, count, values, step, width, &i);
+    if (writer->backend == READER_VM) {
+      return written;
+    }
+  }
+
+  const bool stop = writer->tracee != NULL && !writer->tracee->stopped &&
+                    writer->backend == READER_PTRACE;
+  if (stop && !tracee_stop(writer->tracee)) {
+    return 0;
+  }
+
+  for (; i < count; i++) {
+    written += write_one(writer, addresses[i], values + i * step, width);
+  }
+
+  if (stop) {
+    tracee_resume(writer->tracee);
+  }
+
+  return written;
+}
+
+size_t writer_write(MemoryWriter *writer, const unsigned long *addresses,
+                    const size_t count, const unsigned char *values,
+                    const size_t width) {
+  return write_batch(writer, addresses, count, values, width, width);
+}
+
+size_t writer_write_all(MemoryWriter *writer, const unsigned long *addresses,
+                        const size_t count, const unsigned char *value,
+                        const size_t width) {
+  return write_batch(writer, addresses, count, value, 0, width);
+}
@@ -0,0 +1,33 @@
+#ifndef WRITER_H
+#define WRITER_H
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "reader.h"
+#include "tracee.h"
+
+// Same backends as the reader, in the same fallback order
+typedef struct {
+  pid_t pid;
+  ReaderBackend backend;
+  int mem_fd;
+  Tracee *tracee; // Stopped around ptrace writes, may be NULL
+  unsigned long syscalls;
+} MemoryWriter;
+
+MemoryWriter writer_create(pid_t pid);
+
+void writer_destroy(MemoryWriter *writer);
+
+// Writes width bytes of values at each of count addresses, batching as many
+// addresses per syscall as the backend allows. Returns how many addresses
+// were written, unwritable ones are skipped.
+size_t writer_write(MemoryWriter *writer, const unsigned long *addresses,
+                    size_t count, const unsigned char *values, size_t width);
+
+// Same, writing the one value at every address
+size_t writer_write_all(MemoryWriter *writer, const unsigned long *addresses,
+                        size_t count, const unsigned char *value,
+                        size_t width);
+
+#endif